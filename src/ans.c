@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ans.h"
+#include "memory.h"
+
+ans_table *_ans_table_allocate(unsigned int symbol_count) {
+    ans_table *table = memory_alloc(MEMORY_TAG_BLOCK, sizeof(ans_table));
+    table->symbol_count = symbol_count;
+    table->counts = memory_alloc(MEMORY_TAG_BLOCK, symbol_count * sizeof(uint16_t));
+    table->states = memory_alloc(MEMORY_TAG_BLOCK, ANS_TABLE_SIZE * sizeof(uint16_t));
+    table->starts = memory_alloc(MEMORY_TAG_BLOCK, symbol_count * sizeof(unsigned int));
+    table->shifts = memory_alloc(MEMORY_TAG_BLOCK, symbol_count);
+    table->thresholds = memory_alloc(MEMORY_TAG_BLOCK, symbol_count * sizeof(uint32_t));
+    table->decode = memory_alloc(MEMORY_TAG_BLOCK, ANS_TABLE_SIZE * sizeof(ans_decode_entry));
+    return table;
+}
+
+ans_table *ans_table_create(const uint64_t *freqs, unsigned int symbol_count) {
+    ans_table *table = _ans_table_allocate(symbol_count);
+    _ans_normalize(freqs, symbol_count, table->counts);
+    _ans_build(table);
+    return table;
+}
+
+ans_table *ans_table_from_counts(const uint16_t *counts, unsigned int symbol_count) {
+    ans_table *table = _ans_table_allocate(symbol_count);
+    memcpy(table->counts, counts, symbol_count * sizeof(uint16_t));
+    if (!_ans_build(table)) {
+        ans_table_destroy(table);
+        return NULL;
+    }
+    return table;
+}
+
+void ans_table_destroy(ans_table *table) {
+    if (table == NULL) {
+        return;
+    }
+    memory_free(table->counts);
+    memory_free(table->states);
+    memory_free(table->starts);
+    memory_free(table->shifts);
+    memory_free(table->thresholds);
+    memory_free(table->decode);
+    memory_free(table);
+}
+
+void _ans_normalize(const uint64_t *freqs, unsigned int symbol_count, uint16_t *counts) {
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < symbol_count; i++) {
+        total += freqs[i];
+    }
+
+    memset(counts, 0, symbol_count * sizeof(uint16_t));
+    if (total == 0) {
+        return;
+    }
+
+    // scale with rounding, rare symbols keep at least one state
+    int sum = 0;
+    unsigned int largest = 0;
+    for (unsigned int i = 0; i < symbol_count; i++) {
+        if (freqs[i] == 0) {
+            continue;
+        }
+        uint64_t count = (freqs[i] * ANS_TABLE_SIZE + total / 2) / total;
+        counts[i] = count > 0 ? count : 1;
+        sum += counts[i];
+        if (counts[i] > counts[largest]) {
+            largest = i;
+        }
+    }
+
+    // the rounding error goes to the most frequent symbol, where it costs the least
+    if (sum < ANS_TABLE_SIZE) {
+        counts[largest] += ANS_TABLE_SIZE - sum;
+    }
+    while (sum > ANS_TABLE_SIZE) {
+        largest = 0;
+        for (unsigned int i = 1; i < symbol_count; i++) {
+            if (counts[i] > counts[largest]) {
+                largest = i;
+            }
+        }
+        counts[largest]--;
+        sum--;
+    }
+}
+
+bool _ans_build(ans_table *table) {
+    unsigned int sum = 0;
+    for (unsigned int i = 0; i < table->symbol_count; i++) {
+        sum += table->counts[i];
+    }
+    if (sum != ANS_TABLE_SIZE) {
+        // an empty block has no symbols, its tables are never used
+        return sum == 0;
+    }
+
+    // spread the symbols over the states with an odd step, which visits every state once
+    unsigned char spread[ANS_TABLE_SIZE];
+    unsigned int step = (ANS_TABLE_SIZE >> 1) + (ANS_TABLE_SIZE >> 3) + 3;
+    unsigned int position = 0;
+    for (unsigned int symbol = 0; symbol < table->symbol_count; symbol++) {
+        for (unsigned int i = 0; i < table->counts[symbol]; i++) {
+            spread[position] = symbol;
+            position = (position + step) & (ANS_TABLE_SIZE - 1);
+        }
+    }
+
+    // per symbol, the encoder sheds shift or shift - 1 bits so the state lands in [count, 2 * count)
+    unsigned int next[ANS_MAX_SYMBOLS];
+    unsigned int start = 0;
+    for (unsigned int symbol = 0; symbol < table->symbol_count; symbol++) {
+        unsigned int count = table->counts[symbol];
+        table->starts[symbol] = start;
+        start += count;
+        next[symbol] = count;
+
+        int high = 0;
+        while ((count >> (high + 1)) > 0) {
+            high++;
+        }
+        table->shifts[symbol] = ANS_TABLE_LOG - high;
+        table->thresholds[symbol] = count << table->shifts[symbol];
+    }
+
+    // the states of a symbol are numbered in the order they appear in the spread
+    for (unsigned int state = 0; state < ANS_TABLE_SIZE; state++) {
+        unsigned int symbol = spread[state];
+        unsigned int x = next[symbol]++;
+        table->states[table->starts[symbol] + x - table->counts[symbol]] = ANS_TABLE_SIZE + state;
+
+        int bits = 0;
+        while ((x << bits) < ANS_TABLE_SIZE) {
+            bits++;
+        }
+        table->decode[state].symbol = symbol;
+        table->decode[state].bits = bits;
+        table->decode[state].base = (x << bits) - ANS_TABLE_SIZE;
+    }
+
+    return true;
+}
+
+void ans_encode(const ans_table *table, const unsigned char *data, size_t count, size_t stride, bit_writer *writer) {
+    // the bits of each symbol, produced last to first
+    uint32_t *chunks = memory_alloc(MEMORY_TAG_BLOCK, (count > 0 ? count : 1) * sizeof(uint32_t));
+
+    unsigned int state = ANS_TABLE_SIZE;
+    for (size_t i = count; i-- > 0;) {
+        unsigned int symbol = data[i * stride];
+        int bits = table->shifts[symbol] - (state < table->thresholds[symbol]);
+        chunks[i] = (state & ((1u << bits) - 1)) | (bits << 16);
+        state = table->states[table->starts[symbol] + (state >> bits) - table->counts[symbol]];
+    }
+
+    // the final state comes first, then the bits in the order the decoder wants them
+    bit_writer_write(writer, state - ANS_TABLE_SIZE, ANS_TABLE_LOG);
+    for (size_t i = 0; i < count; i++) {
+        bit_writer_write(writer, chunks[i] & 0xFFFF, chunks[i] >> 16);
+    }
+
+    memory_free(chunks);
+}
@@ -0,0 +1,106 @@
+#ifndef ANS_H
+#define ANS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bitstream.h"
+
+#define ANS_TABLE_LOG 11                        // Bits of the state
+#define ANS_TABLE_SIZE (1 << ANS_TABLE_LOG)     // Number of states, also the sum of the normalized counts
+#define ANS_MAX_SYMBOLS 256                     // Largest alphabet
+
+/**
+ * Structure to represent what the decoder does in a state
+ */
+typedef struct ans_decode_entry {
+    uint16_t base;              // Next state before the bits read are added
+    uint8_t symbol;             // Symbol decoded in this state
+    uint8_t bits;               // Number of bits to read
+} ans_decode_entry;
+
+/**
+ * Structure to represent a tabled asymmetric numeral system coder, with its encode and decode tables
+ */
+typedef struct ans_table {
+    unsigned int symbol_count;  // Size of the alphabet
+    uint16_t *counts;           // Normalized counts, summing to ANS_TABLE_SIZE
+    uint16_t *states;           // Encoder, next state of each occurrence of each symbol, grouped by symbol
+    unsigned int *starts;       // Encoder, first entry of each symbol in states
+    unsigned char *shifts;      // Encoder, bits shed for a symbol in the upper states
+    uint32_t *thresholds;       // Encoder, states from which the symbol sheds its full shift
+    ans_decode_entry *decode;   // Decoder, one entry per state
+} ans_table;
+
+/**
+ * Creates the tables of a frequency table, normalizing the frequencies to ANS_TABLE_SIZE.
+ * @param freqs The frequency of each symbol.
+ * @param symbol_count The size of the alphabet, at most ANS_MAX_SYMBOLS.
+ * @return The new table.
+ */
+ans_table *ans_table_create(const uint64_t *freqs, unsigned int symbol_count);
+
+/**
+ * Creates the tables from the normalized counts stored in a file.
+ * @param counts The normalized count of each symbol.
+ * @param symbol_count The size of the alphabet, at most ANS_MAX_SYMBOLS.
+ * @return The new table, NULL if the counts do not add up to ANS_TABLE_SIZE.
+ */
+ans_table *ans_table_from_counts(const uint16_t *counts, unsigned int symbol_count);
+
+/**
+ * Destroys the table.
+ * @param table The table to destroy.
+ */
+void ans_table_destroy(ans_table *table);
+
+/**
+ * Encodes a strided run of symbols into one stream.
+ * The symbols are encoded last to first and their bits written back in order, so the decoder reads forward.
+ * @param table The table.
+ * @param data The symbols.
+ * @param count The number of symbols.
+ * @param stride The distance between two symbols of the stream.
+ * @param writer The bit writer.
+ */
+void ans_encode(const ans_table *table, const unsigned char *data, size_t count, size_t stride, bit_writer *writer);
+
+/**
+ * Scales the frequencies so they add up to ANS_TABLE_SIZE, every symbol that occurs keeps a count.
+ * @param freqs The frequency of each symbol.
+ * @param symbol_count The size of the alphabet.
+ * @param counts The normalized counts, written.
+ */
+void _ans_normalize(const uint64_t *freqs, unsigned int symbol_count, uint16_t *counts);
+
+/**
+ * Spreads the symbols over the states and fills the encode and decode tables.
+ * @param table The table, with its counts set.
+ * @return true if successful, false if the counts do not add up to ANS_TABLE_SIZE.
+ */
+bool _ans_build(ans_table *table);
+
+/**
+ * Reads the initial state of a stream.
+ * @param reader The bit reader.
+ * @return The state.
+ */
+static inline unsigned int ans_decode_init(bit_reader *reader) {
+    return (unsigned int)bit_reader_read(reader, ANS_TABLE_LOG);
+}
+
+/**
+ * Reads a symbol with a single table lookup.
+ * @param table The table.
+ * @param state The state of the stream, updated.
+ * @param reader The bit reader.
+ * @return The symbol.
+ */
+static inline unsigned int ans_decode(const ans_table *table, unsigned int *state, bit_reader *reader) {
+    ans_decode_entry entry = table->decode[*state];
+    *state = entry.base + (unsigned int)bit_reader_read(reader, entry.bits);
+    return entry.symbol;
+}
+
+#endif // ANS_H
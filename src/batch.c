@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "huffman.h"
+#include "memory.h"
+
+dynamic_array *batch_expand_arguments(char **arguments, int count) {
+    dynamic_array *input_files = dynamic_array_create();
+
+    for (int i = 0; i < count; i++) {
+        if (arguments[i][0] != '@') {
+            dynamic_array_insert(input_files, memory_strdup(MEMORY_TAG_OTHER, arguments[i]));
+            continue;
+        }
+
+        // read the list file, one input file per line
+        FILE *list = fopen(arguments[i] + 1, "r");
+        if (list == NULL) {
+            printf("Error: could not read list file '%s'\n", arguments[i] + 1);
+            continue;
+        }
+
+        char line[LINE_BUFFER_SIZE];
+        while (fgets(line, LINE_BUFFER_SIZE, list) != NULL) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] != '\0') {
+                dynamic_array_insert(input_files, memory_strdup(MEMORY_TAG_OTHER, line));
+            }
+        }
+
+        fclose(list);
+    }
+
+    return input_files;
+}
+
+int batch_default_thread_count() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+void batch_run(dynamic_array *input_files, bool compress, int type, int thread_count) {
+    if (thread_count <= 0) {
+        thread_count = batch_default_thread_count();
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // a few buffers per worker, so the reader can load the next files while the workers encode
+    int job_count = thread_count * BATCH_BUFFERS_PER_THREAD;
+    batch shared;
+    shared.compress = compress;
+    shared.type = type;
+    shared.jobs = blocking_queue_create(job_count);
+    shared.free_jobs = blocking_queue_create(job_count);
+
+    batch_job *jobs = memory_calloc(MEMORY_TAG_OTHER, job_count, sizeof(batch_job));
+    for (int i = 0; i < job_count; i++) {
+        blocking_queue_push(shared.free_jobs, &jobs[i]);
+    }
+
+    // start the workers
+    pthread_t *threads = memory_alloc(MEMORY_TAG_OTHER, thread_count * sizeof(pthread_t));
+    for (int i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, _batch_worker, &shared);
+    }
+
+    // feed the workers, loading each file before handing it over when compressing
+    for (int i = 0; i < input_files->size; i++) {
+        batch_job *job;
+        blocking_queue_pop(shared.free_jobs, (void **)&job);
+
+        job->input_file = input_files->array[i];
+        job->output_file = _batch_output_file(job->input_file, compress);
+
+        if (compress && !_batch_load_file(job)) {
+            printf("Error: could not read '%s'\n", job->input_file);
+            memory_free(job->output_file);
+            blocking_queue_push(shared.free_jobs, job);
+            continue;
+        }
+
+        blocking_queue_push(shared.jobs, job);
+    }
+
+    // let the workers drain the queue and stop
+    blocking_queue_close(shared.jobs);
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s %d files in %.3f s (%.1f files/s, %d threads)\n", compress ? "Compressed" : "Decompressed",
+           input_files->size, seconds, seconds > 0 ? input_files->size / seconds : 0.0, thread_count);
+
+    // deallocate the jobs and queues
+    for (int i = 0; i < job_count; i++) {
+        memory_free(jobs[i].data);
+    }
+    memory_free(jobs);
+    memory_free(threads);
+    blocking_queue_destroy(shared.jobs);
+    blocking_queue_destroy(shared.free_jobs);
+}
+
+void *_batch_worker(void *argument) {
+    batch *shared = argument;
+
+    // buffers reused for every file this thread compresses
+    huffman_scratch *scratch = huffman_scratch_create();
+
+    batch_job *job;
+    while (blocking_queue_pop(shared->jobs, (void **)&job)) {
+        if (shared->compress) {
+            huffman_encode_buffer(job->data, job->length, job->output_file, shared->type, scratch);
+        } else {
+            // the workers already keep the cores busy, block files are decoded on this thread alone
+            huffman_decode_file(job->input_file, job->output_file, 1);
+        }
+
+        // hand the buffer back to the reader
+        memory_free(job->output_file);
+        job->output_file = NULL;
+        blocking_queue_push(shared->free_jobs, job);
+    }
+
+    huffman_scratch_destroy(scratch);
+    return NULL;
+}
+
+bool _batch_load_file(batch_job *job) {
+    // open the input file for reading
+    FILE *input = fopen(job->input_file, "r");
+
+    // if the file does not exist, return false
+    if (input == NULL) {
+        return false;
+    }
+
+    // read the whole file, growing the buffer as needed
+    job->length = 0;
+    while (true) {
+        if (job->capacity - job->length < READ_BUFFER_SIZE + 1) {
+            job->capacity = job->capacity == 0 ? READ_BUFFER_SIZE + 1 : job->capacity * 2;
+            job->data = memory_realloc(MEMORY_TAG_OTHER, job->data, job->capacity);
+        }
+
+        size_t read = fread(job->data + job->length, sizeof(char), READ_BUFFER_SIZE, input);
+        job->length += read;
+        if (read < READ_BUFFER_SIZE) {
+            break;
+        }
+    }
+
+    job->data[job->length] = '\0';
+
+    fclose(input);
+    return true;
+}
+
+char *_batch_output_file(const char *input_file, bool compress) {
+    size_t length = strlen(input_file);
+    size_t extension_length = strlen(BATCH_OUTPUT_EXTENSION);
+    char *output_file = memory_alloc(MEMORY_TAG_OTHER, length + extension_length + 5);
+
+    strcpy(output_file, input_file);
+    if (compress) {
+        strcat(output_file, BATCH_OUTPUT_EXTENSION);
+    } else if (length > extension_length && strcmp(input_file + length - extension_length, BATCH_OUTPUT_EXTENSION) == 0) {
+        output_file[length - extension_length] = '\0';
+    } else {
+        strcat(output_file, ".out");
+    }
+
+    return output_file;
+}
@@ -0,0 +1,82 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "blocking_queue.h"
+#include "dynamic_array.h"
+
+#define BATCH_OUTPUT_EXTENSION ".huffed"
+#define BATCH_BUFFERS_PER_THREAD 2
+
+/**
+ * Structure to represent a file going through the batch
+ */
+typedef struct batch_job {
+    char *input_file;
+    char *output_file;
+    char *data;                 // Contents of the input file, loaded by the reader when compressing
+    size_t length;              // Length of the contents
+    size_t capacity;            // Capacity of the data buffer, reused between files
+} batch_job;
+
+/**
+ * Structure to represent a batch of files shared by the worker threads
+ */
+typedef struct batch {
+    bool compress;              // Compress, otherwise decompress
+    int type;                   // Type of compression
+    blocking_queue *jobs;       // Jobs waiting for a worker
+    blocking_queue *free_jobs;  // Jobs whose buffers the reader can fill again
+} batch;
+
+/**
+ * Expands the batch arguments into a list of input files.
+ * Arguments starting with '@' name a list file with one input file per line.
+ * @param arguments The arguments.
+ * @param count The number of arguments.
+ * @return The input files.
+ */
+dynamic_array *batch_expand_arguments(char **arguments, int count);
+
+/**
+ * Compresses or decompresses many files with a pool of worker threads.
+ * The calling thread reads the next files while the workers encode, so I/O overlaps with encoding.
+ * Compressed files get BATCH_OUTPUT_EXTENSION appended, decompressed files get it removed.
+ * @param input_files The input files.
+ * @param compress Compress the files, otherwise decompress them.
+ * @param type The type of compression.
+ * @param thread_count The number of worker threads, 0 for one per core.
+ */
+void batch_run(dynamic_array *input_files, bool compress, int type, int thread_count);
+
+/**
+ * Returns the number of cores available.
+ * @return The number of cores.
+ */
+int batch_default_thread_count();
+
+/**
+ * Worker thread, pops jobs until the queue is closed.
+ * @param argument The batch.
+ * @return NULL.
+ */
+void *_batch_worker(void *argument);
+
+/**
+ * Reads a whole file into the buffer of a job, growing it when needed.
+ * @param job The job.
+ * @return true if successful, false if the file could not be read.
+ */
+bool _batch_load_file(batch_job *job);
+
+/**
+ * Returns the name of the output file for an input file.
+ * @param input_file The input file.
+ * @param compress Whether the file is being compressed.
+ * @return The output file name.
+ */
+char *_batch_output_file(const char *input_file, bool compress);
+
+#endif // BATCH_H
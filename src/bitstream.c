@@ -0,0 +1,56 @@
+#include <stdlib.h>
+
+#include "bitstream.h"
+#include "memory.h"
+
+bit_writer *bit_writer_create(size_t capacity) {
+    bit_writer *writer = memory_alloc(MEMORY_TAG_BLOCK, sizeof(bit_writer));
+    writer->capacity = capacity > 0 ? capacity : 64;
+    writer->data = memory_alloc(MEMORY_TAG_BLOCK, writer->capacity);
+    writer->size = 0;
+    writer->buffer = 0;
+    writer->count = 0;
+    return writer;
+}
+
+void bit_writer_destroy(bit_writer *writer) {
+    if (writer == NULL) {
+        return;
+    }
+    memory_free(writer->data);
+    memory_free(writer);
+}
+
+void bit_writer_reset(bit_writer *writer) {
+    writer->size = 0;
+    writer->buffer = 0;
+    writer->count = 0;
+}
+
+void _bit_writer_reserve(bit_writer *writer, size_t length) {
+    if (writer->size + length <= writer->capacity) {
+        return;
+    }
+    while (writer->size + length > writer->capacity) {
+        writer->capacity *= 2;
+    }
+    writer->data = memory_realloc(MEMORY_TAG_BLOCK, writer->data, writer->capacity);
+}
+
+size_t bit_writer_finish(bit_writer *writer) {
+    // the last byte is padded with zeros
+    int bytes = (writer->count + 7) / 8;
+    _bit_writer_reserve(writer, bytes);
+    for (int i = 0; i < bytes; i++) {
+        writer->data[writer->size++] = (unsigned char)(writer->buffer >> (8 * i));
+    }
+    writer->buffer = 0;
+    writer->count = 0;
+    return writer->size;
+}
+
+void bit_writer_write_bytes(bit_writer *writer, const void *data, size_t length) {
+    _bit_writer_reserve(writer, length);
+    memcpy(writer->data + writer->size, data, length);
+    writer->size += length;
+}
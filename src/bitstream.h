@@ -0,0 +1,139 @@
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BIT_READER_PADDING 16   // Readable bytes needed after the data, so peeks never check bounds
+
+/**
+ * Structure to represent a growable buffer written bit by bit, least significant bit first
+ */
+typedef struct bit_writer {
+    unsigned char *data;        // Bytes written so far
+    size_t size;                // Number of bytes written
+    size_t capacity;            // Capacity of the data buffer
+    uint64_t buffer;            // Bits waiting to be written
+    int count;                  // Number of bits waiting, always below 32 between writes
+} bit_writer;
+
+/**
+ * Structure to represent a position in a bitstream, least significant bit first
+ */
+typedef struct bit_reader {
+    const unsigned char *data;  // Followed by BIT_READER_PADDING readable bytes
+    size_t position;            // Position in bits
+} bit_reader;
+
+/**
+ * Creates a new bit writer.
+ * @param capacity The initial capacity in bytes.
+ * @return The new bit writer.
+ */
+bit_writer *bit_writer_create(size_t capacity);
+
+/**
+ * Destroys the bit writer.
+ * @param writer The bit writer to destroy.
+ */
+void bit_writer_destroy(bit_writer *writer);
+
+/**
+ * Empties the bit writer, keeping its buffer.
+ * @param writer The bit writer.
+ */
+void bit_writer_reset(bit_writer *writer);
+
+/**
+ * Writes the bits waiting in the accumulator, padding the last byte with zeros.
+ * @param writer The bit writer.
+ * @return The number of bytes written.
+ */
+size_t bit_writer_finish(bit_writer *writer);
+
+/**
+ * Writes bytes at a byte boundary, the accumulator must be empty.
+ * @param writer The bit writer.
+ * @param data The bytes.
+ * @param length The number of bytes.
+ */
+void bit_writer_write_bytes(bit_writer *writer, const void *data, size_t length);
+
+/**
+ * Makes room for at least the given number of bytes.
+ * @param writer The bit writer.
+ * @param length The number of bytes.
+ */
+void _bit_writer_reserve(bit_writer *writer, size_t length);
+
+/**
+ * Writes up to 32 bits.
+ * @param writer The bit writer.
+ * @param bits The bits, the first one in the least significant bit.
+ * @param count The number of bits.
+ */
+static inline void bit_writer_write(bit_writer *writer, uint64_t bits, int count) {
+    writer->buffer |= bits << writer->count;
+    writer->count += count;
+
+    // move whole 32 bit words to the buffer
+    if (writer->count >= 32) {
+        if (writer->size + 4 > writer->capacity) {
+            _bit_writer_reserve(writer, 4);
+        }
+        unsigned char *out = writer->data + writer->size;
+        out[0] = (unsigned char)writer->buffer;
+        out[1] = (unsigned char)(writer->buffer >> 8);
+        out[2] = (unsigned char)(writer->buffer >> 16);
+        out[3] = (unsigned char)(writer->buffer >> 24);
+        writer->size += 4;
+        writer->buffer >>= 32;
+        writer->count -= 32;
+    }
+}
+
+/**
+ * Initializes a bit reader at the start of the data.
+ * @param reader The bit reader.
+ * @param data The data, followed by BIT_READER_PADDING readable bytes.
+ */
+static inline void bit_reader_init(bit_reader *reader, const unsigned char *data) {
+    reader->data = data;
+    reader->position = 0;
+}
+
+/**
+ * Returns the next bits without consuming them, at least 56 are valid.
+ * @param reader The bit reader.
+ * @return The bits, the next one in the least significant bit.
+ */
+static inline uint64_t bit_reader_peek(const bit_reader *reader) {
+    // one unaligned little endian load, the files are little endian like their headers
+    uint64_t value;
+    memcpy(&value, reader->data + (reader->position >> 3), sizeof(uint64_t));
+    return value >> (reader->position & 7);
+}
+
+/**
+ * Consumes bits.
+ * @param reader The bit reader.
+ * @param count The number of bits.
+ */
+static inline void bit_reader_consume(bit_reader *reader, int count) {
+    reader->position += count;
+}
+
+/**
+ * Reads up to 56 bits.
+ * @param reader The bit reader.
+ * @param count The number of bits.
+ * @return The bits, the first one in the least significant bit.
+ */
+static inline uint64_t bit_reader_read(bit_reader *reader, int count) {
+    uint64_t value = bit_reader_peek(reader) & ((1ULL << count) - 1);
+    reader->position += count;
+    return value;
+}
+
+#endif // BITSTREAM_H
@@ -2,30 +2,31 @@
 #include <stdio.h>
 
 #include "bitvector.h"
+#include "memory.h"
 
-bitvector* bitvector_create(int size) {
-    bitvector* bv = malloc(sizeof(bitvector));
+bitvector* bitvector_create(size_t size) {
+    bitvector* bv = memory_alloc(MEMORY_TAG_BITVECTOR, sizeof(bitvector));
     bv->size = size;
     bv->capacity = size / 8 + 1;
-    bv->bits = malloc(sizeof(char) * bv->capacity);
+    bv->bits = memory_alloc(MEMORY_TAG_BITVECTOR, sizeof(char) * bv->capacity);
     return bv;
 }
 
 void bitvector_destroy(bitvector* vector) {
-    free(vector->bits);
-    free(vector);
+    memory_free(vector->bits);
+    memory_free(vector);
 }
 
-char bitvector_get(const bitvector* vector, int index) {
+char bitvector_get(const bitvector* vector, size_t index) {
     // return vector->bits[index];
-    int byte_index = index / 8;
+    size_t byte_index = index / 8;
     int bit_index = index % 8;
     return (vector->bits[byte_index] >> bit_index) & 1;
 }
 
-void bitvector_set(bitvector* vector, int index, char value) {
+void bitvector_set(bitvector* vector, size_t index, char value) {
     // vector->bits[index] = value;
-    int byte_index = index / 8;
+    size_t byte_index = index / 8;
     int bit_index = index % 8;
     if (value) {
         vector->bits[byte_index] |= 1 << bit_index;
@@ -37,7 +38,7 @@ void bitvector_set(bitvector* vector, int index, char value) {
 void bitvector_append(bitvector* vector, char value) {
     if (vector->size / 8 + 1 >= vector->capacity) {
         vector->capacity *= 2;
-        vector->bits = realloc(vector->bits, sizeof(char) * vector->capacity);
+        vector->bits = memory_realloc(MEMORY_TAG_BITVECTOR, vector->bits, sizeof(char) * vector->capacity);
     }
     bitvector_set(vector, vector->size, value);
     vector->size++;
@@ -57,8 +58,8 @@ void bitvector_concat(bitvector* vector, const bitvector* other) {
         return;
     }
 
-    int byte_count = other->size / 8 + 1;
-    for (int i = 0; i < byte_count; i++) {
+    size_t byte_count = other->size / 8 + 1;
+    for (size_t i = 0; i < byte_count; i++) {
         for (int j = 0; j < 8 && i * 8 + j < other->size; j++) {
             bitvector_append(vector, (other->bits[i] >> j) & 1);
         }
@@ -67,12 +68,12 @@ void bitvector_concat(bitvector* vector, const bitvector* other) {
 }
 
 bitvector *bitvector_copy(const bitvector* vector) {
-    bitvector* bv = malloc(sizeof(bitvector));
+    bitvector* bv = memory_alloc(MEMORY_TAG_BITVECTOR, sizeof(bitvector));
     bv->size = vector->size;
-    bv->bits = malloc(sizeof(char) * vector->size / 8 + 1);
+    bv->bits = memory_alloc(MEMORY_TAG_BITVECTOR, sizeof(char) * vector->size / 8 + 1);
     bv->capacity = vector->size / 8 + 1;
     // Copy the bits
-    for (int i = 0; i < vector->size / 8 + 1; i++) {
+    for (size_t i = 0; i < vector->size / 8 + 1; i++) {
         bv->bits[i] = vector->bits[i];
     }
     return bv;
@@ -119,22 +120,22 @@ bitvector *bitvector_copy(const bitvector* vector) {
 // }
 
 void bitvector_reset(bitvector* vector) {
-    for (int i = 0; i < vector->size / 8 + 1; i++) {
+    for (size_t i = 0; i < vector->size / 8 + 1; i++) {
         vector->bits[i] = 0;
     }
     vector->size = 0;
 }
 
-int bitvector_size(const bitvector* vector) {
+size_t bitvector_size(const bitvector* vector) {
     return vector->size;
 }
 
 void bitvector_print(bitvector* bv) {
-    int byte_count = bv->size / 8 + 1;
+    size_t byte_count = bv->size / 8 + 1;
 
     // printf("byte_count: %d\n", byte_count);
     // printf("size: %d\n", bv->size);
-    for (int i = 0; i < byte_count; i++) {
+    for (size_t i = 0; i < byte_count; i++) {
         for (int j = 0; j < 8 && i * 8 + j < bv->size; j++) {
             printf("%d", (bv->bits[i] >> j) & 1);
         }
@@ -1,22 +1,24 @@
 #ifndef BITVECTOR_H
 #define BITVECTOR_H
 
+#include <stddef.h>
+
 typedef struct bitvector {
     // Array of bits
     unsigned char* bits;
-    // Number of bits
-    int size;
+    // Number of bits, 64-bit so the codes of a large file fit
+    size_t size;
     // Capacity of the array
-    unsigned int capacity;
+    size_t capacity;
 } bitvector;
 
-bitvector* bitvector_create(int size);
+bitvector* bitvector_create(size_t size);
 
 void bitvector_destroy(bitvector* vector);
 
-char bitvector_get(const bitvector* vector, int index);
+char bitvector_get(const bitvector* vector, size_t index);
 
-void bitvector_set(bitvector* vector, int index, char value);
+void bitvector_set(bitvector* vector, size_t index, char value);
 
 void bitvector_append(bitvector* vector, char value);
 
@@ -32,7 +34,7 @@ bitvector *bitvector_copy(const bitvector* vector);
 
 void bitvector_reset(bitvector* vector);
 
-int bitvector_size(const bitvector* vector);
+size_t bitvector_size(const bitvector* vector);
 
 void bitvector_print(bitvector* bv);
 
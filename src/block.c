@@ -0,0 +1,1153 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "block.h"
+#include "batch.h"
+#include "crc32c.h"
+#include "huffman.h"
+#include "mapped_file.h"
+#include "pipeline.h"
+#include "memory.h"
+
+bool block_encode_file(char *input_file, char *output_file, block_options *options) {
+    // open the input file for reading
+    FILE *input = fopen(input_file, "rb");
+
+    // if the file does not exist, return
+    if (input == NULL) {
+        printf("Error: could not read '%s'\n", input_file);
+        return false;
+    }
+
+    // open the output file for writing
+    FILE *output = fopen(output_file, "wb");
+
+    // if the file does not exist, return
+    if (output == NULL) {
+        printf("Error: could not create '%s'\n", output_file);
+        fclose(input);
+        return false;
+    }
+
+    // the padding bytes of the header are zeroed so they can be given a meaning later
+    block_file_header header;
+    memset(&header, 0, sizeof(block_file_header));
+    header.magic = BLOCK_MAGIC;
+    // char blocks share their tables when they can, the other types have more than one table per block
+    if (options->type == TYPE_CHAR) {
+        header.version = options->checksums ? BLOCK_VERSION_SHARED_CHECKSUMS : BLOCK_VERSION_SHARED;
+    } else {
+        header.version = options->checksums ? BLOCK_VERSION_CHECKSUMS : BLOCK_VERSION;
+    }
+    header.type = options->type;
+    header.streams = options->streams;
+    header.coder = options->coder;
+    header.block_size = options->block_size > 0 ? options->block_size : BLOCK_SIZE;
+    fwrite(&header, sizeof(block_file_header), 1, output);
+
+    block_index index = {.capacity = 16, .end = sizeof(block_file_header)};
+    index.entries = memory_alloc(MEMORY_TAG_BLOCK, index.capacity * sizeof(block_index_entry));
+    index.checksums = memory_alloc(MEMORY_TAG_BLOCK, index.capacity * sizeof(uint32_t));
+    block_table table = {.block = BLOCK_NO_TABLE};
+
+    bool written = _block_encode_blocks(input, output, &header, &options->lz, &index, &table);
+    if (!written) {
+        printf("Error: could not write '%s'\n", output_file);
+    }
+    _block_write_index(output, &header, &index);
+
+    _block_table_clear(&table);
+    memory_free(index.checksums);
+    memory_free(index.entries);
+
+    fclose(input);
+    fclose(output);
+    return written;
+}
+
+bool block_append_file(char *input_file, char *output_file, block_options *options) {
+    // open the compressed file for reading and writing, a file that does not exist yet is created
+    FILE *output = fopen(output_file, "r+b");
+    if (output == NULL) {
+        return block_encode_file(input_file, output_file, options);
+    }
+
+    // the blocks of the file stay where they are, only their index is read
+    block_file_header header;
+    block_index index;
+    uint32_t *checksums;
+    index.entries = _block_read_index(output, &header, &index.count, &checksums);
+    if (index.entries == NULL || header.block_size < BLOCK_MIN_SIZE) {
+        // files without blocks keep their codes in one stream that cannot be extended
+        printf("Error: '%s' is not a block file, only block files can be appended to\n", output_file);
+        memory_free(index.entries);
+        memory_free(checksums);
+        fclose(output);
+        return false;
+    }
+    index.capacity = index.count > 0 ? index.count : 1;
+    index.checksums = checksums != NULL ? checksums : memory_alloc(MEMORY_TAG_BLOCK, index.capacity * sizeof(uint32_t));
+    index.end = index.count > 0 ? index.entries[index.count - 1].offset + index.entries[index.count - 1].compressed_size
+                                : (int64_t)sizeof(block_file_header);
+
+    FILE *input = fopen(input_file, "rb");
+    if (input == NULL) {
+        printf("Error: could not read '%s'\n", input_file);
+        memory_free(index.checksums);
+        memory_free(index.entries);
+        fclose(output);
+        return false;
+    }
+
+    // the new blocks may go on with the last table shipped, which the last block that is not stored refers to
+    block_table table = {.block = BLOCK_NO_TABLE, .input = output, .index = index.entries,
+                         .block_count = index.count};
+    for (unsigned int i = index.count; i > 0 && block_shares_tables(&header); i--) {
+        unsigned int reference;
+        FSEEK64(output, index.entries[i - 1].offset, SEEK_SET);
+        if (fread(&reference, sizeof(unsigned int), 1, output) == 1 && reference != BLOCK_STORED) {
+            _block_table_fetch(&table, header.coder, reference);
+            break;
+        }
+    }
+    table.input = NULL;
+
+    // the new blocks overwrite the old index, which is written again with them after the last one
+    lz_options lz = options->lz;
+    if (header.type == TYPE_LZ && lz.level == 0) {
+        lz.level = LZ_LEVEL_FAST;
+    }
+    FSEEK64(output, index.end, SEEK_SET);
+    bool written = _block_encode_blocks(input, output, &header, &lz, &index, &table);
+    if (!written) {
+        printf("Error: could not write '%s'\n", output_file);
+    }
+    _block_write_index(output, &header, &index);
+
+    _block_table_clear(&table);
+    memory_free(index.checksums);
+    memory_free(index.entries);
+
+    fclose(input);
+    fclose(output);
+    return written;
+}
+
+bool _block_encode_blocks(FILE *input, FILE *output, const block_file_header *header, const lz_options *lz,
+                          block_index *index, block_table *table) {
+    // one bit writer per stream and one for the whole block, all reused between blocks
+    bit_writer *writers[BLOCK_MAX_STREAMS];
+    for (int i = 0; i < header->streams; i++) {
+        writers[i] = bit_writer_create(header->block_size / header->streams);
+    }
+    bit_writer *block = bit_writer_create(header->block_size);
+
+    // the match finder and its tokens, when the blocks go through LZ77 first
+    lz_matcher *matcher = NULL;
+    lz_token *tokens = NULL;
+    if (header->type == TYPE_LZ) {
+        matcher = lz_matcher_create(lz);
+        tokens = memory_alloc(MEMORY_TAG_BLOCK, header->block_size * sizeof(lz_token));
+    }
+
+    // a reader thread loads the next blocks and a writer thread stores the previous ones while this one encodes
+    pipeline *p = pipeline_start(input, output, header->block_size, NULL, 0, 0);
+    pipeline_buffer *in;
+    while ((in = pipeline_next_input(p)) != NULL) {
+        const unsigned char *data = in->data;
+        size_t length = in->size;
+        bit_writer_reset(block);
+        if (header->type == TYPE_CONTEXT) {
+            _block_encode_context(data, length, header->streams, writers, block);
+        } else if (header->type == TYPE_LZ) {
+            _block_encode_lz(matcher, data, length, tokens, writers[0], block);
+        } else {
+            _block_encode_char(data, length, header->coder, header->streams, writers, block, index->count,
+                               block_shares_tables(header) ? table : NULL);
+        }
+        if (index->count == index->capacity) {
+            index->capacity *= 2;
+            index->entries = memory_realloc(MEMORY_TAG_BLOCK, index->entries, index->capacity * sizeof(block_index_entry));
+            index->checksums = memory_realloc(MEMORY_TAG_BLOCK, index->checksums, index->capacity * sizeof(uint32_t));
+        }
+        if (block_has_checksums(header)) {
+            index->checksums[index->count] = crc32c(0, data, length);
+        }
+        pipeline_release_input(p, in);
+
+        pipeline_buffer *out = pipeline_output_buffer(p, block->size);
+        memcpy(out->data, block->data, block->size);
+        out->size = block->size;
+        pipeline_write(p, out);
+
+        index->entries[index->count].offset = index->end;
+        index->entries[index->count].original_size = length;
+        index->entries[index->count].compressed_size = block->size;
+        index->count++;
+        index->end += block->size;
+    }
+    bool written = pipeline_finish(p);
+
+    memory_free(tokens);
+    lz_matcher_destroy(matcher);
+    bit_writer_destroy(block);
+    for (int i = 0; i < header->streams; i++) {
+        bit_writer_destroy(writers[i]);
+    }
+    return written;
+}
+
+void _block_write_index(FILE *output, const block_file_header *header, const block_index *index) {
+    // the index and the trailer go last, so blocks are written as soon as they are encoded
+    block_trailer trailer;
+    memset(&trailer, 0, sizeof(block_trailer));
+    trailer.index_offset = index->end;
+    trailer.block_count = index->count;
+    trailer.magic = BLOCK_MAGIC;
+    FSEEK64(output, index->end, SEEK_SET);
+    fwrite(index->entries, sizeof(block_index_entry), index->count, output);
+    if (block_has_checksums(header)) {
+        fwrite(index->checksums, sizeof(uint32_t), index->count, output);
+    }
+    fwrite(&trailer, sizeof(block_trailer), 1, output);
+}
+
+void _block_encode_char(const unsigned char *data, size_t length, int coder, int streams, bit_writer **writers,
+                        bit_writer *output, unsigned int number, block_table *table) {
+    // files that do not share tables, older char files being appended to, give every block its own table
+    block_table own = {.block = BLOCK_NO_TABLE};
+    bool shared = table != NULL;
+    if (!shared) {
+        table = &own;
+    }
+
+    uint64_t freqs[BLOCK_ALPHABET_SIZE] = {0};
+    for (size_t i = 0; i < length; i++) {
+        freqs[data[i]]++;
+    }
+
+    // the table fitted to this block, then what it saves over the previous one once its own size is paid for
+    unsigned char lengths[BLOCK_ALPHABET_SIZE];
+    uint16_t counts[BLOCK_ALPHABET_SIZE];
+    double own_cost;
+    double previous_cost = INFINITY;
+    if (coder == BLOCK_CODER_ANS) {
+        _ans_normalize(freqs, BLOCK_ALPHABET_SIZE, counts);
+        own_cost = _block_table_cost(freqs, coder, NULL, counts) + sizeof(counts) * 8;
+        if (table->ans != NULL) {
+            previous_cost = _block_table_cost(freqs, coder, NULL, table->ans->counts);
+        }
+    } else {
+        _canonical_code_lengths(freqs, BLOCK_ALPHABET_SIZE, lengths);
+        own_cost = _block_table_cost(freqs, coder, lengths, NULL) + BLOCK_TABLE_BITS;
+        if (table->code != NULL) {
+            previous_cost = _block_table_cost(freqs, coder, table->code->lengths, NULL);
+        }
+    }
+
+    // a block that no table shrinks, such as compressed or random data, is stored after the marker
+    double coded_cost = (previous_cost < own_cost ? previous_cost : own_cost) + streams * sizeof(unsigned int) * 8;
+    if (shared && coded_cost >= (double)length * 8) {
+        unsigned int stored = BLOCK_STORED;
+        bit_writer_write_bytes(output, &stored, sizeof(unsigned int));
+        bit_writer_write_bytes(output, data, length);
+        return;
+    }
+
+    if (previous_cost > own_cost) {
+        _block_table_clear(table);
+        table->block = number;
+        if (coder == BLOCK_CODER_ANS) {
+            table->ans = ans_table_from_counts(counts, BLOCK_ALPHABET_SIZE);
+        } else {
+            table->code = canonical_code_from_lengths(lengths, BLOCK_ALPHABET_SIZE);
+        }
+    }
+
+    // the block of the table, then the table if it is this one
+    if (shared) {
+        bit_writer_write_bytes(output, &table->block, sizeof(unsigned int));
+    }
+    if (table->block == number) {
+        if (coder == BLOCK_CODER_ANS) {
+            bit_writer_write_bytes(output, table->ans->counts, BLOCK_ALPHABET_SIZE * sizeof(uint16_t));
+        } else {
+            _block_write_lengths(table->code, output);
+        }
+    }
+
+    for (int s = 0; s < streams; s++) {
+        bit_writer_reset(writers[s]);
+    }
+
+    if (coder == BLOCK_CODER_ANS) {
+        // symbol i goes to stream i % streams, each stream is encoded on its own
+        for (int s = 0; s < streams; s++) {
+            size_t count = (size_t)s < length ? (length - s + streams - 1) / streams : 0;
+            ans_encode(table->ans, data + s, count, streams, writers[s]);
+        }
+    } else {
+        // symbol i goes to stream i % streams
+        const canonical_code *code = table->code;
+        size_t i = 0;
+        for (; i + streams <= length; i += streams) {
+            for (int s = 0; s < streams; s++) {
+                canonical_code_encode(code, writers[s], data[i + s]);
+            }
+        }
+        for (int s = 0; i < length; i++, s++) {
+            canonical_code_encode(code, writers[s], data[i]);
+        }
+    }
+
+    // the size of each stream, then the streams back to back
+    unsigned int sizes[BLOCK_MAX_STREAMS];
+    for (int s = 0; s < streams; s++) {
+        sizes[s] = bit_writer_finish(writers[s]);
+    }
+    bit_writer_write_bytes(output, sizes, streams * sizeof(unsigned int));
+    for (int s = 0; s < streams; s++) {
+        bit_writer_write_bytes(output, writers[s]->data, sizes[s]);
+    }
+    _block_table_clear(&own);
+}
+
+double _block_table_cost(const uint64_t *freqs, int coder, const unsigned char *lengths, const uint16_t *counts) {
+    double cost = 0;
+    for (int i = 0; i < BLOCK_ALPHABET_SIZE; i++) {
+        if (freqs[i] == 0) {
+            continue;
+        }
+        if (coder == BLOCK_CODER_ANS ? counts[i] == 0 : lengths[i] == 0) {
+            return INFINITY;
+        }
+        // a symbol costs its code length, or the share of the states it leaves behind
+        cost += freqs[i] * (coder == BLOCK_CODER_ANS ? ANS_TABLE_LOG - log2((double)counts[i]) : (double)lengths[i]);
+    }
+    return cost;
+}
+
+bool _block_table_load(block_table *table, int coder, const unsigned char *data, unsigned int block) {
+    _block_table_clear(table);
+    if (coder == BLOCK_CODER_ANS) {
+        uint16_t counts[BLOCK_ALPHABET_SIZE];
+        memcpy(counts, data, sizeof(counts));
+        table->ans = ans_table_from_counts(counts, BLOCK_ALPHABET_SIZE);
+    } else {
+        table->code = _block_read_lengths(data, BLOCK_ALPHABET_SIZE);
+    }
+    if (table->ans == NULL && table->code == NULL) {
+        return false;
+    }
+    table->block = block;
+    return true;
+}
+
+bool _block_table_fetch(block_table *table, int coder, unsigned int block) {
+    size_t table_size = coder == BLOCK_CODER_ANS ? BLOCK_ALPHABET_SIZE * sizeof(uint16_t) : BLOCK_ALPHABET_SIZE / 2;
+    if (table->input == NULL || block >= table->block_count ||
+        table->index[block].compressed_size < sizeof(unsigned int) + table_size) {
+        return false;
+    }
+
+    // the block gives its own number when it ships its table
+    unsigned char data[sizeof(unsigned int) + BLOCK_ALPHABET_SIZE * sizeof(uint16_t)];
+    unsigned int reference;
+    FSEEK64(table->input, table->index[block].offset, SEEK_SET);
+    if (fread(data, 1, sizeof(unsigned int) + table_size, table->input) != sizeof(unsigned int) + table_size) {
+        return false;
+    }
+    memcpy(&reference, data, sizeof(unsigned int));
+    return reference == block && _block_table_load(table, coder, data + sizeof(unsigned int), block);
+}
+
+void _block_table_clear(block_table *table) {
+    canonical_code_destroy(table->code);
+    ans_table_destroy(table->ans);
+    table->code = NULL;
+    table->ans = NULL;
+    table->block = BLOCK_NO_TABLE;
+}
+
+bool block_decode_file(char *input_file, char *output_file, int thread_count) {
+    // open the input file for reading
+    FILE *input = fopen(input_file, "rb");
+
+    // if the file does not exist, return
+    if (input == NULL) {
+        return false;
+    }
+
+    block_file_header header;
+    unsigned int block_count;
+    uint32_t *checksums;
+    block_index_entry *index = _block_read_index(input, &header, &block_count, &checksums);
+    if (index == NULL) {
+        printf("Error: '%s' is not a valid block file\n", input_file);
+        fclose(input);
+        return false;
+    }
+
+    // open the output file for writing, readable too so it can be mapped
+    FILE *output = fopen(output_file, "w+b");
+
+    // if the file does not exist, return
+    if (output == NULL) {
+        memory_free(checksums);
+        memory_free(index);
+        fclose(input);
+        return false;
+    }
+
+    // check the index before following it, the original sizes give the position of every block in the output
+    uint64_t *positions = memory_alloc(MEMORY_TAG_BLOCK, (block_count + 1) * sizeof(uint64_t));
+    positions[0] = 0;
+    bool valid = true;
+    for (unsigned int i = 0; i < block_count; i++) {
+        if (index[i].original_size > header.block_size) {
+            printf("Error: block %u of '%s' is corrupted\n", i, input_file);
+            block_count = i;
+            valid = false;
+            break;
+        }
+        positions[i + 1] = positions[i] + index[i].original_size;
+    }
+
+    // the output has its final size from the start, so the blocks are decoded in place by several threads
+    mapped_file *mapped = valid ? mapped_file_create(output, positions[block_count]) : NULL;
+    if (mapped != NULL) {
+        valid = _block_run_decoders(input_file, &header, index, checksums, block_count, mapped->data, positions,
+                                    thread_count) == 0;
+        if (!mapped_file_close(mapped)) {
+            printf("Error: could not write '%s'\n", output_file);
+            valid = false;
+        }
+    } else if (valid) {
+        valid = _block_decode_stream(input_file, input, output, &header, index, checksums, block_count);
+    }
+
+    memory_free(positions);
+    memory_free(checksums);
+    memory_free(index);
+
+    fclose(input);
+    fclose(output);
+
+    // a mapped output already has its full size, so a failed block would leave garbage in place of its data
+    if (!valid) {
+        remove(output_file);
+    }
+    return valid;
+}
+
+bool _block_decode_stream(const char *input_file, FILE *input, FILE *output, const block_file_header *header,
+                          const block_index_entry *index, const uint32_t *checksums, unsigned int block_count) {
+    pipeline_extent *extents = memory_alloc(MEMORY_TAG_BLOCK, (block_count > 0 ? block_count : 1) * sizeof(pipeline_extent));
+    for (unsigned int i = 0; i < block_count; i++) {
+        extents[i].offset = index[i].offset;
+        extents[i].size = index[i].compressed_size;
+    }
+
+    // the blocks come in order, so the table a block reuses is always the last one loaded
+    block_table table = {.block = BLOCK_NO_TABLE};
+    bool valid = true;
+
+    // the padding after each block lets the bit readers load whole words without bound checks
+    pipeline *p = pipeline_start(input, output, 0, extents, block_count, BIT_READER_PADDING);
+    for (unsigned int i = 0; i < block_count; i++) {
+        pipeline_buffer *in = pipeline_next_input(p);
+        pipeline_buffer *out = pipeline_output_buffer(p, header->block_size > 0 ? header->block_size : 1);
+        valid = in->size == index[i].compressed_size &&
+                _block_decode(header, in->data, index[i].compressed_size, out->data, index[i].original_size, i,
+                              &table);
+        pipeline_release_input(p, in);
+        if (!valid) {
+            printf("Error: block %u of '%s' is corrupted\n", i, input_file);
+            break;
+        }
+        if (checksums != NULL && crc32c(0, out->data, index[i].original_size) != checksums[i]) {
+            printf("Error: block %u of '%s' failed its checksum\n", i, input_file);
+            valid = false;
+            break;
+        }
+
+        out->size = index[i].original_size;
+        pipeline_write(p, out);
+    }
+    if (!pipeline_finish(p)) {
+        printf("Error: could not write the decoded data\n");
+        valid = false;
+    }
+
+    _block_table_clear(&table);
+    memory_free(extents);
+    return valid;
+}
+
+bool _block_decode(const block_file_header *header, const unsigned char *block, size_t size, unsigned char *output,
+                   size_t length, unsigned int number, block_table *table) {
+    if (header->type == TYPE_LZ) {
+        return _block_decode_lz(block, size, output, length);
+    } else if (header->type == TYPE_CONTEXT) {
+        return _block_decode_context(block, size, header->streams, output, length);
+    }
+    return _block_decode_char(block, size, header->coder, header->streams, output, length, number,
+                              block_shares_tables(header) ? table : NULL);
+}
+
+bool block_verify_file(char *input_file, int thread_count) {
+    // open the input file for reading
+    FILE *input = fopen(input_file, "rb");
+
+    // if the file does not exist, return
+    if (input == NULL) {
+        printf("Error: could not read '%s'\n", input_file);
+        return false;
+    }
+
+    block_file_header header;
+    unsigned int block_count;
+    uint32_t *checksums;
+    block_index_entry *index = _block_read_index(input, &header, &block_count, &checksums);
+    fclose(input);
+    if (index == NULL) {
+        printf("Error: '%s' is not a valid block file\n", input_file);
+        return false;
+    }
+    if (checksums == NULL) {
+        printf("Warning: '%s' has no checksums, only checking that its blocks decode\n", input_file);
+    }
+
+    unsigned int failures = _block_run_decoders(input_file, &header, index, checksums, block_count, NULL, NULL,
+                                                thread_count);
+
+    memory_free(checksums);
+    memory_free(index);
+    return failures == 0;
+}
+
+unsigned int _block_run_decoders(const char *input_file, const block_file_header *header,
+                                 const block_index_entry *index, const uint32_t *checksums, unsigned int block_count,
+                                 unsigned char *output, const uint64_t *positions, int thread_count) {
+    // block i goes to thread i % thread_count, the blocks do not depend on each other
+    if (thread_count <= 0) {
+        thread_count = batch_default_thread_count();
+    }
+    block_decoder *decoders = memory_alloc(MEMORY_TAG_BLOCK, thread_count * sizeof(block_decoder));
+    pthread_t *threads = memory_alloc(MEMORY_TAG_BLOCK, thread_count * sizeof(pthread_t));
+    for (int t = 0; t < thread_count; t++) {
+        decoders[t].input_file = input_file;
+        decoders[t].header = header;
+        decoders[t].index = index;
+        decoders[t].checksums = checksums;
+        decoders[t].block_count = block_count;
+        decoders[t].output = output;
+        decoders[t].positions = positions;
+        decoders[t].first = t;
+        decoders[t].step = thread_count;
+        decoders[t].failures = 0;
+    }
+    for (int t = 1; t < thread_count; t++) {
+        pthread_create(&threads[t], NULL, _block_decode_worker, &decoders[t]);
+    }
+    _block_decode_worker(&decoders[0]);
+    unsigned int failures = decoders[0].failures;
+    for (int t = 1; t < thread_count; t++) {
+        pthread_join(threads[t], NULL);
+        failures += decoders[t].failures;
+    }
+
+    memory_free(threads);
+    memory_free(decoders);
+    return failures;
+}
+
+void *_block_decode_worker(void *argument) {
+    block_decoder *decoder = argument;
+    const block_file_header *header = decoder->header;
+
+    FILE *input = fopen(decoder->input_file, "rb");
+    if (input == NULL) {
+        decoder->failures = decoder->block_count;
+        return NULL;
+    }
+
+    // blocks are decoded straight into the output, or into a scratch buffer when only checked
+    size_t block_capacity = 0;
+    unsigned char *block = NULL;
+    unsigned char *scratch = decoder->output == NULL ? memory_alloc(MEMORY_TAG_BLOCK, header->block_size > 0 ? header->block_size : 1) : NULL;
+
+    // the blocks of the other threads are skipped, the tables they ship are read when needed
+    block_table table = {.block = BLOCK_NO_TABLE, .input = input, .index = decoder->index,
+                         .block_count = decoder->block_count};
+
+    for (unsigned int i = decoder->first; i < decoder->block_count; i += decoder->step) {
+        const block_index_entry *entry = &decoder->index[i];
+        unsigned char *decoded = decoder->output != NULL ? decoder->output + decoder->positions[i] : scratch;
+        if (entry->compressed_size > block_capacity) {
+            block_capacity = entry->compressed_size;
+            memory_free(block);
+            block = memory_alloc(MEMORY_TAG_BLOCK, block_capacity + BIT_READER_PADDING);
+            memset(block, 0, block_capacity + BIT_READER_PADDING);
+        }
+
+        FSEEK64(input, entry->offset, SEEK_SET);
+        bool valid = entry->original_size <= header->block_size &&
+                     fread(block, sizeof(unsigned char), entry->compressed_size, input) == entry->compressed_size &&
+                     _block_decode(header, block, entry->compressed_size, decoded, entry->original_size, i, &table);
+        if (!valid) {
+            printf("Error: block %u of '%s' is corrupted\n", i, decoder->input_file);
+            decoder->failures++;
+        } else if (decoder->checksums != NULL && crc32c(0, decoded, entry->original_size) != decoder->checksums[i]) {
+            printf("Error: block %u of '%s' failed its checksum\n", i, decoder->input_file);
+            decoder->failures++;
+        }
+    }
+
+    _block_table_clear(&table);
+    memory_free(block);
+    memory_free(scratch);
+    fclose(input);
+    return NULL;
+}
+
+bool _block_decode_char(const unsigned char *block, size_t size, int coder, int streams, unsigned char *output,
+                        size_t length, unsigned int number, block_table *shared) {
+    size_t table_size = coder == BLOCK_CODER_ANS ? BLOCK_ALPHABET_SIZE * sizeof(uint16_t) : BLOCK_ALPHABET_SIZE / 2;
+    if (streams < 1 || streams > BLOCK_MAX_STREAMS) {
+        return false;
+    }
+
+    // the table comes first, unless the block reuses the table of an earlier block
+    block_table own = {.block = BLOCK_NO_TABLE};
+    block_table *table = shared != NULL ? shared : &own;
+    unsigned int reference = number;
+    size_t position = 0;
+    if (shared != NULL) {
+        if (size < sizeof(unsigned int)) {
+            return false;
+        }
+        memcpy(&reference, block, sizeof(unsigned int));
+        position = sizeof(unsigned int);
+        if (reference == BLOCK_STORED) {
+            if (size - position != length) {
+                return false;
+            }
+            memcpy(output, block + position, length);
+            return true;
+        }
+    }
+    bool valid;
+    if (reference == number) {
+        valid = size - position >= table_size && _block_table_load(table, coder, block + position, number);
+        position += table_size;
+    } else {
+        valid = reference < number && (table->block == reference || _block_table_fetch(table, coder, reference));
+    }
+
+    // one reader per stream, each stops at the end of its own stream
+    size_t header_size = position + streams * sizeof(unsigned int);
+    unsigned int sizes[BLOCK_MAX_STREAMS];
+    bit_reader readers[BLOCK_MAX_STREAMS];
+    size_t ends[BLOCK_MAX_STREAMS];
+    valid = valid && size >= header_size;
+    if (valid) {
+        memcpy(sizes, block + position, streams * sizeof(unsigned int));
+        position = header_size;
+    }
+    for (int s = 0; s < streams && valid; s++) {
+        if (sizes[s] > size - position) {
+            valid = false;
+            break;
+        }
+        bit_reader_init(&readers[s], block + position);
+        ends[s] = (size_t)sizes[s] * 8;
+        position += sizes[s];
+    }
+
+    if (valid && coder == BLOCK_CODER_ANS) {
+        valid = _block_decode_ans(table->ans, readers, ends, streams, output, length);
+    } else if (valid) {
+        valid = _block_decode_huffman(table->code, readers, ends, streams, output, length);
+    }
+
+    _block_table_clear(&own);
+    return valid;
+}
+
+bool _block_decode_huffman(const canonical_code *code, bit_reader *readers, const size_t *ends, int streams,
+                           unsigned char *output, size_t length) {
+    // the streams do not depend on each other, so their lookups overlap in the pipeline
+    bool overrun = false;
+    size_t i = 0;
+    for (; i + streams <= length && !overrun; i += streams) {
+        for (int s = 0; s < streams; s++) {
+            output[i + s] = canonical_code_decode(code, &readers[s]);
+        }
+        // a corrupted stream reads at most one code past its end per round, well within the padding
+        for (int s = 0; s < streams; s++) {
+            overrun |= readers[s].position > ends[s];
+        }
+    }
+    for (int s = 0; i < length && !overrun; i++, s++) {
+        output[i] = canonical_code_decode(code, &readers[s]);
+        overrun |= readers[s].position > ends[s];
+    }
+
+    return !overrun;
+}
+
+bool _block_decode_ans(const ans_table *table, bit_reader *readers, const size_t *ends, int streams,
+                       unsigned char *output, size_t length) {
+    // every stream starts with its own state
+    unsigned int states[BLOCK_MAX_STREAMS];
+    for (int s = 0; s < streams; s++) {
+        states[s] = ans_decode_init(&readers[s]);
+    }
+
+    bool overrun = false;
+    size_t i = 0;
+    for (; i + streams <= length && !overrun; i += streams) {
+        for (int s = 0; s < streams; s++) {
+            output[i + s] = ans_decode(table, &states[s], &readers[s]);
+        }
+        for (int s = 0; s < streams; s++) {
+            overrun |= readers[s].position > ends[s];
+        }
+    }
+    for (int s = 0; i < length && !overrun; i++, s++) {
+        output[i] = ans_decode(table, &states[s], &readers[s]);
+        overrun |= readers[s].position > ends[s];
+    }
+
+    return !overrun;
+}
+
+block_index_entry *_block_read_index(FILE *input, block_file_header *header, unsigned int *block_count,
+                                     uint32_t **checksums) {
+    *checksums = NULL;
+    FSEEK64(input, 0, SEEK_SET);
+    if (fread(header, sizeof(block_file_header), 1, input) != 1 || header->magic != BLOCK_MAGIC ||
+        header->version < BLOCK_VERSION || header->version > BLOCK_VERSION_SHARED_CHECKSUMS || header->streams < 1 ||
+        header->streams > BLOCK_MAX_STREAMS || header->coder > BLOCK_CODER_ANS || header->block_size > BLOCK_MAX_SIZE) {
+        return NULL;
+    }
+
+    // the trailer is the last thing in the file and points at the index right before it, then the checksums
+    block_trailer trailer;
+    FSEEK64(input, 0, SEEK_END);
+    int64_t end = FTELL64(input);
+    FSEEK64(input, -(int64_t)sizeof(block_trailer), SEEK_END);
+    size_t entry_size = sizeof(block_index_entry) + (block_has_checksums(header) ? sizeof(uint32_t) : 0);
+    if (fread(&trailer, sizeof(block_trailer), 1, input) != 1 || trailer.magic != BLOCK_MAGIC ||
+        trailer.index_offset + (int64_t)(trailer.block_count * entry_size) + (int64_t)sizeof(block_trailer) != end) {
+        return NULL;
+    }
+
+    block_index_entry *index = memory_alloc(MEMORY_TAG_BLOCK, (trailer.block_count > 0 ? trailer.block_count : 1) * sizeof(block_index_entry));
+    FSEEK64(input, trailer.index_offset, SEEK_SET);
+    if (fread(index, sizeof(block_index_entry), trailer.block_count, input) != trailer.block_count) {
+        memory_free(index);
+        return NULL;
+    }
+
+    if (block_has_checksums(header)) {
+        *checksums = memory_alloc(MEMORY_TAG_BLOCK, (trailer.block_count > 0 ? trailer.block_count : 1) * sizeof(uint32_t));
+        if (fread(*checksums, sizeof(uint32_t), trailer.block_count, input) != trailer.block_count) {
+            memory_free(*checksums);
+            *checksums = NULL;
+            memory_free(index);
+            return NULL;
+        }
+    }
+
+    *block_count = trailer.block_count;
+    return index;
+}
+
+void _block_encode_context(const unsigned char *data, size_t length, int streams, bit_writer **writers,
+                           bit_writer *output) {
+    // segment s covers the bytes from starts[s] to starts[s + 1]
+    size_t starts[BLOCK_MAX_STREAMS + 1];
+    for (int s = 0; s <= streams; s++) {
+        starts[s] = length * s / streams;
+    }
+
+    // count the bytes following each context, every segment starts in context 0
+    uint64_t (*freqs)[BLOCK_ALPHABET_SIZE] = memory_calloc(MEMORY_TAG_BLOCK, BLOCK_ALPHABET_SIZE, sizeof(*freqs));
+    for (int s = 0; s < streams; s++) {
+        unsigned char context = 0;
+        for (size_t i = starts[s]; i < starts[s + 1]; i++) {
+            freqs[context][data[i]]++;
+            context = data[i];
+        }
+    }
+
+    unsigned char map[BLOCK_ALPHABET_SIZE];
+    unsigned int cluster_count = _block_cluster_contexts(freqs, map);
+
+    // the number of tables, the table of each context, then the code lengths of each table
+    unsigned char count_byte = cluster_count;
+    bit_writer_write_bytes(output, &count_byte, 1);
+    bit_writer_write_bytes(output, map, BLOCK_ALPHABET_SIZE);
+
+    canonical_code *codes[BLOCK_MAX_CLUSTERS];
+    for (unsigned int c = 0; c < cluster_count; c++) {
+        codes[c] = canonical_code_create(freqs[c], BLOCK_ALPHABET_SIZE);
+        _block_write_lengths(codes[c], output);
+    }
+
+    for (int s = 0; s < streams; s++) {
+        bit_writer_reset(writers[s]);
+        unsigned char context = 0;
+        for (size_t i = starts[s]; i < starts[s + 1]; i++) {
+            canonical_code_encode(codes[map[context]], writers[s], data[i]);
+            context = data[i];
+        }
+    }
+
+    // the size of each stream, then the streams back to back
+    unsigned int sizes[BLOCK_MAX_STREAMS];
+    for (int s = 0; s < streams; s++) {
+        sizes[s] = bit_writer_finish(writers[s]);
+    }
+    bit_writer_write_bytes(output, sizes, streams * sizeof(unsigned int));
+    for (int s = 0; s < streams; s++) {
+        bit_writer_write_bytes(output, writers[s]->data, sizes[s]);
+    }
+
+    for (unsigned int c = 0; c < cluster_count; c++) {
+        canonical_code_destroy(codes[c]);
+    }
+    memory_free(freqs);
+}
+
+double _block_entropy_cost(const uint64_t *freqs) {
+    uint64_t total = 0;
+    double cost = 0;
+    for (int i = 0; i < BLOCK_ALPHABET_SIZE; i++) {
+        if (freqs[i] > 0) {
+            total += freqs[i];
+            cost -= freqs[i] * log2((double)freqs[i]);
+        }
+    }
+    return total > 0 ? cost + total * log2((double)total) : 0;
+}
+
+unsigned int _block_cluster_contexts(uint64_t (*freqs)[BLOCK_ALPHABET_SIZE], unsigned char *map) {
+    // only the contexts that occur take part
+    unsigned int ids[BLOCK_ALPHABET_SIZE];
+    unsigned int k = 0;
+    for (unsigned int context = 0; context < BLOCK_ALPHABET_SIZE; context++) {
+        map[context] = 0;
+        for (int i = 0; i < BLOCK_ALPHABET_SIZE; i++) {
+            if (freqs[context][i] > 0) {
+                ids[k++] = context;
+                break;
+            }
+        }
+    }
+
+    if (k == 0) {
+        return 1;
+    }
+
+    // group i starts as context ids[i], merged groups point at the group they joined
+    double costs[BLOCK_ALPHABET_SIZE];
+    int parents[BLOCK_ALPHABET_SIZE];
+    for (unsigned int i = 0; i < k; i++) {
+        costs[i] = _block_entropy_cost(freqs[ids[i]]);
+        parents[i] = -1;
+    }
+
+    // what merging two groups costs, a negative cost is a saving
+    double (*deltas)[BLOCK_ALPHABET_SIZE] = memory_alloc(MEMORY_TAG_BLOCK, BLOCK_ALPHABET_SIZE * sizeof(*deltas));
+    uint64_t merged[BLOCK_ALPHABET_SIZE];
+    for (unsigned int i = 0; i < k; i++) {
+        for (unsigned int j = i + 1; j < k; j++) {
+            for (int s = 0; s < BLOCK_ALPHABET_SIZE; s++) {
+                merged[s] = freqs[ids[i]][s] + freqs[ids[j]][s];
+            }
+            deltas[i][j] = _block_entropy_cost(merged) - costs[i] - costs[j] - BLOCK_TABLE_BITS;
+        }
+    }
+
+    unsigned int cluster_count = k;
+    while (cluster_count > 1) {
+        // the cheapest merge left
+        unsigned int best_i = 0, best_j = 0;
+        double best = 0;
+        bool found = false;
+        for (unsigned int i = 0; i < k; i++) {
+            if (parents[i] != -1) {
+                continue;
+            }
+            for (unsigned int j = i + 1; j < k; j++) {
+                if (parents[j] == -1 && (!found || deltas[i][j] < best)) {
+                    best = deltas[i][j];
+                    best_i = i;
+                    best_j = j;
+                    found = true;
+                }
+            }
+        }
+
+        if (!found || (best >= 0 && cluster_count <= BLOCK_MAX_CLUSTERS)) {
+            break;
+        }
+
+        // fold j into i and refresh the costs of merging with i
+        for (int s = 0; s < BLOCK_ALPHABET_SIZE; s++) {
+            freqs[ids[best_i]][s] += freqs[ids[best_j]][s];
+        }
+        costs[best_i] = _block_entropy_cost(freqs[ids[best_i]]);
+        parents[best_j] = best_i;
+        cluster_count--;
+
+        for (unsigned int other = 0; other < k; other++) {
+            if (other == best_i || parents[other] != -1) {
+                continue;
+            }
+            for (int s = 0; s < BLOCK_ALPHABET_SIZE; s++) {
+                merged[s] = freqs[ids[best_i]][s] + freqs[ids[other]][s];
+            }
+            double delta = _block_entropy_cost(merged) - costs[best_i] - costs[other] - BLOCK_TABLE_BITS;
+            if (other < best_i) {
+                deltas[other][best_i] = delta;
+            } else {
+                deltas[best_i][other] = delta;
+            }
+        }
+    }
+    memory_free(deltas);
+
+    // number the groups that are left, and move their frequencies to the front
+    int numbers[BLOCK_ALPHABET_SIZE];
+    unsigned int number = 0;
+    for (unsigned int i = 0; i < k; i++) {
+        numbers[i] = parents[i] == -1 ? (int)number++ : -1;
+    }
+    for (unsigned int i = 0; i < k; i++) {
+        unsigned int root = i;
+        while (parents[root] != -1) {
+            root = parents[root];
+        }
+        map[ids[i]] = numbers[root];
+    }
+    for (unsigned int i = 0; i < k; i++) {
+        if (numbers[i] != -1 && (unsigned int)numbers[i] != ids[i]) {
+            memcpy(freqs[numbers[i]], freqs[ids[i]], sizeof(freqs[0]));
+        }
+    }
+
+    return cluster_count;
+}
+
+bool _block_decode_context(const unsigned char *block, size_t size, int streams, unsigned char *output,
+                           size_t length) {
+    if (streams < 1 || streams > BLOCK_MAX_STREAMS || size < 1 + BLOCK_ALPHABET_SIZE) {
+        return false;
+    }
+
+    unsigned int cluster_count = block[0];
+    const unsigned char *map = block + 1;
+    size_t header_size = 1 + BLOCK_ALPHABET_SIZE + cluster_count * (BLOCK_ALPHABET_SIZE / 2) +
+                         streams * sizeof(unsigned int);
+    if (cluster_count < 1 || cluster_count > BLOCK_MAX_CLUSTERS || size < header_size) {
+        return false;
+    }
+
+    // rebuild the code of each group
+    canonical_code *codes[BLOCK_MAX_CLUSTERS];
+    const unsigned char *packed = map + BLOCK_ALPHABET_SIZE;
+    bool valid = true;
+    for (unsigned int c = 0; c < cluster_count; c++) {
+        codes[c] = _block_read_lengths(packed, BLOCK_ALPHABET_SIZE);
+        packed += BLOCK_ALPHABET_SIZE / 2;
+        valid = valid && codes[c] != NULL;
+    }
+
+    // every context goes straight to its code
+    const canonical_code *context_codes[BLOCK_ALPHABET_SIZE];
+    for (int context = 0; context < BLOCK_ALPHABET_SIZE; context++) {
+        valid = valid && map[context] < cluster_count;
+        context_codes[context] = valid ? codes[map[context]] : NULL;
+    }
+
+    unsigned int sizes[BLOCK_MAX_STREAMS];
+    memcpy(sizes, packed, streams * sizeof(unsigned int));
+    bit_reader readers[BLOCK_MAX_STREAMS];
+    size_t ends[BLOCK_MAX_STREAMS];
+    size_t position = header_size;
+    for (int s = 0; s < streams && valid; s++) {
+        if (sizes[s] > size - position) {
+            valid = false;
+            break;
+        }
+        bit_reader_init(&readers[s], block + position);
+        ends[s] = (size_t)sizes[s] * 8;
+        position += sizes[s];
+    }
+
+    if (valid) {
+        // each segment carries its own context, so the segments decode side by side
+        size_t starts[BLOCK_MAX_STREAMS + 1];
+        unsigned char contexts[BLOCK_MAX_STREAMS];
+        for (int s = 0; s <= streams; s++) {
+            starts[s] = length * s / streams;
+        }
+        for (int s = 0; s < streams; s++) {
+            contexts[s] = 0;
+        }
+
+        // the first segment is the shortest, all segments have at least its length
+        size_t shortest = starts[1] - starts[0];
+        bool overrun = false;
+        for (size_t i = 0; i < shortest && !overrun; i++) {
+            for (int s = 0; s < streams; s++) {
+                contexts[s] = canonical_code_decode(context_codes[contexts[s]], &readers[s]);
+                output[starts[s] + i] = contexts[s];
+            }
+            for (int s = 0; s < streams; s++) {
+                overrun |= readers[s].position > ends[s];
+            }
+        }
+        for (int s = 0; s < streams && !overrun; s++) {
+            for (size_t i = starts[s] + shortest; i < starts[s + 1]; i++) {
+                contexts[s] = canonical_code_decode(context_codes[contexts[s]], &readers[s]);
+                output[i] = contexts[s];
+            }
+            overrun |= readers[s].position > ends[s];
+        }
+        valid = !overrun;
+    }
+
+    for (unsigned int c = 0; c < cluster_count; c++) {
+        canonical_code_destroy(codes[c]);
+    }
+
+    return valid;
+}
+
+void _block_write_lengths(const canonical_code *code, bit_writer *output) {
+    for (unsigned int i = 0; i < code->symbol_count; i += 2) {
+        unsigned char packed = code->lengths[i] | (code->lengths[i + 1] << 4);
+        bit_writer_write_bytes(output, &packed, 1);
+    }
+}
+
+canonical_code *_block_read_lengths(const unsigned char *packed, unsigned int symbol_count) {
+    unsigned char lengths[CANONICAL_MAX_SYMBOLS];
+    for (unsigned int i = 0; i < symbol_count / 2; i++) {
+        lengths[2 * i] = packed[i] & 0x0F;
+        lengths[2 * i + 1] = packed[i] >> 4;
+    }
+    return canonical_code_from_lengths(lengths, symbol_count);
+}
+
+void _block_encode_lz(lz_matcher *matcher, const unsigned char *data, size_t length, lz_token *tokens,
+                      bit_writer *writer, bit_writer *output) {
+    size_t token_count = lz_parse(matcher, data, length, tokens);
+
+    // literals and length codes share an alphabet, distances have their own
+    uint64_t literal_freqs[LZ_LITERAL_LENGTH_SYMBOLS] = {0};
+    uint64_t distance_freqs[LZ_DISTANCE_CODES] = {0};
+    for (size_t i = 0; i < token_count; i++) {
+        if (tokens[i].length == 0) {
+            literal_freqs[tokens[i].value]++;
+            continue;
+        }
+        unsigned int code;
+        int extra_bits;
+        lz_bucket(tokens[i].length - LZ_MIN_MATCH, &code, &extra_bits);
+        literal_freqs[256 + code]++;
+        lz_bucket(tokens[i].value - 1, &code, &extra_bits);
+        distance_freqs[code]++;
+    }
+
+    canonical_code *literal_code = canonical_code_create(literal_freqs, LZ_LITERAL_LENGTH_SYMBOLS);
+    canonical_code *distance_code = canonical_code_create(distance_freqs, LZ_DISTANCE_CODES);
+    _block_write_lengths(literal_code, output);
+    _block_write_lengths(distance_code, output);
+
+    bit_writer_reset(writer);
+    for (size_t i = 0; i < token_count; i++) {
+        if (tokens[i].length == 0) {
+            canonical_code_encode(literal_code, writer, tokens[i].value);
+            continue;
+        }
+        unsigned int code;
+        int extra_bits;
+        unsigned int extra = lz_bucket(tokens[i].length - LZ_MIN_MATCH, &code, &extra_bits);
+        canonical_code_encode(literal_code, writer, 256 + code);
+        bit_writer_write(writer, extra, extra_bits);
+        extra = lz_bucket(tokens[i].value - 1, &code, &extra_bits);
+        canonical_code_encode(distance_code, writer, code);
+        bit_writer_write(writer, extra, extra_bits);
+    }
+
+    // a single stream, its size then its bytes
+    unsigned int stream_size = bit_writer_finish(writer);
+    bit_writer_write_bytes(output, &stream_size, sizeof(unsigned int));
+    bit_writer_write_bytes(output, writer->data, stream_size);
+
+    canonical_code_destroy(literal_code);
+    canonical_code_destroy(distance_code);
+}
+
+bool _block_decode_lz(const unsigned char *block, size_t size, unsigned char *output, size_t length) {
+    size_t header_size = LZ_LITERAL_LENGTH_SYMBOLS / 2 + LZ_DISTANCE_CODES / 2 + sizeof(unsigned int);
+    if (size < header_size) {
+        return false;
+    }
+
+    canonical_code *literal_code = _block_read_lengths(block, LZ_LITERAL_LENGTH_SYMBOLS);
+    canonical_code *distance_code = _block_read_lengths(block + LZ_LITERAL_LENGTH_SYMBOLS / 2, LZ_DISTANCE_CODES);
+    unsigned int stream_size;
+    memcpy(&stream_size, block + header_size - sizeof(unsigned int), sizeof(unsigned int));
+
+    bool valid = literal_code != NULL && distance_code != NULL && stream_size <= size - header_size;
+    bit_reader reader;
+    bit_reader_init(&reader, block + header_size);
+    size_t end = (size_t)stream_size * 8;
+
+    size_t position = 0;
+    while (valid && position < length) {
+        unsigned int symbol = canonical_code_decode(literal_code, &reader);
+        if (symbol < 256) {
+            output[position++] = symbol;
+        } else {
+            int extra_bits;
+            unsigned int match = lz_bucket_base(symbol - 256, &extra_bits) + LZ_MIN_MATCH;
+            match += bit_reader_read(&reader, extra_bits);
+            unsigned int distance = lz_bucket_base(canonical_code_decode(distance_code, &reader), &extra_bits) + 1;
+            distance += bit_reader_read(&reader, extra_bits);
+
+            if (distance > position || match > length - position) {
+                valid = false;
+                break;
+            }
+
+            // copies may overlap what they write, a run of one byte repeated is the common case
+            const unsigned char *source = output + position - distance;
+            unsigned char *target = output + position;
+            if (distance >= match) {
+                memcpy(target, source, match);
+            } else {
+                for (unsigned int i = 0; i < match; i++) {
+                    target[i] = source[i];
+                }
+            }
+            position += match;
+        }
+        valid = reader.position <= end;
+    }
+
+    canonical_code_destroy(literal_code);
+    canonical_code_destroy(distance_code);
+
+    return valid;
+}
@@ -0,0 +1,444 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bitstream.h"
+#include "canonical.h"
+#include "ans.h"
+#include "lz.h"
+
+#define BLOCK_MAGIC 0x32465548          // "HUF2", block files
+#define BLOCK_VERSION 1
+#define BLOCK_VERSION_CHECKSUMS 2       // Version of files with a CRC32C of every block after the index
+#define BLOCK_VERSION_SHARED 3          // Version of char files whose blocks may reuse the table of an earlier block
+#define BLOCK_VERSION_SHARED_CHECKSUMS 4  // Both of the above
+#define BLOCK_SIZE (1 << 20)            // Input bytes per block, by default
+#define BLOCK_MIN_SIZE (1 << 12)        // Smallest block size that can be asked for
+#define BLOCK_MAX_SIZE (1 << 26)        // Largest block size, also the largest a file may declare
+#define BLOCK_MAX_STREAMS 8
+#define BLOCK_DEFAULT_STREAMS 4         // Streams when the block format is picked by another option
+#define BLOCK_ALPHABET_SIZE 256         // Symbols of the char mode
+
+#define BLOCK_MAX_CLUSTERS 32           // Most tables of a block in context mode
+#define BLOCK_TABLE_BITS (BLOCK_ALPHABET_SIZE / 2 * 8)  // Cost of storing one more table, in bits
+
+#define BLOCK_CODER_HUFFMAN 0           // Canonical huffman codes
+#define BLOCK_CODER_ANS 1               // Tabled asymmetric numeral system
+
+#define BLOCK_NO_TABLE 0xFFFFFFFFu      // Block of a shared table that holds none yet
+#define BLOCK_STORED 0xFFFFFFFEu        // Table of a block stored as is, when no table shrinks it
+
+/**
+ * Structure to represent the options of a block file
+ */
+typedef struct block_options {
+    int type;                           // Type of compression, TYPE_CHAR, TYPE_CONTEXT or TYPE_LZ
+    int streams;                        // Interleaved streams per block, 1 to BLOCK_MAX_STREAMS
+    int coder;                          // Entropy coder, BLOCK_CODER_HUFFMAN or BLOCK_CODER_ANS
+    lz_options lz;                      // Match finder, for TYPE_LZ
+    bool checksums;                     // Store the CRC32C of every block, checked when decoding
+    unsigned int block_size;            // Input bytes per block, BLOCK_SIZE if 0
+} block_options;
+
+/**
+ * Structure to represent the header at the start of a block file
+ */
+typedef struct block_file_header {
+    unsigned int magic;                 // BLOCK_MAGIC, where older files keep their root offset
+    unsigned char version;              // BLOCK_VERSION
+    unsigned char type;                 // Type of compression
+    unsigned char streams;              // Interleaved streams per block
+    unsigned char coder;                // Entropy coder of the blocks
+    unsigned int block_size;            // Input bytes per block, the last one may be shorter
+} block_file_header;
+
+/**
+ * Structure to represent a block in the index at the end of a block file
+ */
+typedef struct block_index_entry {
+    int64_t offset;                     // Offset of the block
+    unsigned int original_size;         // Size of the block once decoded
+    unsigned int compressed_size;       // Size of the block in the file
+} block_index_entry;
+
+/**
+ * Structure to represent the index of a file being written, kept in memory until it goes after the last block
+ */
+typedef struct block_index {
+    block_index_entry *entries;         // Offset and sizes of every block
+    uint32_t *checksums;                // CRC32C of every block, filled only if the file has them
+    unsigned int count;                 // Number of blocks
+    unsigned int capacity;              // Capacity of the arrays
+    int64_t end;                        // Offset after the last block, where the index goes
+} block_index;
+
+/**
+ * Structure to represent the table of a char block that later blocks may reuse.
+ * A block of a shared file starts with the number of the block whose table it uses; a block that ships
+ * its own table gives its own number, then the table, and a block stored as is gives BLOCK_STORED, then
+ * its bytes. Blocks only refer to the last table shipped, so a
+ * decoder going through the blocks in order always has it, and one that skips blocks reads it from the file.
+ */
+typedef struct block_table {
+    unsigned int block;                 // Block that shipped the table, BLOCK_NO_TABLE if none yet
+    canonical_code *code;               // The table, with BLOCK_CODER_HUFFMAN
+    ans_table *ans;                     // The table, with BLOCK_CODER_ANS
+    FILE *input;                        // Decoder, reads the tables of skipped blocks, NULL if there are none
+    const block_index_entry *index;     // Decoder, where the blocks are in the input
+    unsigned int block_count;           // Decoder, number of blocks in the index
+} block_table;
+
+/**
+ * Structure to represent a thread decoding every n-th block of a file
+ */
+typedef struct block_decoder {
+    const char *input_file;             // Opened by every thread, so each has its own position
+    const block_file_header *header;
+    const block_index_entry *index;
+    const uint32_t *checksums;          // CRC32C of every block, NULL if the file has none
+    unsigned int block_count;
+    unsigned char *output;              // The whole decoded file, NULL to only check the blocks
+    const uint64_t *positions;          // Position of every block in the output
+    unsigned int first;                 // First block of this thread
+    unsigned int step;                  // Number of threads
+    unsigned int failures;              // Blocks that could not be decoded or failed their checksum
+} block_decoder;
+
+/**
+ * Structure to represent the trailer at the very end of a block file
+ */
+typedef struct block_trailer {
+    int64_t index_offset;               // Offset of the index
+    unsigned int block_count;           // Number of blocks in the index
+    unsigned int magic;                 // BLOCK_MAGIC
+} block_trailer;
+
+/**
+ * Tells whether a block file stores the CRC32C of every block.
+ * @param header The file header.
+ * @return true if the file has checksums.
+ */
+static inline bool block_has_checksums(const block_file_header *header) {
+    return header->version == BLOCK_VERSION_CHECKSUMS || header->version == BLOCK_VERSION_SHARED_CHECKSUMS;
+}
+
+/**
+ * Tells whether the blocks of a file may reuse the table of an earlier block.
+ * @param header The file header.
+ * @return true if the blocks start with the number of the block of their table.
+ */
+static inline bool block_shares_tables(const block_file_header *header) {
+    return header->version == BLOCK_VERSION_SHARED || header->version == BLOCK_VERSION_SHARED_CHECKSUMS;
+}
+
+/**
+ * Compresses a file into blocks.
+ * Each block stores the code lengths of its canonical code, then its symbols dealt round robin
+ * over several bitstreams, so the decoder can follow the streams at once.
+ * In char mode a block keeps the table of the previous one when its histogram is coded about as well
+ * by it as by a table of its own plus the cost of storing it, so drifting data gets new tables and
+ * steady data does not pay for them. Blocks that would not shrink are stored as is.
+ * @param input_file The input file.
+ * @param output_file The output file.
+ * @param options The options.
+ * @return true if successful, false if a file could not be opened or written.
+ */
+bool block_encode_file(char *input_file, char *output_file, block_options *options);
+
+/**
+ * Compresses a file into new blocks at the end of an existing block file, without reading its blocks.
+ * The new blocks take the place of the index, which is written again after them with the new entries,
+ * so the cost is that of the new data. They keep the type, streams, coder, block size and checksums of
+ * the file; char blocks go on with the last table shipped, or ship a new one when it pays.
+ * A file that does not exist yet is created with the options. Char files of the versions before shared
+ * tables get new blocks in their own layout, each with its own table.
+ * @param input_file The new data.
+ * @param output_file The block file.
+ * @param options The options of a new file, and the match finder of new LZ blocks.
+ * @return true if successful, false if the file is not a block file or a file could not be read or written.
+ */
+bool block_append_file(char *input_file, char *output_file, block_options *options);
+
+/**
+ * Encodes a file into blocks at the current position of the output, adding them to the index.
+ * @param input The input file.
+ * @param output The output file.
+ * @param header The file header.
+ * @param lz The match finder, for TYPE_LZ.
+ * @param index The index, extended.
+ * @param table The last table shipped, for files that share tables.
+ * @return true if successful, false if the blocks could not be written.
+ */
+bool _block_encode_blocks(FILE *input, FILE *output, const block_file_header *header, const lz_options *lz,
+                          block_index *index, block_table *table);
+
+/**
+ * Writes the index, the checksums and the trailer after the last block.
+ * @param output The output file.
+ * @param header The file header.
+ * @param index The index.
+ */
+void _block_write_index(FILE *output, const block_file_header *header, const block_index *index);
+
+/**
+ * Decompresses a block file.
+ * The index gives the size of the output and where each block goes, so the output is mapped at its final
+ * size and the blocks are decoded in place by several threads.
+ * Blocks of files with checksums are checked as they are decoded.
+ * If a block is corrupted or fails its checksum, the output file is removed.
+ * @param input_file The input file.
+ * @param output_file The output file.
+ * @param thread_count The number of threads, 0 for one per core.
+ * @return true if every block was decoded and checked, false otherwise.
+ */
+bool block_decode_file(char *input_file, char *output_file, int thread_count);
+
+/**
+ * Decompresses the blocks of a file in order through the pipeline, when the output cannot be mapped.
+ * Stops at the first block that is corrupted or fails its checksum.
+ * @param input_file The name of the input file, for the errors.
+ * @param input The input file.
+ * @param output The output file.
+ * @param header The file header.
+ * @param index The index.
+ * @param checksums The CRC32C of every block, NULL if the file has none.
+ * @param block_count The number of blocks.
+ * @return true if every block was decoded and written, false otherwise.
+ */
+bool _block_decode_stream(const char *input_file, FILE *input, FILE *output, const block_file_header *header,
+                          const block_index_entry *index, const uint32_t *checksums, unsigned int block_count);
+
+/**
+ * Decodes every block of a file without writing it, checking the checksums if the file has them.
+ * The blocks are independent, so they are spread over several threads.
+ * @param input_file The input file.
+ * @param thread_count The number of threads, 0 for one per core.
+ * @return true if every block is valid, false otherwise.
+ */
+bool block_verify_file(char *input_file, int thread_count);
+
+/**
+ * Decodes and checks the blocks of a file on several threads.
+ * @param input_file The input file, opened by every thread.
+ * @param header The file header.
+ * @param index The index.
+ * @param checksums The CRC32C of every block, NULL if the file has none.
+ * @param block_count The number of blocks.
+ * @param output The whole decoded file, NULL to only check the blocks.
+ * @param positions The position of every block in the output.
+ * @param thread_count The number of threads, 0 for one per core.
+ * @return The number of blocks that could not be decoded or failed their checksum.
+ */
+unsigned int _block_run_decoders(const char *input_file, const block_file_header *header,
+                                 const block_index_entry *index, const uint32_t *checksums, unsigned int block_count,
+                                 unsigned char *output, const uint64_t *positions, int thread_count);
+
+/**
+ * Decoder thread, decodes and checks its share of the blocks.
+ * @param argument The block_decoder of the thread.
+ * @return NULL.
+ */
+void *_block_decode_worker(void *argument);
+
+/**
+ * Decodes one block of any type.
+ * @param header The file header.
+ * @param block The block, followed by BIT_READER_PADDING readable bytes.
+ * @param size The size of the block.
+ * @param output The output bytes.
+ * @param length The number of bytes to decode.
+ * @param number The number of the block.
+ * @param table The last table loaded by this decoder, for files that share tables.
+ * @return true if successful, false if the block is corrupted.
+ */
+bool _block_decode(const block_file_header *header, const unsigned char *block, size_t size, unsigned char *output,
+                   size_t length, unsigned int number, block_table *table);
+
+/**
+ * Encodes one block, reusing the previous table if it costs fewer bits than shipping a new one, or stores
+ * it if neither table makes it smaller.
+ * @param data The input bytes.
+ * @param length The number of bytes.
+ * @param coder The entropy coder.
+ * @param streams The number of interleaved streams.
+ * @param writers One bit writer per stream, reused between blocks.
+ * @param output The bit writer receiving the block.
+ * @param number The number of the block.
+ * @param table The last table shipped, replaced if this block ships one; NULL for files that do not share tables,
+ *              whose blocks always ship their table and are never stored.
+ */
+void _block_encode_char(const unsigned char *data, size_t length, int coder, int streams, bit_writer **writers,
+                        bit_writer *output, unsigned int number, block_table *table);
+
+/**
+ * Returns the number of bits a table spends on a histogram, without the table itself.
+ * @param freqs The frequencies.
+ * @param coder The entropy coder.
+ * @param lengths The code lengths of the table, with BLOCK_CODER_HUFFMAN.
+ * @param counts The normalized counts of the table, with BLOCK_CODER_ANS.
+ * @return The number of bits, INFINITY if a symbol of the histogram has no code.
+ */
+double _block_table_cost(const uint64_t *freqs, int coder, const unsigned char *lengths, const uint16_t *counts);
+
+/**
+ * Replaces a table with one read from a block.
+ * @param table The table.
+ * @param coder The entropy coder.
+ * @param data The packed code lengths or the normalized counts.
+ * @param block The block that ships the table.
+ * @return true if successful, false if the table is corrupted.
+ */
+bool _block_table_load(block_table *table, int coder, const unsigned char *data, unsigned int block);
+
+/**
+ * Reads the table shipped by a block that this decoder skipped.
+ * @param table The table, with its input and index set.
+ * @param coder The entropy coder.
+ * @param block The block that ships the table.
+ * @return true if successful, false if the table cannot be read or the block does not ship one.
+ */
+bool _block_table_fetch(block_table *table, int coder, unsigned int block);
+
+/**
+ * Frees the code of a table, the table itself belongs to the caller.
+ * @param table The table.
+ */
+void _block_table_clear(block_table *table);
+
+/**
+ * Encodes one block with a code per group of contexts, the context being the previous byte.
+ * The block is cut into one contiguous segment per stream, each starting in context 0,
+ * so the streams stay independent even though every byte depends on the one before.
+ * @param data The input bytes.
+ * @param length The number of bytes.
+ * @param streams The number of streams.
+ * @param writers One bit writer per stream, reused between blocks.
+ * @param output The bit writer receiving the block.
+ */
+void _block_encode_context(const unsigned char *data, size_t length, int streams, bit_writer **writers,
+                           bit_writer *output);
+
+/**
+ * Groups the contexts whose statistics are close enough to share a table.
+ * Pairs are merged greedily while merging saves more than the cost of a table, or while there are
+ * more than BLOCK_MAX_CLUSTERS groups.
+ * @param freqs The frequencies of the bytes following each context, replaced by those of each group.
+ * @param map The group of each context, written.
+ * @return The number of groups.
+ */
+unsigned int _block_cluster_contexts(uint64_t (*freqs)[BLOCK_ALPHABET_SIZE], unsigned char *map);
+
+/**
+ * Returns the number of bits an ideal coder spends on a histogram.
+ * @param freqs The frequencies.
+ * @return The number of bits.
+ */
+double _block_entropy_cost(const uint64_t *freqs);
+
+/**
+ * Encodes one block as literals and matches, with a code for literals and lengths and another for distances.
+ * The extra bits of lengths and distances follow their codes in a single stream.
+ * @param matcher The match finder.
+ * @param data The input bytes.
+ * @param length The number of bytes.
+ * @param tokens Room for length tokens, reused between blocks.
+ * @param writer The bit writer of the stream, reused between blocks.
+ * @param output The bit writer receiving the block.
+ */
+void _block_encode_lz(lz_matcher *matcher, const unsigned char *data, size_t length, lz_token *tokens,
+                      bit_writer *writer, bit_writer *output);
+
+/**
+ * Decodes one block coded by _block_encode_lz.
+ * @param block The block, followed by BIT_READER_PADDING readable bytes.
+ * @param size The size of the block.
+ * @param output The output bytes.
+ * @param length The number of bytes to decode.
+ * @return true if successful, false if the block is corrupted.
+ */
+bool _block_decode_lz(const unsigned char *block, size_t size, unsigned char *output, size_t length);
+
+/**
+ * Writes code lengths two per byte.
+ * @param code The canonical code.
+ * @param output The bit writer.
+ */
+void _block_write_lengths(const canonical_code *code, bit_writer *output);
+
+/**
+ * Reads code lengths written by _block_write_lengths.
+ * @param packed The packed lengths.
+ * @param symbol_count The size of the alphabet, even.
+ * @return The canonical code, NULL if the lengths do not form a prefix code.
+ */
+canonical_code *_block_read_lengths(const unsigned char *packed, unsigned int symbol_count);
+
+/**
+ * Decodes one block coded by _block_encode_context.
+ * @param block The block, followed by BIT_READER_PADDING readable bytes.
+ * @param size The size of the block.
+ * @param streams The number of streams.
+ * @param output The output bytes.
+ * @param length The number of bytes to decode.
+ * @return true if successful, false if the block is corrupted.
+ */
+bool _block_decode_context(const unsigned char *block, size_t size, int streams, unsigned char *output,
+                           size_t length);
+
+/**
+ * Decodes one block.
+ * @param block The block, followed by BIT_READER_PADDING readable bytes.
+ * @param size The size of the block.
+ * @param coder The entropy coder.
+ * @param streams The number of interleaved streams.
+ * @param output The output bytes.
+ * @param length The number of bytes to decode.
+ * @param number The number of the block.
+ * @param shared The last table loaded by this decoder, NULL if every block ships its own table.
+ * @return true if successful, false if the block is corrupted.
+ */
+bool _block_decode_char(const unsigned char *block, size_t size, int coder, int streams, unsigned char *output,
+                        size_t length, unsigned int number, block_table *shared);
+
+/**
+ * Decodes the streams of a block coded with a canonical huffman code.
+ * @param code The canonical code.
+ * @param readers One bit reader per stream.
+ * @param ends The end of each stream, in bits.
+ * @param streams The number of interleaved streams.
+ * @param output The output bytes.
+ * @param length The number of bytes to decode.
+ * @return true if successful, false if a stream ran past its end.
+ */
+bool _block_decode_huffman(const canonical_code *code, bit_reader *readers, const size_t *ends, int streams,
+                           unsigned char *output, size_t length);
+
+/**
+ * Decodes the streams of a block coded with tabled asymmetric numeral systems.
+ * @param table The table.
+ * @param readers One bit reader per stream.
+ * @param ends The end of each stream, in bits.
+ * @param streams The number of interleaved streams.
+ * @param output The output bytes.
+ * @param length The number of bytes to decode.
+ * @return true if successful, false if a stream ran past its end.
+ */
+bool _block_decode_ans(const ans_table *table, bit_reader *readers, const size_t *ends, int streams,
+                       unsigned char *output, size_t length);
+
+/**
+ * Reads the index of a block file.
+ * @param input The input file.
+ * @param header The file header, read.
+ * @param block_count The number of blocks, read.
+ * @param checksums The CRC32C of every block, read, NULL if the file has none; freed by the caller.
+ * @return The index, NULL if the file is not a valid block file.
+ */
+block_index_entry *_block_read_index(FILE *input, block_file_header *header, unsigned int *block_count,
+                                     uint32_t **checksums);
+
+#endif // BLOCK_H
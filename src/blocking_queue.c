@@ -0,0 +1,92 @@
+#include <stdlib.h>
+
+#include "blocking_queue.h"
+#include "memory.h"
+
+blocking_queue *blocking_queue_create(int capacity) {
+    // allocate memory for the queue
+    blocking_queue *queue = memory_alloc(MEMORY_TAG_PIPELINE, sizeof(blocking_queue));
+
+    // if allocation fails, return NULL
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    // initialize the queue
+    queue->items = memory_alloc(MEMORY_TAG_PIPELINE, capacity * sizeof(void *));
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->size = 0;
+    queue->closed = false;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+
+    return queue;
+}
+
+void blocking_queue_destroy(blocking_queue *queue) {
+    // if queue does not exist, do nothing
+    if (queue == NULL) {
+        return;
+    }
+
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    memory_free(queue->items);
+    memory_free(queue);
+}
+
+bool blocking_queue_push(blocking_queue *queue, void *item) {
+    pthread_mutex_lock(&queue->lock);
+
+    // wait for room in the queue
+    while (queue->size == queue->capacity && !queue->closed) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+
+    // add the item after the newest one
+    queue->items[(queue->head + queue->size) % queue->capacity] = item;
+    queue->size++;
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+bool blocking_queue_pop(blocking_queue *queue, void **item) {
+    pthread_mutex_lock(&queue->lock);
+
+    // wait for an item, a closed queue still hands out the items left
+    while (queue->size == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+
+    if (queue->size == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+
+    // take the oldest item
+    *item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->size--;
+
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+void blocking_queue_close(blocking_queue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,56 @@
+#ifndef BLOCKING_QUEUE_H
+#define BLOCKING_QUEUE_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/**
+ * Structure to represent a bounded queue shared between threads
+ */
+typedef struct blocking_queue {
+    void **items;               // Ring buffer of items
+    int capacity;               // Maximum number of items
+    int head;                   // Index of the oldest item
+    int size;                   // Number of items in the queue
+    bool closed;                // No more items will be pushed
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} blocking_queue;
+
+/**
+ * Creates a new blocking queue.
+ * @param capacity The maximum number of items in the queue.
+ * @return The new blocking queue.
+ */
+blocking_queue *blocking_queue_create(int capacity);
+
+/**
+ * Destroys the blocking queue, the items left are not destroyed.
+ * @param queue The blocking queue to destroy.
+ */
+void blocking_queue_destroy(blocking_queue *queue);
+
+/**
+ * Pushes an item, waiting while the queue is full.
+ * @param queue The blocking queue.
+ * @param item The item to push.
+ * @return true if successful, false if the queue was closed.
+ */
+bool blocking_queue_push(blocking_queue *queue, void *item);
+
+/**
+ * Pops the oldest item, waiting while the queue is empty.
+ * @param queue The blocking queue.
+ * @param item The popped item.
+ * @return true if successful, false if the queue is closed and empty.
+ */
+bool blocking_queue_pop(blocking_queue *queue, void **item);
+
+/**
+ * Closes the queue, waking up every waiting thread.
+ * @param queue The blocking queue.
+ */
+void blocking_queue_close(blocking_queue *queue);
+
+#endif // BLOCKING_QUEUE_H
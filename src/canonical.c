@@ -0,0 +1,196 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canonical.h"
+#include "memory.h"
+
+/**
+ * Structure to sort the symbols by frequency
+ */
+typedef struct _canonical_leaf {
+    uint64_t freq;
+    unsigned int symbol;
+} _canonical_leaf;
+
+int _canonical_leaf_compare(const void *key1, const void *key2) {
+    const _canonical_leaf *leaf1 = key1;
+    const _canonical_leaf *leaf2 = key2;
+    if (leaf1->freq != leaf2->freq) {
+        return leaf1->freq < leaf2->freq ? -1 : 1;
+    }
+    // ties are broken by symbol so every build gives the same code
+    return leaf1->symbol < leaf2->symbol ? -1 : leaf1->symbol > leaf2->symbol;
+}
+
+canonical_code *canonical_code_create(const uint64_t *freqs, unsigned int symbol_count) {
+    canonical_code *code = memory_alloc(MEMORY_TAG_BLOCK, sizeof(canonical_code));
+    code->symbol_count = symbol_count;
+    code->lengths = memory_alloc(MEMORY_TAG_BLOCK, symbol_count);
+    code->codes = memory_alloc(MEMORY_TAG_BLOCK, symbol_count * sizeof(unsigned int));
+    code->table = memory_alloc(MEMORY_TAG_BLOCK, CANONICAL_TABLE_SIZE * sizeof(uint32_t));
+
+    _canonical_code_lengths(freqs, symbol_count, code->lengths);
+    _canonical_code_assign(code);
+
+    return code;
+}
+
+canonical_code *canonical_code_from_lengths(const unsigned char *lengths, unsigned int symbol_count) {
+    canonical_code *code = memory_alloc(MEMORY_TAG_BLOCK, sizeof(canonical_code));
+    code->symbol_count = symbol_count;
+    code->lengths = memory_alloc(MEMORY_TAG_BLOCK, symbol_count);
+    code->codes = memory_alloc(MEMORY_TAG_BLOCK, symbol_count * sizeof(unsigned int));
+    code->table = memory_alloc(MEMORY_TAG_BLOCK, CANONICAL_TABLE_SIZE * sizeof(uint32_t));
+    memcpy(code->lengths, lengths, symbol_count);
+
+    if (!_canonical_code_assign(code)) {
+        canonical_code_destroy(code);
+        return NULL;
+    }
+
+    return code;
+}
+
+void canonical_code_destroy(canonical_code *code) {
+    if (code == NULL) {
+        return;
+    }
+    memory_free(code->lengths);
+    memory_free(code->codes);
+    memory_free(code->table);
+    memory_free(code);
+}
+
+void _canonical_code_lengths(const uint64_t *freqs, unsigned int symbol_count, unsigned char *lengths) {
+    memset(lengths, 0, symbol_count);
+
+    // only the symbols that occur get a code
+    _canonical_leaf *leaves = memory_alloc(MEMORY_TAG_BLOCK, symbol_count * sizeof(_canonical_leaf));
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < symbol_count; i++) {
+        if (freqs[i] > 0) {
+            leaves[n].freq = freqs[i];
+            leaves[n].symbol = i;
+            n++;
+        }
+    }
+
+    if (n == 0) {
+        memory_free(leaves);
+        return;
+    }
+
+    // a lone symbol still needs one bit
+    if (n == 1) {
+        lengths[leaves[0].symbol] = 1;
+        memory_free(leaves);
+        return;
+    }
+
+    // leaves are nodes 0 to n - 1, the inner nodes follow in the order they are created
+    uint64_t *weights = memory_alloc(MEMORY_TAG_BLOCK, 2 * n * sizeof(uint64_t));
+    unsigned int *parents = memory_alloc(MEMORY_TAG_BLOCK, 2 * n * sizeof(unsigned int));
+    unsigned char *depths = memory_alloc(MEMORY_TAG_BLOCK, 2 * n);
+
+    while (true) {
+        qsort(leaves, n, sizeof(_canonical_leaf), _canonical_leaf_compare);
+        for (unsigned int i = 0; i < n; i++) {
+            weights[i] = leaves[i].freq;
+        }
+
+        // both the leaves and the inner nodes come out sorted, so two queues replace the priority queue
+        unsigned int leaf = 0, inner = n;
+        for (unsigned int next = n; next < 2 * n - 1; next++) {
+            unsigned int children[2];
+            for (int j = 0; j < 2; j++) {
+                if (leaf < n && (inner >= next || weights[leaf] <= weights[inner])) {
+                    children[j] = leaf++;
+                } else {
+                    children[j] = inner++;
+                }
+            }
+            weights[next] = weights[children[0]] + weights[children[1]];
+            parents[children[0]] = next;
+            parents[children[1]] = next;
+        }
+
+        // the root is the last node, every node comes before its parent
+        int max_depth = 0;
+        depths[2 * n - 2] = 0;
+        for (int i = 2 * n - 3; i >= 0; i--) {
+            depths[i] = depths[parents[i]] + 1;
+            if (depths[i] > max_depth) {
+                max_depth = depths[i];
+            }
+        }
+
+        if (max_depth <= CANONICAL_MAX_LENGTH) {
+            for (unsigned int i = 0; i < n; i++) {
+                lengths[leaves[i].symbol] = depths[i];
+            }
+            break;
+        }
+
+        // too deep, flatten the frequencies and try again, all ones gives a balanced tree
+        for (unsigned int i = 0; i < n; i++) {
+            leaves[i].freq = (leaves[i].freq >> 1) | 1;
+        }
+    }
+
+    memory_free(weights);
+    memory_free(parents);
+    memory_free(depths);
+    memory_free(leaves);
+}
+
+bool _canonical_code_assign(canonical_code *code) {
+    // count the codes of each length
+    unsigned int length_counts[CANONICAL_MAX_LENGTH + 1] = {0};
+    for (unsigned int i = 0; i < code->symbol_count; i++) {
+        if (code->lengths[i] > CANONICAL_MAX_LENGTH) {
+            return false;
+        }
+        length_counts[code->lengths[i]]++;
+    }
+    length_counts[0] = 0;
+
+    // the first code of each length, rejecting lengths that overflow the code space
+    unsigned int next_code[CANONICAL_MAX_LENGTH + 1];
+    unsigned int value = 0;
+    for (int length = 1; length <= CANONICAL_MAX_LENGTH; length++) {
+        value = (value + length_counts[length - 1]) << 1;
+        next_code[length] = value;
+        if (value + length_counts[length] > (1u << length)) {
+            return false;
+        }
+    }
+
+    // unused entries consume a whole table width, so corrupted data still moves forward
+    for (int i = 0; i < CANONICAL_TABLE_SIZE; i++) {
+        code->table[i] = CANONICAL_MAX_LENGTH;
+    }
+
+    for (unsigned int symbol = 0; symbol < code->symbol_count; symbol++) {
+        int length = code->lengths[symbol];
+        if (length == 0) {
+            code->codes[symbol] = 0;
+            continue;
+        }
+
+        // codes are read least significant bit first, so store them reversed
+        unsigned int canonical = next_code[length]++;
+        unsigned int reversed = 0;
+        for (int bit = 0; bit < length; bit++) {
+            reversed |= ((canonical >> bit) & 1) << (length - 1 - bit);
+        }
+        code->codes[symbol] = reversed;
+
+        // every table index starting with the code decodes to the symbol
+        for (unsigned int index = reversed; index < CANONICAL_TABLE_SIZE; index += 1u << length) {
+            code->table[index] = (symbol << 8) | length;
+        }
+    }
+
+    return true;
+}
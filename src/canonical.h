@@ -0,0 +1,83 @@
+#ifndef CANONICAL_H
+#define CANONICAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitstream.h"
+
+#define CANONICAL_MAX_LENGTH 12                         // Longest code, also the number of bits of the decode table
+#define CANONICAL_TABLE_SIZE (1 << CANONICAL_MAX_LENGTH)
+#define CANONICAL_MAX_SYMBOLS 1024                      // Largest alphabet
+
+/**
+ * Structure to represent a length limited canonical huffman code, with its decode table
+ */
+typedef struct canonical_code {
+    unsigned int symbol_count;  // Size of the alphabet
+    unsigned char *lengths;     // Code length of each symbol, 0 for symbols that do not occur
+    unsigned int *codes;        // Code of each symbol, bit reversed for least significant bit first streams
+    uint32_t *table;            // Symbol << 8 | length, indexed by the next CANONICAL_MAX_LENGTH bits
+} canonical_code;
+
+/**
+ * Creates the canonical code of a frequency table.
+ * Codes longer than CANONICAL_MAX_LENGTH are avoided by flattening the frequencies.
+ * @param freqs The frequency of each symbol.
+ * @param symbol_count The size of the alphabet, at most CANONICAL_MAX_SYMBOLS.
+ * @return The new canonical code.
+ */
+canonical_code *canonical_code_create(const uint64_t *freqs, unsigned int symbol_count);
+
+/**
+ * Creates a canonical code from the code lengths stored in a file.
+ * @param lengths The code length of each symbol.
+ * @param symbol_count The size of the alphabet, at most CANONICAL_MAX_SYMBOLS.
+ * @return The new canonical code, NULL if the lengths do not form a prefix code.
+ */
+canonical_code *canonical_code_from_lengths(const unsigned char *lengths, unsigned int symbol_count);
+
+/**
+ * Destroys the canonical code.
+ * @param code The canonical code to destroy.
+ */
+void canonical_code_destroy(canonical_code *code);
+
+/**
+ * Computes huffman code lengths limited to CANONICAL_MAX_LENGTH.
+ * @param freqs The frequency of each symbol.
+ * @param symbol_count The size of the alphabet.
+ * @param lengths The code length of each symbol, written.
+ */
+void _canonical_code_lengths(const uint64_t *freqs, unsigned int symbol_count, unsigned char *lengths);
+
+/**
+ * Assigns the codes from the lengths and fills the decode table.
+ * @param code The canonical code, with its lengths set.
+ * @return true if successful, false if the lengths do not form a prefix code.
+ */
+bool _canonical_code_assign(canonical_code *code);
+
+/**
+ * Writes a symbol.
+ * @param code The canonical code.
+ * @param writer The bit writer.
+ * @param symbol The symbol.
+ */
+static inline void canonical_code_encode(const canonical_code *code, bit_writer *writer, unsigned int symbol) {
+    bit_writer_write(writer, code->codes[symbol], code->lengths[symbol]);
+}
+
+/**
+ * Reads a symbol with a single table lookup.
+ * @param code The canonical code.
+ * @param reader The bit reader.
+ * @return The symbol.
+ */
+static inline unsigned int canonical_code_decode(const canonical_code *code, bit_reader *reader) {
+    uint32_t entry = code->table[bit_reader_peek(reader) & (CANONICAL_TABLE_SIZE - 1)];
+    bit_reader_consume(reader, entry & 0xFF);
+    return entry >> 8;
+}
+
+#endif // CANONICAL_H
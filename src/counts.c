@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "counts.h"
+#include "memory.h"
+
+bool counts_write(const char *counts_file, int type, const vocabulary *vocab) {
+    // open the counts file for writing
+    FILE *output = fopen(counts_file, "wb");
+
+    // if the file cannot be created, return
+    if (output == NULL) {
+        printf("Error: could not write '%s'\n", counts_file);
+        return false;
+    }
+
+    counts_header header;
+    memset(&header, 0, sizeof(counts_header));
+    header.magic = COUNTS_MAGIC;
+    header.type = type;
+    header.symbol_count = vocab->count;
+    fwrite(&header, sizeof(counts_header), 1, output);
+
+    for (size_t i = 0; i < vocab->count; i++) {
+        unsigned int length = strlen(vocab->words[i]);
+        fwrite(&length, sizeof(unsigned int), 1, output);
+        fwrite(vocab->words[i], sizeof(char), length, output);
+        fwrite(&vocab->freqs[i], sizeof(uint64_t), 1, output);
+    }
+
+    bool success = !ferror(output);
+    success &= fclose(output) == 0;
+    if (!success) {
+        printf("Error: could not write '%s'\n", counts_file);
+    }
+    return success;
+}
+
+vocabulary *counts_read(const char *counts_file, int *type) {
+    // open the counts file for reading
+    FILE *input = fopen(counts_file, "rb");
+
+    // if the file does not exist, return NULL
+    if (input == NULL) {
+        printf("Error: could not read '%s'\n", counts_file);
+        return NULL;
+    }
+
+    counts_header header;
+    if (fread(&header, sizeof(counts_header), 1, input) != 1 || header.magic != COUNTS_MAGIC) {
+        printf("Error: '%s' is not a counts file\n", counts_file);
+        fclose(input);
+        return NULL;
+    }
+    *type = header.type;
+
+    // words grow the buffer as needed, a word is never longer than the file
+    vocabulary *vocab = vocabulary_create();
+    size_t capacity = 256;
+    char *word = memory_alloc(MEMORY_TAG_OTHER, capacity);
+    for (uint64_t i = 0; i < header.symbol_count; i++) {
+        unsigned int length;
+        uint64_t freq;
+        if (fread(&length, sizeof(unsigned int), 1, input) != 1) {
+            break;
+        }
+        if (length + 1 > capacity) {
+            capacity = length + 1;
+            word = memory_realloc(MEMORY_TAG_OTHER, word, capacity);
+        }
+        if (fread(word, sizeof(char), length, input) != length || fread(&freq, sizeof(uint64_t), 1, input) != 1) {
+            break;
+        }
+        word[length] = '\0';
+        vocabulary_add(vocab, word, freq);
+    }
+    memory_free(word);
+    fclose(input);
+
+    if (vocab->count != header.symbol_count) {
+        printf("Error: '%s' is truncated\n", counts_file);
+        vocabulary_destroy(vocab);
+        return NULL;
+    }
+    return vocab;
+}
+
+bool counts_merge_files(char **counts_files, int file_count, const char *output_file) {
+    if (file_count < 1) {
+        printf("Error: no counts file to merge\n");
+        return false;
+    }
+
+    // the first file receives the symbols of the others
+    int type;
+    vocabulary *merged = counts_read(counts_files[0], &type);
+    if (merged == NULL) {
+        return false;
+    }
+
+    for (int i = 1; i < file_count; i++) {
+        int shard_type;
+        vocabulary *shard = counts_read(counts_files[i], &shard_type);
+        if (shard == NULL) {
+            vocabulary_destroy(merged);
+            return false;
+        }
+        if (shard_type != type) {
+            printf("Error: '%s' counts another type of symbols than '%s'\n", counts_files[i], counts_files[0]);
+            vocabulary_destroy(shard);
+            vocabulary_destroy(merged);
+            return false;
+        }
+
+        uint32_t *remap = memory_alloc(MEMORY_TAG_OTHER, (shard->count + 1) * sizeof(uint32_t));
+        vocabulary_merge(merged, shard, remap);
+        memory_free(remap);
+        vocabulary_destroy(shard);
+    }
+
+    // the same shards give the same file whatever the order they are merged in
+    memory_free(vocabulary_sort(merged));
+    bool success = counts_write(output_file, type, merged);
+    vocabulary_destroy(merged);
+    return success;
+}
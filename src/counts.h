@@ -0,0 +1,47 @@
+#ifndef COUNTS_H
+#define COUNTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vocabulary.h"
+
+#define COUNTS_MAGIC 0x4E465548         // "HUFN", frequency table files
+
+/**
+ * Structure to represent the header of a counts file, followed by one entry per symbol:
+ * the length of the symbol as an unsigned int, its bytes, then its frequency as a uint64_t
+ */
+typedef struct counts_header {
+    unsigned int magic;                 // COUNTS_MAGIC
+    unsigned int type;                  // Type of symbols counted, TYPE_CHAR or TYPE_WORD
+    uint64_t symbol_count;              // Number of entries
+} counts_header;
+
+/**
+ * Writes the symbols and frequencies of a vocabulary to a counts file.
+ * @param counts_file The counts file.
+ * @param type The type of symbols.
+ * @param vocab The vocabulary, written in the order of its symbol ids.
+ * @return true if successful, false if the file could not be written.
+ */
+bool counts_write(const char *counts_file, int type, const vocabulary *vocab);
+
+/**
+ * Reads a counts file.
+ * @param counts_file The counts file.
+ * @param type Set to the type of symbols.
+ * @return The vocabulary, NULL if the file is missing or is not a counts file.
+ */
+vocabulary *counts_read(const char *counts_file, int *type);
+
+/**
+ * Adds up the counts files of several shards into one, in byte order.
+ * @param counts_files The counts files.
+ * @param file_count The number of counts files.
+ * @param output_file The merged counts file.
+ * @return true if successful, false if a file could not be read, has another type or could not be written.
+ */
+bool counts_merge_files(char **counts_files, int file_count, const char *output_file);
+
+#endif // COUNTS_H
@@ -0,0 +1,96 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_X86
+#include <nmmintrin.h>
+#endif
+
+#define CRC32C_POLYNOMIAL 0x82F63B78u  // Castagnoli polynomial, reflected
+
+static uint32_t crc32c_tables[8][256];
+static bool crc32c_use_hardware = false;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+void _crc32c_init() {
+    for (unsigned int i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        }
+        crc32c_tables[0][i] = crc;
+    }
+    // table k gives the CRC of a byte followed by k zero bytes, so eight bytes are folded per step
+    for (unsigned int i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            crc32c_tables[k][i] = (crc32c_tables[k - 1][i] >> 8) ^ crc32c_tables[0][crc32c_tables[k - 1][i] & 0xFF];
+        }
+    }
+
+#ifdef CRC32C_X86
+    crc32c_use_hardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) {
+    pthread_once(&crc32c_once, _crc32c_init);
+    if (crc32c_use_hardware) {
+        return ~_crc32c_hardware(~crc, data, length);
+    }
+    return ~_crc32c_table(~crc, data, length);
+}
+
+uint32_t _crc32c_table(uint32_t crc, const unsigned char *data, size_t length) {
+    while (length >= 8) {
+        // little endian loads, like the rest of the file formats
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = crc32c_tables[7][low & 0xFF] ^ crc32c_tables[6][(low >> 8) & 0xFF] ^
+              crc32c_tables[5][(low >> 16) & 0xFF] ^ crc32c_tables[4][low >> 24] ^
+              crc32c_tables[3][high & 0xFF] ^ crc32c_tables[2][(high >> 8) & 0xFF] ^
+              crc32c_tables[1][(high >> 16) & 0xFF] ^ crc32c_tables[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = (crc >> 8) ^ crc32c_tables[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC32C_X86
+__attribute__((target("sse4.2")))
+uint32_t _crc32c_hardware(uint32_t crc, const unsigned char *data, size_t length) {
+#ifdef __x86_64__
+    uint64_t wide = crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        wide = _mm_crc32_u64(wide, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)wide;
+#endif
+    while (length >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        length -= 4;
+    }
+    while (length-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#else
+uint32_t _crc32c_hardware(uint32_t crc, const unsigned char *data, size_t length) {
+    // no crc32 instruction on this architecture
+    return _crc32c_table(crc, data, length);
+}
+#endif
@@ -0,0 +1,41 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Computes the CRC32C (Castagnoli) of a buffer, continuing a previous one.
+ * Uses the crc32 instruction of SSE4.2 when the processor has it, a table otherwise.
+ * @param crc The CRC of the data before the buffer, 0 to start.
+ * @param data The buffer.
+ * @param length The length of the buffer.
+ * @return The CRC of the data up to the end of the buffer.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+
+/**
+ * Computes the CRC32C of a buffer eight bytes at a time with tables.
+ * @param crc The inverted CRC so far.
+ * @param data The buffer.
+ * @param length The length of the buffer.
+ * @return The inverted CRC.
+ */
+uint32_t _crc32c_table(uint32_t crc, const unsigned char *data, size_t length);
+
+/**
+ * Computes the CRC32C of a buffer with the crc32 instruction.
+ * @param crc The inverted CRC so far.
+ * @param data The buffer.
+ * @param length The length of the buffer.
+ * @return The inverted CRC.
+ */
+uint32_t _crc32c_hardware(uint32_t crc, const unsigned char *data, size_t length);
+
+/**
+ * Fills the tables and picks the implementation, once.
+ */
+void _crc32c_init();
+
+#endif // CRC32C_H
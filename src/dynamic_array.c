@@ -1,10 +1,11 @@
 #include "dynamic_array.h"
+#include "memory.h"
 
 #include <stdlib.h>
 
 dynamic_array *dynamic_array_create() {
-  dynamic_array *array = malloc(sizeof(dynamic_array));
-  array->array = malloc(2 * sizeof(void *));
+  dynamic_array *array = memory_alloc(MEMORY_TAG_ARRAY, sizeof(dynamic_array));
+  array->array = memory_alloc(MEMORY_TAG_ARRAY, 2 * sizeof(void *));
   array->size = 0;
   array->capacity = 2;
   return array;
@@ -19,14 +20,14 @@ void dynamic_array_destroy(dynamic_array *array, void (*destroy)(void *element))
       destroy(array->array[i]);
     }
   }
-  free(array->array);
-  free(array);
+  memory_free(array->array);
+  memory_free(array);
 }
 
 void dynamic_array_insert(dynamic_array *array, void *element) {
   if (array->size == array->capacity) {
     array->capacity *= 2;
-    array->array = realloc(array->array, array->capacity * sizeof(void *));
+    array->array = memory_realloc(MEMORY_TAG_ARRAY, array->array, array->capacity * sizeof(void *));
   }
   array->array[array->size++] = element;
 }
@@ -0,0 +1,356 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grep.h"
+#include "block.h"
+#include "memory.h"
+
+int64_t grep_file(char *input_file, char *dictionary_file, const char *word, FILE *output) {
+    // words never hold delimiters, a word with one is not a single word of any file
+    if (word[0] == '\0' || strpbrk(word, " \t\n") != NULL) {
+        printf("Error: --grep searches for a single word, without spaces\n");
+        return -1;
+    }
+
+    // open the input file for reading
+    FILE *input = fopen(input_file, "rb");
+
+    // if the file does not exist, return
+    if (input == NULL) {
+        printf("Error: could not read '%s'\n", input_file);
+        return -1;
+    }
+
+    // the tree comes from the dictionary or from the header of the file
+    huffman_dictionary *dictionary = NULL;
+    huffman_decoder *decoder = NULL;
+    uint64_t word_count = 0;
+    unsigned int magic = 0;
+    fread(&magic, sizeof(unsigned int), 1, input);
+    FSEEK64(input, 0, SEEK_SET);
+    if (magic == BLOCK_MAGIC) {
+        printf("Error: '%s' is a block file, --grep only searches files without blocks\n", input_file);
+        fclose(input);
+        return -1;
+    } else if (dictionary_file != NULL) {
+        dictionary = huffman_read_dictionary(dictionary_file);
+        if (dictionary == NULL) {
+            printf("Error: '%s' is not a dictionary\n", dictionary_file);
+            fclose(input);
+            return -1;
+        }
+        huffman_dictionary_file_header header;
+        if (fread(&header, sizeof(huffman_dictionary_file_header), 1, input) != 1 ||
+            header.magic != HUFFMAN_DICTIONARY_FILE_MAGIC || header.dictionary_id != dictionary->header.dictionary_id) {
+            printf("Error: '%s' was not compressed with '%s'\n", input_file, dictionary_file);
+            huffman_delete_dictionary(dictionary);
+            fclose(input);
+            return -1;
+        }
+        decoder = dictionary->decoder;
+        word_count = header.word_count;
+    } else {
+        huffman_header header;
+        FSEEK64(input, 0, SEEK_END);
+        int64_t file_size = FTELL64(input);
+        FSEEK64(input, 0, SEEK_SET);
+        if (fread(&header, sizeof(huffman_header), 1, input) != 1 || header.root_offset == HUFFMAN_DICTIONARY_FILE_MAGIC) {
+            printf("Error: '%s' was compressed with a dictionary, use --dict\n", input_file);
+            fclose(input);
+            return -1;
+        }
+        word_count = _huffman_header_word_count(&header, file_size);
+
+        // an empty input has no tree to read
+        if (word_count == 0) {
+            fclose(input);
+            return 0;
+        }
+        decoder = huffman_read_decoder(input, header.word_list_offset, header.huffman_table_offset,
+                                       header.compressed_offset);
+        if (decoder == NULL) {
+            printf("Error: '%s' has a corrupted huffman table\n", input_file);
+            fclose(input);
+            return -1;
+        }
+        FSEEK64(input, header.compressed_offset, SEEK_SET);
+    }
+
+    // a word the symbols cannot spell is not in the file, the data is not read at all
+    bool escape = false;
+    for (unsigned int i = 0; i < decoder->symbols->count; i++) {
+        escape |= decoder->symbols->lengths[i] == 0;
+    }
+    int64_t match_count = 0;
+    if (_grep_can_spell(decoder->symbols, word, escape)) {
+        match_count = grep_decoded(input, word_count, decoder, word, output);
+        if (match_count < 0) {
+            printf("Error: '%s' is corrupted\n", input_file);
+        }
+    }
+
+    fclose(input);
+    if (dictionary != NULL) {
+        huffman_delete_dictionary(dictionary);
+    } else {
+        huffman_delete_decoder(decoder);
+    }
+    return match_count;
+}
+
+int64_t grep_decoded(FILE *input, uint64_t word_count, const huffman_decoder *decoder, const char *word, FILE *output) {
+    const huffman_symbol_table *symbols = decoder->symbols;
+    const huffman_flat_node *nodes = decoder->nodes;
+
+    grep_search search;
+    memset(&search, 0, sizeof(grep_search));
+    search.symbols = symbols;
+    search.word = word;
+    search.word_length = strlen(word);
+    search.line_capacity = 1024;
+    search.line = memory_alloc(MEMORY_TAG_OTHER, search.line_capacity * sizeof(uint32_t));
+    search.output = output;
+
+    // sort the symbols once, so the search only compares the ones found in the word
+    search.kinds = memory_alloc(MEMORY_TAG_OTHER, symbols->count > 0 ? symbols->count : 1);
+    for (unsigned int i = 0; i < symbols->count; i++) {
+        const char *text = symbols->pool + symbols->offsets[i];
+        if (symbols->lengths[i] == 1 && text[0] == '\n') {
+            search.kinds[i] = GREP_KIND_NEWLINE;
+        } else if (symbols->lengths[i] == 1 && IS_WORD_DELIMITER(text[0])) {
+            search.kinds[i] = GREP_KIND_DELIMITER;
+        } else if (symbols->lengths[i] > 0 && strstr(word, text) != NULL) {
+            search.kinds[i] = GREP_KIND_PART;
+        } else {
+            search.kinds[i] = GREP_KIND_OTHER;
+        }
+    }
+
+    bool corrupted = false;
+    uint64_t words = 0;
+    if (nodes[0].left == HUFFMAN_NO_CHILD && nodes[0].right == HUFFMAN_NO_CHILD) {
+        // a lone leaf is coded as a single bit, there is nothing to walk
+        for (; words < word_count; words++) {
+            _grep_add_symbol(&search, nodes[0].symbol);
+        }
+    } else {
+        grep_entry *table = _grep_create_table(nodes, decoder->node_count);
+
+        // the codes left over at the end of a chunk are carried to the front of the next one
+        size_t capacity = READ_BUFFER_SIZE + 16;
+        unsigned char *data = memory_alloc(MEMORY_TAG_OTHER, capacity);
+        size_t size = 0;
+        uint64_t position = 0;
+
+        // a reader thread loads the compressed data ahead
+        pipeline *p = pipeline_start(input, NULL, READ_BUFFER_SIZE, NULL, 0, 0);
+        pipeline_buffer *in;
+        while (words < word_count && !corrupted && (in = pipeline_next_input(p)) != NULL) {
+            size_t carry = size - (position >> 3);
+            memmove(data, data + (position >> 3), carry);
+            position &= 7;
+            if (carry + in->size + 3 > capacity) {
+                capacity = carry + in->size + 3;
+                data = memory_realloc(MEMORY_TAG_OTHER, data, capacity);
+            }
+            memcpy(data + carry, in->data, in->size);
+            size = carry + in->size;
+            pipeline_release_input(p, in);
+            memset(data + size, 0, 3);
+
+            uint64_t limit = (uint64_t)size * 8;
+            while (words < word_count) {
+                uint64_t start = position;
+                unsigned int symbol = _grep_decode_symbol(table, nodes, data, limit, &position);
+                if (symbol == GREP_NEED_BITS) {
+                    break;
+                } else if (symbol == HUFFMAN_NO_SYMBOL) {
+                    corrupted = true;
+                    break;
+                }
+                if (symbols->lengths[symbol] == 0) {
+                    // the escape symbol, the next bits hold the literal byte
+                    if (position + HUFFMAN_ESCAPE_BITS > limit) {
+                        position = start;
+                        break;
+                    }
+                    unsigned int literal = 0;
+                    for (int i = 0; i < HUFFMAN_ESCAPE_BITS; i++, position++) {
+                        literal |= ((data[position >> 3] >> (position & 7)) & 1) << i;
+                    }
+                    symbol = symbols->count + literal;
+                }
+                _grep_add_symbol(&search, symbol);
+                words++;
+            }
+        }
+        pipeline_finish(p);
+
+        memory_free(data);
+        memory_free(table);
+    }
+
+    // the last line may not end with a newline
+    if (search.matched == (int64_t)search.word_length) {
+        search.line_matches = true;
+    }
+    if (search.line_matches && search.line_size > 0) {
+        _grep_print_line(&search);
+    }
+
+    memory_free(search.line);
+    memory_free(search.kinds);
+    return corrupted || words < word_count ? -1 : (int64_t)search.match_count;
+}
+
+bool _grep_can_spell(const huffman_symbol_table *symbols, const char *word, bool escape) {
+    // spelled[i] is whether the first i bytes of the word are a sequence of symbols
+    size_t length = strlen(word);
+    bool *spelled = memory_calloc(MEMORY_TAG_OTHER, length + 1, sizeof(bool));
+    spelled[0] = true;
+    for (size_t i = 0; i < length; i++) {
+        if (!spelled[i]) {
+            continue;
+        }
+        if (escape) {
+            spelled[i + 1] = true;
+        }
+        for (unsigned int s = 0; s < symbols->count; s++) {
+            unsigned int symbol_length = symbols->lengths[s];
+            if (symbol_length > 0 && symbol_length <= length - i &&
+                memcmp(symbols->pool + symbols->offsets[s], word + i, symbol_length) == 0) {
+                spelled[i + symbol_length] = true;
+            }
+        }
+    }
+    bool result = spelled[length];
+    memory_free(spelled);
+    return result;
+}
+
+grep_entry *_grep_create_table(const huffman_flat_node *nodes, unsigned int node_count) {
+    // the height of every node, children come after their parent in breadth first order
+    unsigned char *heights = memory_calloc(MEMORY_TAG_OTHER, node_count, sizeof(unsigned char));
+    for (unsigned int i = node_count; i-- > 0;) {
+        int height = 0;
+        if (nodes[i].left != HUFFMAN_NO_CHILD && heights[nodes[i].left] + 1 > height) {
+            height = heights[nodes[i].left] + 1;
+        }
+        if (nodes[i].right != HUFFMAN_NO_CHILD && heights[nodes[i].right] + 1 > height) {
+            height = heights[nodes[i].right] + 1;
+        }
+        heights[i] = height < UCHAR_MAX ? height : UCHAR_MAX;
+    }
+
+    size_t size = 1u << GREP_TABLE_BITS;
+    grep_entry *table = memory_alloc(MEMORY_TAG_OTHER, size * sizeof(grep_entry));
+    _grep_fill_table(table, nodes, 0, GREP_TABLE_BITS);
+
+    // the nodes the first bits reach get a subtable no deeper than their subtree
+    for (unsigned int value = 0; value < (1u << GREP_TABLE_BITS); value++) {
+        if (table[value].bits > 0 || table[value].next == HUFFMAN_NO_CHILD) {
+            continue;
+        }
+        unsigned int node = table[value].next;
+        int bits = heights[node] < GREP_SUBTABLE_BITS ? heights[node] : GREP_SUBTABLE_BITS;
+        table = memory_realloc(MEMORY_TAG_OTHER, table, (size + ((size_t)1 << bits)) * sizeof(grep_entry));
+        _grep_fill_table(table + size, nodes, node, bits);
+        table[value].next = size;
+        table[value].subtable_bits = bits;
+        size += (size_t)1 << bits;
+    }
+
+    memory_free(heights);
+    return table;
+}
+
+void _grep_fill_table(grep_entry *table, const huffman_flat_node *nodes, unsigned int node, int bits) {
+    // every value walks the tree from the node, the first bit is the lowest
+    for (unsigned int value = 0; value < (1u << bits); value++) {
+        unsigned int current = node;
+        table[value].bits = 0;
+        table[value].subtable_bits = 0;
+        for (int bit = 0; bit < bits && current != HUFFMAN_NO_CHILD; bit++) {
+            current = (value >> bit) & 1 ? nodes[current].right : nodes[current].left;
+            if (current != HUFFMAN_NO_CHILD && nodes[current].left == HUFFMAN_NO_CHILD &&
+                nodes[current].right == HUFFMAN_NO_CHILD) {
+                table[value].bits = bit + 1;
+                current = nodes[current].symbol;
+                break;
+            }
+        }
+        table[value].next = current;
+    }
+}
+
+void _grep_add_symbol(grep_search *search, uint32_t symbol) {
+    const huffman_symbol_table *symbols = search->symbols;
+    const char *text;
+    size_t length;
+    int kind;
+    char literal;
+    if (symbol < symbols->count) {
+        text = symbols->pool + symbols->offsets[symbol];
+        length = symbols->lengths[symbol];
+        kind = search->kinds[symbol];
+    } else {
+        literal = (char)(symbol - symbols->count);
+        text = &literal;
+        length = 1;
+        kind = literal == '\n' ? GREP_KIND_NEWLINE : IS_WORD_DELIMITER(literal) ? GREP_KIND_DELIMITER : GREP_KIND_PART;
+    }
+
+    // the line is kept as symbols, it only becomes text if it holds the word
+    if (search->line_size == search->line_capacity) {
+        search->line_capacity *= 2;
+        search->line = memory_realloc(MEMORY_TAG_OTHER, search->line, search->line_capacity * sizeof(uint32_t));
+    }
+    search->line[search->line_size++] = symbol;
+    search->offset += length;
+
+    if (kind == GREP_KIND_OTHER) {
+        search->matched = -1;
+    } else if (kind == GREP_KIND_PART) {
+        // a word may be spelled with several symbols, each must go on where the one before stopped
+        if (search->matched >= 0 && length <= search->word_length - search->matched &&
+            memcmp(search->word + search->matched, text, length) == 0) {
+            search->matched += length;
+        } else {
+            search->matched = -1;
+        }
+    } else {
+        if (search->matched == (int64_t)search->word_length) {
+            search->line_matches = true;
+        }
+        search->matched = 0;
+        if (kind == GREP_KIND_NEWLINE) {
+            if (search->line_matches) {
+                _grep_print_line(search);
+            }
+            search->line_matches = false;
+            search->line_size = 0;
+            search->line_offset = search->offset;
+        }
+    }
+}
+
+void _grep_print_line(grep_search *search) {
+    const huffman_symbol_table *symbols = search->symbols;
+    fprintf(search->output, "%llu:", (unsigned long long)search->line_offset);
+    bool newline = false;
+    for (size_t i = 0; i < search->line_size; i++) {
+        uint32_t symbol = search->line[i];
+        if (symbol < symbols->count) {
+            fwrite(symbols->pool + symbols->offsets[symbol], 1, symbols->lengths[symbol], search->output);
+            newline = symbols->lengths[symbol] == 1 && symbols->pool[symbols->offsets[symbol]] == '\n';
+        } else {
+            fputc((int)(symbol - symbols->count), search->output);
+            newline = symbol - symbols->count == '\n';
+        }
+    }
+    if (!newline) {
+        fputc('\n', search->output);
+    }
+    search->match_count++;
+}
@@ -0,0 +1,167 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "huffman.h"
+
+#define GREP_TABLE_BITS 12              // Bits of code looked up first
+#define GREP_SUBTABLE_BITS 8            // Most bits looked up next for longer codes, which then walk the tree
+#define GREP_NEED_BITS 0xFFFFFFFEu      // The data ends inside the code, more is needed to decode it
+
+/**
+ * Structure to represent an entry of the lookup table, for the next GREP_TABLE_BITS bits of data
+ */
+typedef struct grep_entry {
+    unsigned int next;                  // Symbol of the leaf reached, the node reached after all the bits or the subtable
+    unsigned char bits;                 // Bits of the code of the leaf, 0 if the code is longer
+    unsigned char subtable_bits;        // Bits looked up in the subtable of the node reached, 0 if it has none
+} grep_entry;
+
+/**
+ * Structure to represent a search for a word through the symbols of a file, in order
+ */
+typedef struct grep_search {
+    const huffman_symbol_table *symbols;  // Words of the file
+    const char *word;                   // The word searched for
+    size_t word_length;                 // Length of the word
+    unsigned char *kinds;               // GREP_KIND of every symbol
+    int64_t matched;                    // Bytes of the word the current token matches so far, -1 once it cannot match
+    bool line_matches;                  // Whether a token of the current line is the word
+    uint32_t *line;                     // Symbols of the current line, literals after symbols->count
+    size_t line_size;                   // Symbols of the current line
+    size_t line_capacity;               // Capacity of the line
+    uint64_t line_offset;               // Offset of the current line in the original file
+    uint64_t offset;                    // Offset of the next symbol in the original file
+    uint64_t match_count;               // Lines matched
+    FILE *output;                       // Where the matching lines go
+} grep_search;
+
+#define GREP_KIND_OTHER 0               // A word that is not part of the word searched for
+#define GREP_KIND_PART 1                // A word found in the word searched for, which may spell it
+#define GREP_KIND_DELIMITER 2           // A space or a tab, ending a token
+#define GREP_KIND_NEWLINE 3             // A newline, ending a token and a line
+
+/**
+ * Prints the lines of a file compressed without blocks where a word appears, without decompressing the
+ * other lines. The word is looked up in the table of the file first, a word its symbols cannot spell is
+ * reported missing without reading the data. The codes are then decoded to symbols with a lookup table,
+ * and only the symbols of the lines holding the word are turned back into text.
+ * A line is printed as the offset of its first byte in the original file, a colon and the line.
+ * @param input_file The compressed file.
+ * @param dictionary_file The dictionary it was compressed with, NULL if it carries its own table.
+ * @param word The word, matched whole against the words the file was split into (at spaces, tabs and newlines).
+ * @param output Where the matching lines go.
+ * @return The number of matching lines, -1 if the file could not be searched.
+ */
+int64_t grep_file(char *input_file, char *dictionary_file, const char *word, FILE *output);
+
+/**
+ * Searches the compressed data of a file.
+ * @param input The compressed file, at the start of the compressed data.
+ * @param word_count The number of words.
+ * @param decoder The tree of the file.
+ * @param word The word.
+ * @param output Where the matching lines go.
+ * @return The number of matching lines, -1 if the data is corrupted.
+ */
+int64_t grep_decoded(FILE *input, uint64_t word_count, const huffman_decoder *decoder, const char *word, FILE *output);
+
+/**
+ * Checks that a word can be spelled with the symbols of a file, one after another.
+ * @param symbols The symbols.
+ * @param word The word.
+ * @param escape Whether the file has an escape symbol, which spells any byte.
+ * @return true if the word may appear in the file.
+ */
+bool _grep_can_spell(const huffman_symbol_table *symbols, const char *word, bool escape);
+
+/**
+ * Builds the lookup table of a tree, with a subtable after each node the first bits can reach.
+ * @param nodes The nodes of the flat tree.
+ * @param node_count The number of nodes.
+ * @return The table, 1 << GREP_TABLE_BITS entries followed by the subtables.
+ */
+grep_entry *_grep_create_table(const huffman_flat_node *nodes, unsigned int node_count);
+
+/**
+ * Fills a table with the leaves or nodes every value of the next bits reaches from a node.
+ * @param table The table, 1 << bits entries.
+ * @param nodes The nodes of the flat tree.
+ * @param node The node the bits start from.
+ * @param bits The bits looked up.
+ */
+void _grep_fill_table(grep_entry *table, const huffman_flat_node *nodes, unsigned int node, int bits);
+
+/**
+ * Adds the next symbol of the file to a search, printing the line it ends if the word is in it.
+ * @param search The search.
+ * @param symbol The symbol, or symbols->count plus the byte of a literal.
+ */
+void _grep_add_symbol(grep_search *search, uint32_t symbol);
+
+/**
+ * Prints the current line of a search.
+ * @param search The search.
+ */
+void _grep_print_line(grep_search *search);
+
+/**
+ * Decodes one symbol, a table lookup for most codes.
+ * @param table The lookup table.
+ * @param nodes The nodes of the flat tree.
+ * @param data The compressed data, readable two bytes past the end.
+ * @param limit The number of bits of data.
+ * @param position The bit where the code starts, advanced past it.
+ * @return The symbol, GREP_NEED_BITS if the data ends first, HUFFMAN_NO_SYMBOL if the tree is broken.
+ */
+static inline unsigned int _grep_decode_symbol(const grep_entry *table, const huffman_flat_node *nodes,
+                                               const unsigned char *data, uint64_t limit, uint64_t *position) {
+    uint64_t bit = *position;
+    const unsigned char *bytes = data + (bit >> 3);
+    unsigned int window = ((unsigned int)bytes[0] | (unsigned int)bytes[1] << 8 | (unsigned int)bytes[2] << 16) >>
+                          (bit & 7);
+    grep_entry entry = table[window & ((1u << GREP_TABLE_BITS) - 1)];
+    int bits = GREP_TABLE_BITS;
+    if (entry.subtable_bits > 0) {
+        // a long code, the subtable of the node the first bits reach takes the next ones
+        if (bit + GREP_TABLE_BITS > limit) {
+            return GREP_NEED_BITS;
+        }
+        bit += GREP_TABLE_BITS;
+        bytes = data + (bit >> 3);
+        window = ((unsigned int)bytes[0] | (unsigned int)bytes[1] << 8) >> (bit & 7);
+        bits = entry.subtable_bits;
+        entry = table[entry.next + (window & ((1u << bits) - 1))];
+    }
+    if (entry.bits > 0) {
+        if (bit + entry.bits > limit) {
+            return GREP_NEED_BITS;
+        }
+        *position = bit + entry.bits;
+        return entry.next;
+    }
+    if (entry.next == HUFFMAN_NO_CHILD) {
+        return bit + bits > limit ? GREP_NEED_BITS : HUFFMAN_NO_SYMBOL;
+    }
+
+    // a longer code still, the tables took its first bits
+    unsigned int current = entry.next;
+    bit += bits;
+    do {
+        if (bit >= limit) {
+            return GREP_NEED_BITS;
+        }
+        current = (data[bit >> 3] >> (bit & 7)) & 1 ? nodes[current].right : nodes[current].left;
+        bit++;
+        if (current == HUFFMAN_NO_CHILD) {
+            return HUFFMAN_NO_SYMBOL;
+        }
+    } while (nodes[current].left != HUFFMAN_NO_CHILD || nodes[current].right != HUFFMAN_NO_CHILD);
+    *position = bit;
+    return nodes[current].symbol;
+}
+
+#endif // GREP_H
@@ -1,13 +1,49 @@
 #include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "huffman.h"
+#include "batch.h"
+#include "block.h"
+#include "counts.h"
+#include "mapped_file.h"
+#include "memory.h"
+
+void huffman_encode_file_per_char(char *input_file, char *output_file, int thread_count, double sample_rate) {
+  if (sample_rate < 1) {
+    // the tree comes from a sample, so the chunks are not counted and the codes go through the stream
+    uint64_t *char_freq_table = _huffman_sample_char_freq_table(input_file, sample_rate);
+    if (char_freq_table == NULL) {
+      return;
+    }
+    huffman_tree *tree = _huffman_create_tree_from_char_freq_table(char_freq_table);
+    if (!huffman_encode_file_streamed(input_file, output_file, tree)) {
+      trie *code_table = _huffman_char_create_code_table(tree);
+      huffman_encode_file(input_file, output_file, tree, code_table);
+      trie_destroy(code_table, (void (*)(void *))bitvector_destroy);
+    }
+    huffman_delete_tree(tree);
+    memory_free(char_freq_table);
+    return;
+  }
+
+  // count the characters of every chunk, the totals give the tree and the chunks where their codes start
+  size_t chunk_size = 0, chunk_count = 0;
+  uint64_t *chunk_freqs = _huffman_get_chunk_freq_tables(input_file, &chunk_size, &chunk_count);
+
+  // if the file does not exist, return
+  if (chunk_freqs == NULL) {
+    return;
+  }
 
-void huffman_encode_file_per_char(char *input_file, char *output_file) {
-  // create a character frequency table
-  int *char_freq_table = _huffman_get_char_freq_table_from_file(input_file);
+  uint64_t char_freq_table[256] = {0};
+  for (size_t i = 0; i < chunk_count; i++) {
+    for (int c = 0; c < 256; c++) {
+      char_freq_table[c] += chunk_freqs[i * 256 + c];
+    }
+  }
 
   // create a huffman tree from the character frequency table
   huffman_tree *tree = _huffman_create_tree_from_char_freq_table(char_freq_table);
@@ -16,70 +52,604 @@ void huffman_encode_file_per_char(char *input_file, char *output_file) {
   // huffman_print(tree);
   // printf("\n====================\n");
 
-  // create a character code table from the huffman tree
-  trie *code_table = _huffman_char_create_code_table(tree);
+  _huffman_encode_file_chars(input_file, output_file, tree, chunk_freqs, chunk_size, chunk_count, thread_count);
+
+  memory_free(chunk_freqs);
+  huffman_delete_tree(tree);
+}
+
+void _huffman_encode_file_chars(char *input_file, char *output_file, huffman_tree *tree, const uint64_t *chunk_freqs,
+                                size_t chunk_size, size_t chunk_count, int thread_count) {
+  // the exact size of the output is known, encode the chunks in place, or through the stream if it cannot be mapped
+  if (!huffman_encode_file_mapped(input_file, output_file, tree, chunk_freqs, chunk_size, chunk_count,
+                                  thread_count)) {
+    // create a character code table from the huffman tree
+    trie *code_table = _huffman_char_create_code_table(tree);
+
+    // trie_print(code_table);
+
+    // encode the input file using the character code table
+    huffman_encode_file(input_file, output_file, tree, code_table);
+
+    trie_destroy(code_table, (void (*)(void *))bitvector_destroy);
+  }
+}
+
+void huffman_count_file(char *input_file, char *counts_file, int type, int thread_count, double sample_rate) {
+  vocabulary *vocab = NULL;
+  huffman_word_tokens *tokens = NULL;
+  if (type == TYPE_WORD) {
+    // only the frequencies are kept, not the symbol ids of the words
+    tokens = _huffman_tokenize_file(input_file, thread_count, false, false);
+    vocab = tokens != NULL ? tokens->vocabulary : NULL;
+  } else {
+    uint64_t *char_freq_table = sample_rate < 1 ? _huffman_sample_char_freq_table(input_file, sample_rate)
+                                                : _huffman_get_char_freq_table_from_file(input_file);
+    if (char_freq_table != NULL) {
+      // sampled counts are scaled back up, so they add up with the counts of other shards
+      for (int c = 1; c < 256 && sample_rate < 1; c++) {
+        char_freq_table[c] = (uint64_t)(char_freq_table[c] / sample_rate);
+      }
+      vocab = _huffman_char_vocabulary(char_freq_table);
+      memory_free(char_freq_table);
+    }
+  }
+
+  // if the file does not exist, return
+  if (vocab == NULL) {
+    printf("Error: could not read '%s'\n", input_file);
+    return;
+  }
+
+  counts_write(counts_file, type, vocab);
+
+  if (tokens != NULL) {
+    huffman_delete_word_tokens(tokens);
+  } else {
+    vocabulary_destroy(vocab);
+  }
+}
+
+vocabulary *_huffman_char_vocabulary(const uint64_t *char_freq_table) {
+  // the characters are added in byte order, like the words of a sorted vocabulary
+  vocabulary *vocab = vocabulary_create();
+  for (int c = 1; c < 256; c++) {
+    if (char_freq_table[c] > 0) {
+      char word[2] = {(char)c, '\0'};
+      vocabulary_add(vocab, word, char_freq_table[c]);
+    }
+  }
+  return vocab;
+}
+
+bool huffman_encode_file_with_counts(char *input_file, char *output_file, char *counts_file, int thread_count) {
+  int type;
+  vocabulary *counts = counts_read(counts_file, &type);
+  if (counts == NULL) {
+    remove(output_file);
+    return false;
+  }
+
+  bool encoded = false;
+
+  if (type == TYPE_CHAR) {
+    uint64_t char_freq_table[256] = {0};
+    for (size_t i = 0; i < counts->count; i++) {
+      if (strlen(counts->words[i]) == 1) {
+        char_freq_table[(unsigned char)counts->words[i][0]] = counts->freqs[i];
+      }
+    }
+
+    // the chunks are still counted, for where their codes go, and every character needs a code
+    size_t chunk_size = 0, chunk_count = 0;
+    uint64_t *chunk_freqs = _huffman_get_chunk_freq_tables(input_file, &chunk_size, &chunk_count);
+    int missing = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+      for (int c = 1; c < 256; c++) {
+        if (chunk_freqs[i * 256 + c] > 0 && char_freq_table[c] == 0) {
+          char_freq_table[c] = 1;
+          missing++;
+        }
+      }
+    }
+
+    if (chunk_freqs == NULL) {
+      printf("Error: could not read '%s'\n", input_file);
+    } else if (missing > 0) {
+      printf("Error: %d characters of '%s' are missing from '%s'\n", missing, input_file, counts_file);
+    } else {
+      huffman_tree *tree = _huffman_create_tree_from_char_freq_table(char_freq_table);
+      _huffman_encode_file_chars(input_file, output_file, tree, chunk_freqs, chunk_size, chunk_count, thread_count);
+      huffman_delete_tree(tree);
+      encoded = true;
+    }
+    memory_free(chunk_freqs);
+  } else if (type == TYPE_WORD) {
+    huffman_word_tokens *tokens = _huffman_tokenize_file(input_file, thread_count, true, false);
+    if (tokens == NULL) {
+      printf("Error: could not read '%s'\n", input_file);
+      vocabulary_destroy(counts);
+      return false;
+    }
+
+    // the words of the file take the codes of the same words in the counts
+    huffman_tree *tree = huffman_create_tree_from_vocabulary(counts);
+    bitvector **counts_codes = _huffman_word_create_code_array(tree, counts->count);
+    bitvector **codes = memory_alloc(MEMORY_TAG_HUFFMAN, (tokens->vocabulary->count + 1) * sizeof(bitvector *));
+    uint64_t word_count = 0;
+    size_t missing = 0;
+    for (size_t i = 0; i < tokens->vocabulary->count; i++) {
+      uint32_t symbol = vocabulary_find(counts, tokens->vocabulary->words[i]);
+      codes[i] = symbol != VOCABULARY_NO_SYMBOL ? counts_codes[symbol] : NULL;
+      missing += symbol == VOCABULARY_NO_SYMBOL;
+      word_count += tokens->vocabulary->freqs[i];
+    }
 
-  // trie_print(code_table);
+    if (missing > 0) {
+      printf("Error: %zu words of '%s' are missing from '%s'\n", missing, input_file, counts_file);
+    } else {
+      huffman_encode_word_tokens(tokens, output_file, tree, codes, word_count);
+      encoded = true;
+    }
+
+    // the codes are borrowed from the counts
+    memory_free(codes);
+    _huffman_delete_code_array(counts_codes, counts->count);
+    huffman_delete_tree(tree);
+    huffman_delete_word_tokens(tokens);
+  } else {
+    printf("Error: '%s' counts an unsupported type of symbols\n", counts_file);
+  }
 
-  // deallocate the character frequency table
-  free(char_freq_table);
+  // an output left from an earlier run would pass for the shard compressed with these counts
+  if (!encoded) {
+    remove(output_file);
+  }
 
-  // encode the input file using the character code table
-  huffman_encode_file(input_file, output_file, tree, code_table);
+  vocabulary_destroy(counts);
+  return encoded;
 }
 
-int *_huffman_get_char_freq_table_from_file(char *input_file) {
+uint64_t *_huffman_get_chunk_freq_tables(char *input_file, size_t *chunk_size, size_t *chunk_count) {
   // open the input file for reading
-  FILE *input = fopen(input_file, "r");
+  FILE *input = fopen(input_file, "rb");
 
   // if the file does not exist, return NULL
   if (input == NULL) {
     return NULL;
   }
 
-  // allocate and initialize a character frequency table
-  int *char_freq_table = calloc(256, sizeof(int));
-  memset(char_freq_table, 0, 256 * sizeof(int));
+  // chunks grow with the file so their tables stay small
+  FSEEK64(input, 0, SEEK_END);
+  uint64_t file_size = FTELL64(input);
+  FSEEK64(input, 0, SEEK_SET);
+  *chunk_size = READ_BUFFER_SIZE;
+  while (file_size / *chunk_size >= HUFFMAN_MAX_CHUNKS) {
+    *chunk_size *= 2;
+  }
+  *chunk_count = (file_size + *chunk_size - 1) / *chunk_size;
+
+  // read the file buffer by buffer, a chunk is a whole number of buffers
+  uint64_t *chunk_freqs = memory_calloc(MEMORY_TAG_HUFFMAN, (*chunk_count > 0 ? *chunk_count : 1) * 256, sizeof(uint64_t));
+  char *buffer = memory_alloc(MEMORY_TAG_HUFFMAN, READ_BUFFER_SIZE);
+  uint64_t position = 0;
+  size_t length;
+  while (position < *chunk_count * *chunk_size &&
+         (length = fread(buffer, sizeof(char), READ_BUFFER_SIZE, input)) > 0) {
+    _huffman_count_chars(chunk_freqs + position / *chunk_size * 256, buffer, length);
+    position += length;
+  }
 
-  // read the file line by line and update the character frequency table
-  char line[LINE_BUFFER_SIZE];
-  while (fgets(line, LINE_BUFFER_SIZE, input) != NULL) {
-    for (int i = 0; i < strlen(line); i++) {
-      char_freq_table[(unsigned char)line[i]]++;
+  // close the file
+  memory_free(buffer);
+  fclose(input);
+
+  return chunk_freqs;
+}
+
+bool huffman_encode_file_mapped(char *input_file, char *output_file, huffman_tree *tree, const uint64_t *chunk_freqs,
+                                size_t chunk_size, size_t chunk_count, int thread_count) {
+  // the codes are written from machine words, a deeper tree needs a file of tens of terabytes
+  uint64_t codes[256] = {0};
+  unsigned char lengths[256] = {0};
+  if (tree->root != NULL && !_huffman_char_code_words(tree->root, 0, 0, codes, lengths)) {
+    return false;
+  }
+
+  // the histogram of every chunk times the code lengths gives the bit where its codes start
+  uint64_t *chunk_bits = memory_alloc(MEMORY_TAG_HUFFMAN, (chunk_count + 1) * sizeof(uint64_t));
+  uint64_t word_count = 0;
+  chunk_bits[0] = 0;
+  for (size_t i = 0; i < chunk_count; i++) {
+    chunk_bits[i + 1] = chunk_bits[i];
+    for (int c = 0; c < 256; c++) {
+      chunk_bits[i + 1] += chunk_freqs[i * 256 + c] * lengths[c];
+      word_count += chunk_freqs[i * 256 + c];
+    }
+  }
+
+  // open the output file for writing, readable too so it can be mapped
+  FILE *output = fopen(output_file, "w+b");
+
+  // if the file does not exist, return
+  if (output == NULL) {
+    memory_free(chunk_bits);
+    return true;
+  }
+
+  // write the header with its final word count, then map the file at its final size,
+  // the compressed data takes a byte per 8 bits plus the last partial one, like the stream writes it
+  huffman_header *header = _huffman_write_header(tree, NULL, NULL, output);
+  header->word_count = word_count;
+  FSEEK64(output, 0, SEEK_SET);
+  fwrite(header, sizeof(huffman_header), 1, output);
+  mapped_file *mapped = mapped_file_create(output, header->compressed_offset + chunk_bits[chunk_count] / 8 + 1);
+  if (mapped == NULL) {
+    fclose(output);
+    memory_free(header);
+    memory_free(chunk_bits);
+    return false;
+  }
+
+  // chunk i goes to thread i % thread_count, each writes its codes straight at their position
+  if (thread_count <= 0) {
+    thread_count = batch_default_thread_count();
+  }
+  unsigned char *edges = memory_calloc(MEMORY_TAG_HUFFMAN, (chunk_count > 0 ? chunk_count : 1) * 2, sizeof(unsigned char));
+  huffman_char_encoder *encoders = memory_alloc(MEMORY_TAG_HUFFMAN, thread_count * sizeof(huffman_char_encoder));
+  pthread_t *threads = memory_alloc(MEMORY_TAG_HUFFMAN, thread_count * sizeof(pthread_t));
+  for (int t = 0; t < thread_count; t++) {
+    encoders[t].input_file = input_file;
+    encoders[t].codes = codes;
+    encoders[t].lengths = lengths;
+    encoders[t].chunk_size = chunk_size;
+    encoders[t].chunk_count = chunk_count;
+    encoders[t].chunk_bits = chunk_bits;
+    encoders[t].output = mapped->data + header->compressed_offset;
+    encoders[t].edges = edges;
+    encoders[t].first = t;
+    encoders[t].step = thread_count;
+    encoders[t].failed = false;
+  }
+  for (int t = 1; t < thread_count; t++) {
+    pthread_create(&threads[t], NULL, _huffman_char_encode_worker, &encoders[t]);
+  }
+  _huffman_char_encode_worker(&encoders[0]);
+  bool failed = encoders[0].failed;
+  for (int t = 1; t < thread_count; t++) {
+    pthread_join(threads[t], NULL);
+    failed |= encoders[t].failed;
+  }
+
+  // the bytes two chunks share were kept aside, the bits of both sides are merged now
+  unsigned char *data = mapped->data + header->compressed_offset;
+  for (size_t i = 0; i < chunk_count; i++) {
+    data[chunk_bits[i] / 8] |= edges[2 * i];
+    if (chunk_bits[i + 1] % 8 != 0) {
+      data[chunk_bits[i + 1] / 8] |= edges[2 * i + 1];
+    }
+  }
+
+  if (failed) {
+    printf("Error: '%s' changed while it was compressed\n", input_file);
+  }
+  if (!mapped_file_close(mapped)) {
+    printf("Error: could not write '%s'\n", output_file);
+  }
+  fclose(output);
+
+  memory_free(threads);
+  memory_free(encoders);
+  memory_free(edges);
+  memory_free(header);
+  memory_free(chunk_bits);
+  return true;
+}
+
+void *_huffman_char_encode_worker(void *argument) {
+  huffman_char_encoder *encoder = argument;
+
+  FILE *input = fopen(encoder->input_file, "rb");
+  if (input == NULL) {
+    encoder->failed = true;
+    return NULL;
+  }
+
+  unsigned char *buffer = memory_alloc(MEMORY_TAG_HUFFMAN, encoder->chunk_size);
+  for (size_t i = encoder->first; i < encoder->chunk_count; i += encoder->step) {
+    FSEEK64(input, (int64_t)(i * encoder->chunk_size), SEEK_SET);
+    size_t length = fread(buffer, sizeof(unsigned char), encoder->chunk_size, input);
+    if (!_huffman_encode_chars(buffer, length, encoder->codes, encoder->lengths, encoder->output,
+                               encoder->chunk_bits[i], encoder->chunk_bits[i + 1], encoder->edges + 2 * i)) {
+      encoder->failed = true;
+    }
+  }
+
+  memory_free(buffer);
+  fclose(input);
+  return NULL;
+}
+
+bool huffman_encode_file_streamed(char *input_file, char *output_file, huffman_tree *tree) {
+  uint64_t codes[256] = {0};
+  unsigned char lengths[256] = {0};
+  if (tree->root != NULL && !_huffman_char_code_words(tree->root, 0, 0, codes, lengths)) {
+    return false;
+  }
+
+  // open the input file for reading
+  FILE *input = fopen(input_file, "rb");
+
+  // if the file does not exist, return
+  if (input == NULL) {
+    return true;
+  }
+
+  // open the output file for writing
+  FILE *output = fopen(output_file, "wb");
+
+  // if the file does not exist, return
+  if (output == NULL) {
+    fclose(input);
+    return true;
+  }
+
+  huffman_header *header = _huffman_write_header(tree, NULL, NULL, output);
+  FSEEK64(output, header->compressed_offset, SEEK_SET);
+
+  // a reader thread loads the next chunks and a writer thread stores the codes while this one encodes,
+  // the byte the codes of a chunk end in is carried into the next one
+  uint64_t word_count = 0;
+  unsigned char carry = 0;
+  uint64_t carry_bits = 0;
+  pipeline *p = pipeline_start(input, output, READ_BUFFER_SIZE, NULL, 0, 0);
+  pipeline_buffer *in;
+  while ((in = pipeline_next_input(p)) != NULL) {
+    uint64_t end = carry_bits;
+    for (size_t i = 0; i < in->size; i++) {
+      end += lengths[in->data[i]];
+      word_count += lengths[in->data[i]] > 0;
+    }
+
+    unsigned char edges[2] = {carry, 0};
+    pipeline_buffer *out = pipeline_output_buffer(p, end / 8 + 1);
+    _huffman_encode_chars(in->data, in->size, codes, lengths, out->data, carry_bits, end, edges);
+    pipeline_release_input(p, in);
+
+    // the first byte was shared with the chunk before, the last one is shared with the chunk after
+    if (carry_bits != 0) {
+      out->data[0] = edges[0];
     }
+    carry = end % 8 == 0 ? 0 : end / 8 == 0 && carry_bits != 0 ? edges[0] : edges[1];
+    carry_bits = end % 8;
+    out->size = end / 8;
+    pipeline_write(p, out);
+  }
+
+  // the data always ends with the byte after the last full one, like the other writers
+  pipeline_buffer *out = pipeline_output_buffer(p, 1);
+  out->data[0] = carry;
+  out->size = 1;
+  pipeline_write(p, out);
+  if (!pipeline_finish(p)) {
+    printf("Error: could not write '%s'\n", output_file);
+  }
+
+  // write the final header to the output file
+  header->word_count = word_count;
+  FSEEK64(output, 0, SEEK_SET);
+  fwrite(header, sizeof(huffman_header), 1, output);
+
+  fclose(input);
+  fclose(output);
+  memory_free(header);
+  return true;
+}
+
+bool _huffman_encode_chars(const unsigned char *data, size_t length, const uint64_t *codes,
+                           const unsigned char *lengths, unsigned char *output, uint64_t start, uint64_t end,
+                           unsigned char *edges) {
+  // the first byte is shared with the chunk before when the codes do not start on a byte
+  unsigned char *out = output + start / 8;
+  unsigned char *head = start % 8 != 0 ? out : NULL;
+  uint64_t accumulator = 0;
+  int count = start % 8;
+  uint64_t remaining = end - start;
+
+  for (size_t i = 0; i < length; i++) {
+    unsigned int length_bits = lengths[data[i]];
+    uint64_t code = codes[data[i]];
+
+    // a file changed since it was counted must not write past its chunk
+    if (length_bits > remaining) {
+      return false;
+    }
+    remaining -= length_bits;
+
+    // codes longer than 32 bits are added in two halves, the accumulator never holds more than 63 bits
+    if (length_bits > 32) {
+      accumulator |= (code & 0xFFFFFFFFu) << count;
+      count += 32;
+      code >>= 32;
+      length_bits -= 32;
+      _huffman_store_word(&out, &accumulator, &count, head, edges);
+    }
+    accumulator |= code << count;
+    count += length_bits;
+    if (count >= 32) {
+      _huffman_store_word(&out, &accumulator, &count, head, edges);
+    }
+  }
+
+  // the last partial byte is shared with the chunk after, it is kept aside like the first one
+  for (; count > 0; count -= 8, accumulator >>= 8, out++) {
+    if (out == head) {
+      edges[0] |= (unsigned char)accumulator;
+    } else if (count < 8) {
+      edges[1] = (unsigned char)accumulator;
+    } else {
+      *out = (unsigned char)accumulator;
+    }
+  }
+
+  return remaining == 0;
+}
+
+bool _huffman_char_code_words(huffman_node *node, uint64_t code, int depth, uint64_t *codes, unsigned char *lengths) {
+  if (node->data != NULL) {
+    // a tree with a single leaf still needs one bit per word
+    codes[(unsigned char)node->data[0]] = code;
+    lengths[(unsigned char)node->data[0]] = depth > 0 ? depth : 1;
+    return true;
+  }
+  if (depth == 64) {
+    return false;
+  }
+
+  // the first bit of a code is its least significant one, like the decoder reads them
+  return _huffman_char_code_words(node->left, code, depth + 1, codes, lengths) &&
+         _huffman_char_code_words(node->right, code | (uint64_t)1 << depth, depth + 1, codes, lengths);
+}
+
+uint64_t *_huffman_get_char_freq_table_from_file(char *input_file) {
+  // open the input file for reading
+  FILE *input = fopen(input_file, "r");
+
+  // if the file does not exist, return NULL
+  if (input == NULL) {
+    return NULL;
+  }
+
+  // allocate and initialize a character frequency table
+  uint64_t *char_freq_table = memory_calloc(MEMORY_TAG_HUFFMAN, 256, sizeof(uint64_t));
+
+  // read the file chunk by chunk and update the character frequency table
+  char *buffer = memory_alloc(MEMORY_TAG_HUFFMAN, READ_BUFFER_SIZE + 1);
+  size_t pending = 0, length;
+  while ((length = _huffman_read_chunk(input, buffer, &pending)) > 0) {
+    _huffman_count_chars(char_freq_table, buffer, length);
+    memmove(buffer, buffer + length, pending);
   }
 
   // close the file
+  memory_free(buffer);
+  fclose(input);
+
+  return char_freq_table;
+}
+
+uint64_t *_huffman_sample_char_freq_table(char *input_file, double sample_rate) {
+  // open the input file for reading
+  FILE *input = fopen(input_file, "rb");
+
+  // if the file does not exist, return NULL
+  if (input == NULL) {
+    return NULL;
+  }
+
+  uint64_t *char_freq_table = memory_calloc(MEMORY_TAG_HUFFMAN, 256, sizeof(uint64_t));
+  unsigned char *buffer = memory_alloc(MEMORY_TAG_HUFFMAN, READ_BUFFER_SIZE);
+  uint64_t size;
+  uint64_t sampled = _huffman_sample_bytes(input, sample_rate, char_freq_table, buffer, &size);
+  memory_free(buffer);
   fclose(input);
 
+  // NUL bytes are left out like in the full count, every other byte gets a code in case the sample missed it,
+  // unless the sample read the whole file: every leaf costs a record in the header
+  char_freq_table[0] = 0;
+  for (int c = 1; c < 256 && sampled < size; c++) {
+    if (char_freq_table[c] == 0) {
+      char_freq_table[c] = 1;
+    }
+  }
+
   return char_freq_table;
 }
 
+uint64_t _huffman_sample_bytes(FILE *input, double sample_rate, uint64_t *freqs, unsigned char *buffer,
+                               uint64_t *size) {
+  FSEEK64(input, 0, SEEK_END);
+  *size = FTELL64(input);
+  FSEEK64(input, 0, SEEK_SET);
+
+  // the whole file in order, or a chunk at every stride so the sample covers the file evenly
+  uint64_t stride = sample_rate < 1 ? (uint64_t)(HUFFMAN_SAMPLE_CHUNK_SIZE / sample_rate) : READ_BUFFER_SIZE;
+  size_t chunk_size = sample_rate < 1 ? HUFFMAN_SAMPLE_CHUNK_SIZE : READ_BUFFER_SIZE;
+  uint64_t sampled = 0;
+  for (uint64_t offset = 0; offset < *size; offset += stride) {
+    if (sample_rate < 1) {
+      FSEEK64(input, offset, SEEK_SET);
+    }
+    size_t length = fread(buffer, 1, chunk_size, input);
+    if (length == 0) {
+      break;
+    }
+    for (size_t i = 0; i < length; i++) {
+      freqs[buffer[i]]++;
+    }
+    sampled += length;
+  }
+
+  return sampled;
+}
+
+void _huffman_count_chars(uint64_t *char_freq_table, const char *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    // NUL bytes cannot be keys of the code table, they are left out like before
+    if (data[i] != '\0') {
+      char_freq_table[(unsigned char)data[i]]++;
+    }
+  }
+}
+
+size_t _huffman_read_chunk(FILE *input, char *buffer, size_t *pending) {
+  size_t length = *pending + fread(buffer + *pending, sizeof(char), READ_BUFFER_SIZE - *pending, input);
+  size_t end = length;
+
+  // a full buffer may end in the middle of a word, cut it after the last delimiter
+  if (length == READ_BUFFER_SIZE) {
+    while (end > 0 && !IS_WORD_DELIMITER(buffer[end - 1])) {
+      end--;
+    }
+    if (end == 0) {
+      end = length;
+    }
+  }
+
+  *pending = length - end;
+  return end;
+}
+
 int _freq_compare(const void *key1, const void *key2) {
-  return ((huffman_node *)key2)->freq - ((huffman_node *)key1)->freq;
+  // compared rather than subtracted, the difference of two 64-bit counts does not fit an int
+  uint64_t freq1 = ((huffman_node *)key1)->freq;
+  uint64_t freq2 = ((huffman_node *)key2)->freq;
+  return (freq2 > freq1) - (freq2 < freq1);
 }
 
 void huffman_node_print(void *data) {
   huffman_node *node = (huffman_node *)data;
   if (node->data != NULL) {
-    printf("%s (%d)\n", node->data, node->freq);
+    printf("%s (%llu)\n", node->data, (unsigned long long)node->freq);
   } else {
-    printf("  (%d)\n", node->freq);
+    printf("  (%llu)\n", (unsigned long long)node->freq);
   }
 }
 
-huffman_tree *_huffman_create_tree_from_char_freq_table(int *char_freq_table) {
+huffman_tree *_huffman_create_tree_from_char_freq_table(uint64_t *char_freq_table) {
   // create a priority queue
   priority_queue *queue = priority_queue_create(NULL, _freq_compare);
 
   // insert the characters into the priority queue
   for (int i = 0; i < 256; i++) {
     if (char_freq_table[i] > 0) {
-      huffman_node *node = malloc(sizeof(huffman_node));
-      node->data = malloc(sizeof(char) * 2);
+      huffman_node *node = memory_alloc(MEMORY_TAG_TREE, sizeof(huffman_node));
+      node->data = memory_alloc(MEMORY_TAG_TREE, sizeof(char) * 2);
       node->data[0] = (unsigned char)i;
       node->data[1] = '\0';
+      node->length = 1;
       node->freq = char_freq_table[i];
+      node->offset = -1;
       node->left = NULL;
       node->right = NULL;
       priority_queue_insert(queue, node);
@@ -87,7 +657,6 @@ huffman_tree *_huffman_create_tree_from_char_freq_table(int *char_freq_table) {
   }
 
   // build the huffman tree
-  unsigned int current_index = 0;
   while (priority_queue_size(queue) > 1) {
     huffman_node *left = NULL, *right = NULL, *parent = NULL;
 
@@ -98,9 +667,11 @@ huffman_tree *_huffman_create_tree_from_char_freq_table(int *char_freq_table) {
     // printf("casando %s (%d) com %s (%d)\n", left->data, left->freq, right->data, right->freq);
 
     // create a parent node
-    parent = malloc(sizeof(huffman_node));
+    parent = memory_alloc(MEMORY_TAG_TREE, sizeof(huffman_node));
     parent->data = NULL;
+    parent->length = 0;
     parent->freq = left->freq + right->freq;
+    parent->offset = -1;
     parent->left = left;
     parent->right = right;
 
@@ -110,15 +681,15 @@ huffman_tree *_huffman_create_tree_from_char_freq_table(int *char_freq_table) {
     priority_queue_insert(queue, parent);
   }
 
-  // extract the root node from the priority queue
-  huffman_node *root;
+  // extract the root node from the priority queue, an empty input has no root
+  huffman_node *root = NULL;
   priority_queue_extract(queue, (void **)&root);
 
   // deallocate the priority queue
   priority_queue_destroy(queue);
 
   // create a huffman tree
-  huffman_tree *tree = malloc(sizeof(huffman_tree));
+  huffman_tree *tree = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_tree));
   tree->root = root;
 
   return tree;
@@ -138,9 +709,9 @@ void huffman_print_tree(huffman_node *node, int level) {
   }
 
   if (node->data != NULL) {
-    printf("%s (%d)\n", node->data, node->freq);
+    printf("%s (%llu)\n", node->data, (unsigned long long)node->freq);
   } else {
-    printf("%d\n", node->freq);
+    printf("%llu\n", (unsigned long long)node->freq);
   }
 
   huffman_print_tree(node->left, level + 1);
@@ -169,6 +740,10 @@ void _huffman_char_traverse_tree(huffman_node *node, bitvector *code, int depth,
   if (node->data != NULL) {
     // insert the character code into the code table
     bitvector *copy = bitvector_copy(code);
+    if (depth == 0) {
+      // a tree with a single leaf still needs one bit per word
+      bitvector_append(copy, 0);
+    }
     trie_insert(code_table, node->data, copy);
   } else {
     // traverse the left subtree
@@ -183,6 +758,9 @@ void _huffman_char_traverse_tree(huffman_node *node, bitvector *code, int depth,
     bitvector_append(copy_right, 1);
     _huffman_char_traverse_tree(node->right, copy_right, depth + 1, code_table);
   }
+
+  // each call owns the code it was given
+  bitvector_destroy(code);
 }
 
 void huffman_encode_file(char *input_file, char *output_file, huffman_tree *tree, trie *code_table) {
@@ -208,175 +786,377 @@ void huffman_encode_file(char *input_file, char *output_file, huffman_tree *tree
 
   bitvector *output_buffer = bitvector_create(0);
 
-  // encode the input file using the character code table
-  char line[LINE_BUFFER_SIZE];
-  unsigned int word_count = 0;
-  fseek(input, 0, SEEK_SET);
-  fseek(output, header->compressed_offset, SEEK_SET);
-  while (fgets(line, LINE_BUFFER_SIZE, input) != NULL) {
-    int steps = 0;
-    for (int i = 0; i < strlen(line); i += steps) {
-      bitvector *code = trie_search(code_table, (char *)(line + i), &steps, false);
-      // printf("buff: %s\n", (char *)(line + i));
-      // printf("steps: %d\n", steps);
-
-      if (steps == 0) {
-        printf("could not find code for '%s'\n", (char *)(line + i));
-        steps = 1;
-      }
-
-      if (code == NULL) {
-        printf("code not found\n");
-        continue;
-      }
-
-      // printf("code: ");
-      // bitvector_print(code);
-      bitvector_concat(output_buffer, code);
-      word_count++;
-    }
+  // a reader thread loads the next chunks and a writer thread stores the codes while this one encodes,
+  // the zeroed byte after each chunk ends the text the code table is searched with
+  uint64_t word_count = 0;
+  FSEEK64(input, 0, SEEK_SET);
+  FSEEK64(output, header->compressed_offset, SEEK_SET);
+  pipeline *p = pipeline_start(input, output, READ_BUFFER_SIZE, NULL, 0, 1);
+  pipeline_buffer *in;
+  while ((in = pipeline_next_input(p)) != NULL) {
+    word_count += _huffman_encode_text((const char *)in->data, in->size, code_table, output_buffer);
+    pipeline_release_input(p, in);
+
+    // write the codes as they come, so the buffer stays the size of a chunk
+    _huffman_flush_compressed_pipelined(output_buffer, p);
+  }
+  if (!pipeline_finish(p)) {
+    printf("Error: could not write '%s'\n", output_file);
   }
 
   header->word_count = word_count;
   // printf("word_count: %d\n", word_count);
 
-  // write the output buffer to the output file
-  // bitvector *compressed_output_buffer = bitvector_compress(output_buffer);
-  // bitvector_print(output_buffer);
-  // bitvector_print(compressed_output_buffer);
-  fwrite(output_buffer->bits, output_buffer->size / 8 + 1, 1, output);
-
-  // write the huffman header to the output file
-  fseek(output, 0, SEEK_SET);
-  fwrite(header, sizeof(huffman_header), 1, output);
+  // write the output buffer and the final header to the output file
+  _huffman_write_compressed(header, output_buffer, output);
 
   // close the files
   fclose(input);
   fclose(output);
-}
 
-huffman_header *_huffman_write_header(huffman_tree *tree, trie *code_table, FILE *input, FILE *output) {
-  // create a huffman header
-  huffman_header *header = malloc(sizeof(huffman_header));
-  header->root_offset = 0;
-  header->word_list_offset = 0;
-  header->huffman_table_offset = 0;
-  header->compressed_offset = 0;
+  memory_free(header);
+  bitvector_destroy(output_buffer);
+}
 
-  // write the huffman header to the output file
-  fwrite(&header, sizeof(huffman_header), 1, output);
+size_t _huffman_encode_text(const char *text, size_t length, trie *code_table, bitvector *output_buffer) {
+  size_t word_count = 0;
+  int steps = 0;
 
-  header->word_list_offset = ftell(output);
+  for (size_t i = 0; i < length; i += steps) {
+    // NUL bytes are not counted by _huffman_count_chars, so they have no code and are left out
+    if (text[i] == '\0') {
+      steps = 1;
+      continue;
+    }
 
-  // write the word list to the output file
-  _huffman_write_word_list(tree, output);
+    bitvector *code = trie_search(code_table, (char *)(text + i), &steps, false);
+    if (steps == 0) {
+      steps = 1;
+    }
+    if (code == NULL) {
+      continue;
+    }
 
-  header->huffman_table_offset = ftell(output);
+    // printf("code: ");
+    // bitvector_print(code);
+    bitvector_concat(output_buffer, code);
+    word_count++;
+  }
 
-  // write the code list to the output file
-  header->root_offset = _huffman_write_huffman_table(tree, output);
+  return word_count;
+}
 
-  header->compressed_offset = ftell(output);
+void _huffman_write_compressed(huffman_header *header, bitvector *output_buffer, FILE *output) {
+  // write what is left of the output buffer to the output file
+  fwrite(output_buffer->bits, output_buffer->size / 8 + 1, 1, output);
 
   // write the huffman header to the output file
-  fseek(output, 0, SEEK_SET);
+  FSEEK64(output, 0, SEEK_SET);
   fwrite(header, sizeof(huffman_header), 1, output);
-
-  return header;
 }
 
-void _huffman_write_word_list(huffman_tree *tree, FILE *output) {
-  // recursively write the word list to the output file
-  _huffman_write_word_list_helper(tree->root, output);
+void _huffman_flush_compressed(bitvector *output_buffer, FILE *output) {
+  size_t bytes = output_buffer->size / 8;
+  fwrite(output_buffer->bits, sizeof(unsigned char), bytes, output);
+
+  // the last partial byte moves to the front, its bits are set one by one so stale ones are overwritten
+  output_buffer->bits[0] = output_buffer->bits[bytes];
+  output_buffer->size %= 8;
 }
 
-void _huffman_write_word_list_helper(huffman_node *node, FILE *output) {
-  if (node == NULL) {
-    return;
-  }
+void _huffman_flush_compressed_pipelined(bitvector *output_buffer, pipeline *p) {
+  size_t bytes = output_buffer->size / 8;
+  pipeline_buffer *out = pipeline_output_buffer(p, bytes);
+  memcpy(out->data, output_buffer->bits, bytes);
+  out->size = bytes;
+  pipeline_write(p, out);
 
-  if (node->data != NULL) {
-    int current_offset = ftell(output);
-    int length = strlen(node->data);
-    // printf("writing %s (%d)\n", node->data, length);
-    fwrite(&length, sizeof(int), 1, output);
-    fwrite(node->data, length, 1, output);
-    free(node->data);
-    node->data = (char *)current_offset;
-  } else {
-    node->data = (char *)-1;
-    _huffman_write_word_list_helper(node->left, output);
-    _huffman_write_word_list_helper(node->right, output);
+  // the last partial byte moves to the front, like when writing to the file directly
+  output_buffer->bits[0] = output_buffer->bits[bytes];
+  output_buffer->size %= 8;
+}
+
+uint64_t _huffman_header_word_count(const huffman_header *header, int64_t file_size) {
+  // every word takes at least one bit, a count the data cannot hold has garbage in its high half
+  uint64_t available_bits = file_size > header->compressed_offset ? (uint64_t)(file_size - header->compressed_offset) * 8 : 0;
+  if (header->word_count > available_bits) {
+    return header->word_count & 0xFFFFFFFFu;
   }
+  return header->word_count;
 }
 
-long _huffman_write_huffman_table(huffman_tree *tree, FILE *output) {
-  // write the huffman table to the output file
-  return _huffman_write_huffman_table_helper(tree->root, output);
+huffman_scratch *huffman_scratch_create() {
+  huffman_scratch *scratch = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_scratch));
+  scratch->char_freq_table = memory_calloc(MEMORY_TAG_HUFFMAN, 256, sizeof(uint64_t));
+  scratch->output_buffer = bitvector_create(0);
+  return scratch;
 }
 
-long _huffman_write_huffman_table_helper(huffman_node *node, FILE *output) {
-  if (node == NULL) {
-    return -1;
+void huffman_scratch_destroy(huffman_scratch *scratch) {
+  if (scratch == NULL) {
+    return;
   }
 
-  int freq = node->freq;
-  // already has offset as data
-  long data = (long)node->data;
-  long left_offset = _huffman_write_huffman_table_helper(node->left, output);
-  long right_offset = _huffman_write_huffman_table_helper(node->right, output);
+  memory_free(scratch->char_freq_table);
+  bitvector_destroy(scratch->output_buffer);
+  memory_free(scratch);
+}
+
+void huffman_encode_buffer(char *data, size_t length, char *output_file, int type, huffman_scratch *scratch) {
+  huffman_tree *tree = NULL;
+  trie *code_table = NULL;
+  vocabulary *vocab = NULL;
+  symbol_stream *symbols = NULL;
+  uint32_t *remap = NULL;
+  bitvector **codes = NULL;
+  uint64_t word_count = 0;
+
+  // count the symbols and build the code table, without touching the disk
+  if (type == TYPE_WORD) {
+    // the words are split once, the encoder only maps their symbol ids to codes
+    vocab = vocabulary_create();
+    symbols = symbol_stream_create();
+    word_count = _huffman_tokenize_words(vocab, symbols, data, length, NULL);
+    remap = vocabulary_sort(vocab);
+    tree = huffman_create_tree_from_vocabulary(vocab);
+    codes = _huffman_word_create_code_array(tree, vocab->count);
+  } else {
+    memset(scratch->char_freq_table, 0, 256 * sizeof(uint64_t));
+    _huffman_count_chars(scratch->char_freq_table, data, length);
+    tree = _huffman_create_tree_from_char_freq_table(scratch->char_freq_table);
+    code_table = _huffman_char_create_code_table(tree);
+  }
+
+  // open the output file for writing
+  FILE *output = fopen(output_file, "wb");
+
+  if (output != NULL) {
+    // write the header, then encode the data into the reused output buffer
+    huffman_header *header = _huffman_write_header(tree, code_table, NULL, output);
+    bitvector_reset(scratch->output_buffer);
+    FSEEK64(output, header->compressed_offset, SEEK_SET);
+    if (type == TYPE_WORD) {
+      uint32_t *buffer = memory_alloc(MEMORY_TAG_HUFFMAN, READ_BUFFER_SIZE * sizeof(uint32_t));
+      symbol_stream_rewind(symbols);
+      _huffman_encode_symbols(symbols, word_count, remap, codes, buffer, scratch->output_buffer, NULL);
+      header->word_count = word_count;
+      memory_free(buffer);
+    } else {
+      header->word_count = _huffman_encode_text(data, length, code_table, scratch->output_buffer);
+    }
+    _huffman_write_compressed(header, scratch->output_buffer, output);
+
+    fclose(output);
+    memory_free(header);
+  }
+
+  if (type == TYPE_WORD) {
+    _huffman_delete_code_array(codes, vocab->count);
+    symbol_stream_destroy(symbols);
+    vocabulary_destroy(vocab);
+    memory_free(remap);
+  } else {
+    trie_destroy(code_table, (void (*)(void *))bitvector_destroy);
+  }
+  huffman_delete_tree(tree);
+}
+
+huffman_header *_huffman_write_header(huffman_tree *tree, trie *code_table, FILE *input, FILE *output) {
+  // create a huffman header
+  // zeroed, padding included, so nothing uninitialized reaches the file
+  huffman_header *header = memory_calloc(MEMORY_TAG_HUFFMAN, 1, sizeof(huffman_header));
+
+  // write the huffman header to the output file
+  fwrite(header, sizeof(huffman_header), 1, output);
+
+  header->word_list_offset = FTELL64(output);
+
+  // write the word list to the output file
+  _huffman_write_word_list(tree, output);
+
+  header->huffman_table_offset = FTELL64(output);
+
+  // write the code list to the output file
+  header->root_offset = _huffman_stored_root_offset(_huffman_write_huffman_table(tree, output));
+
+  header->compressed_offset = FTELL64(output);
+
+  // write the huffman header to the output file
+  FSEEK64(output, 0, SEEK_SET);
+  fwrite(header, sizeof(huffman_header), 1, output);
+
+  return header;
+}
+
+void _huffman_write_word_list(huffman_tree *tree, FILE *output) {
+  // recursively write the word list to the output file
+  _huffman_write_word_list_helper(tree->root, output);
+}
+
+void _huffman_write_word_list_helper(huffman_node *node, FILE *output) {
+  if (node == NULL) {
+    return;
+  }
+
+  if (node->data != NULL) {
+    node->offset = FTELL64(output);
+    int length = node->length;
+    // printf("writing %s (%d)\n", node->data, length);
+    fwrite(&length, sizeof(int), 1, output);
+    fwrite(node->data, length, 1, output);
+  } else {
+    node->offset = -1;
+    _huffman_write_word_list_helper(node->left, output);
+    _huffman_write_word_list_helper(node->right, output);
+  }
+}
+
+int64_t _huffman_write_huffman_table(huffman_tree *tree, FILE *output) {
+  // write the huffman table to the output file
+  return _huffman_write_huffman_table_helper(tree->root, output);
+}
+
+unsigned int _huffman_stored_root_offset(int64_t root_offset) {
+  // the first field of a file tells it apart from the other formats, so it never takes the value of a magic
+  if (root_offset < 0 || root_offset > UINT_MAX || root_offset == BLOCK_MAGIC ||
+      root_offset == HUFFMAN_DICTIONARY_MAGIC || root_offset == HUFFMAN_DICTIONARY_FILE_MAGIC) {
+    return 0;
+  }
+  return (unsigned int)root_offset;
+}
+
+int64_t _huffman_write_huffman_table_helper(huffman_node *node, FILE *output) {
+  if (node == NULL) {
+    return -1;
+  }
+
+  int64_t left_offset = _huffman_write_huffman_table_helper(node->left, output);
+  int64_t right_offset = _huffman_write_huffman_table_helper(node->right, output);
+
+  int64_t current_offset = FTELL64(output);
 
-  long current_offset = ftell(output);
+  // the frequency is only informative, it saturates to keep the record layout
+  int freq = node->freq > INT_MAX ? INT_MAX : (int)node->freq;
 
-  fwrite(&node->freq, sizeof(int), 1, output);
-  fwrite(&node->data, sizeof(long), 1, output);
-  fwrite(&left_offset, sizeof(long), 1, output);
-  fwrite(&right_offset, sizeof(long), 1, output);
+  // the word list offset is written where the word will be read back
+  fwrite(&freq, sizeof(int), 1, output);
+  fwrite(&node->offset, sizeof(int64_t), 1, output);
+  fwrite(&left_offset, sizeof(int64_t), 1, output);
+  fwrite(&right_offset, sizeof(int64_t), 1, output);
 
   return current_offset;
 }
 
-void huffman_decode_file(char *input_file, char *output_file) {
+bool huffman_decode_file(char *input_file, char *output_file, int thread_count) {
   // open the input file for reading
   FILE *input = fopen(input_file, "rb");
 
   // if the file does not exist, return
   if (input == NULL) {
-    return;
+    printf("Error: could not read '%s'\n", input_file);
+    return false;
   }
 
-  // open the output file for writing
-  FILE *output = fopen(output_file, "w");
+  // open the output file for writing, readable too so it can be mapped
+  FILE *output = fopen(output_file, "w+b");
 
   // if the file does not exist, return
   if (output == NULL) {
     fclose(input);
-    return;
+    return false;
+  }
+
+  // block files start with their own magic where older files keep their root offset
+  unsigned int magic = 0;
+  if (fread(&magic, sizeof(unsigned int), 1, input) == 1 && magic == BLOCK_MAGIC) {
+    fclose(input);
+    fclose(output);
+    return block_decode_file(input_file, output_file, thread_count);
   }
 
   // read the huffman header from the input file
   huffman_header header;
-  fseek(input, 0, SEEK_SET);
+  FSEEK64(input, 0, SEEK_END);
+  int64_t file_size = FTELL64(input);
+  FSEEK64(input, 0, SEEK_SET);
   fread(&header, sizeof(huffman_header), 1, input);
+  header.word_count = _huffman_header_word_count(&header, file_size);
 
-  // read the huffman table from the input file
-  fseek(input, header.root_offset, SEEK_SET);
-  huffman_tree *tree = huffman_read_huffman_table(input);
+  // files compressed with a dictionary do not carry their own table
+  if (header.root_offset == HUFFMAN_DICTIONARY_FILE_MAGIC) {
+    printf("Error: '%s' was compressed with a dictionary, use --dict\n", input_file);
+    fclose(input);
+    fclose(output);
+    return false;
+  }
 
-  // populate the words from the input file
-  fseek(input, header.word_list_offset, SEEK_SET);
-  _huffman_populate_tree_with_words(tree, input);
+  // an empty input has no tree to read
+  if (header.word_count == 0) {
+    fclose(input);
+    fclose(output);
+    return true;
+  }
 
-  // huffman_print(tree);
+  // load the word list and the huffman table with a single read into a flat tree
+  huffman_decoder *decoder = huffman_read_decoder(input, header.word_list_offset, header.huffman_table_offset,
+                                                  header.compressed_offset);
+  if (decoder == NULL) {
+    printf("Error: '%s' has a corrupted huffman table\n", input_file);
+    fclose(input);
+    fclose(output);
+    return false;
+  }
+
+  // when every word is a single character the word count is the size of the output, it is mapped and decoded in place
+  bool per_char = true, escape = false;
+  for (unsigned int i = 0; i < decoder->symbols->count; i++) {
+    per_char &= decoder->symbols->lengths[i] == 1;
+    escape |= decoder->symbols->lengths[i] == 0;
+  }
+  mapped_file *mapped = per_char ? mapped_file_create(output, header.word_count) : NULL;
+
+  // codes resynchronize on their own, so segments can be decoded from guessed boundaries on several threads,
+  // unless every word is a single bit or escapes break the code with raw bits; the segments decode more bits
+  // than the file holds, so it only pays on enough cores and is left to an explicit -j rather than the default
+  bool lone_leaf = decoder->nodes[0].left == HUFFMAN_NO_CHILD && decoder->nodes[0].right == HUFFMAN_NO_CHILD;
+  bool parallel = thread_count > 1 && !lone_leaf && !escape;
 
   // decode the input file using the huffman tree
-  fseek(input, header.compressed_offset, SEEK_SET);
+  bool decoded = true;
+  FSEEK64(input, header.compressed_offset, SEEK_SET);
   // printf("compressed_offset: 0x%x\n", header.compressed_offset);
-  huffman_decode_file_helper(input, output, &header, tree);
+  if (parallel) {
+    huffman_output *buffered_output = mapped != NULL ? huffman_output_create_mapped(mapped->data, mapped->size)
+                                                     : huffman_output_create(output);
+    decoded = huffman_decode_file_parallel(input, file_size - header.compressed_offset, buffered_output,
+                                           header.word_count, decoder, thread_count);
+    huffman_output_destroy(buffered_output);
+  } else if (mapped != NULL) {
+    decoded = huffman_decode_file_helper(input, NULL, mapped->data, mapped->size, header.word_count, decoder);
+  } else {
+    decoded = huffman_decode_file_helper(input, output, NULL, 0, header.word_count, decoder);
+  }
+  if (!decoded) {
+    printf("Error: '%s' is corrupted or truncated, its data does not decode to its %llu words\n", input_file,
+           (unsigned long long)header.word_count);
+  }
+  bool written = true;
+  if (mapped != NULL && !mapped_file_close(mapped)) {
+    printf("Error: could not write '%s'\n", output_file);
+    written = false;
+  }
 
   // close the files
   fclose(input);
   fclose(output);
+
+  // like block files, a file that does not decode leaves no output behind
+  if (!decoded) {
+    remove(output_file);
+  }
+
+  huffman_delete_decoder(decoder);
+  return decoded && written;
 }
 
 char **_huffman_read_word_list(FILE *input) {
@@ -385,13 +1165,13 @@ char **_huffman_read_word_list(FILE *input) {
   fread(&word_count, sizeof(unsigned int), 1, input);
 
   // allocate memory for the words
-  char **words = malloc(word_count * sizeof(char *));
+  char **words = memory_alloc(MEMORY_TAG_HUFFMAN, word_count * sizeof(char *));
 
   // read the words from the input file
   for (int i = 0; i < word_count; i++) {
     unsigned int length;
     fread(&length, sizeof(unsigned int), 1, input);
-    words[i] = malloc(length + 1);
+    words[i] = memory_alloc(MEMORY_TAG_HUFFMAN, length + 1);
     fread(words[i], sizeof(char), length, input);
     words[i][length] = '\0';
   }
@@ -399,273 +1179,1547 @@ char **_huffman_read_word_list(FILE *input) {
   return words;
 }
 
-huffman_tree *huffman_read_huffman_table(FILE *input) {
-  // read the huffman table from the input file
-  huffman_node *root = _huffman_read_huffman_table_helper(input);
-
-  // create a huffman tree
-  huffman_tree *tree = malloc(sizeof(huffman_tree));
-  tree->root = root;
+huffman_decoder *huffman_read_decoder(FILE *input, int64_t word_list_offset, int64_t huffman_table_offset,
+                                      int64_t huffman_table_end) {
+  int64_t size = huffman_table_end - word_list_offset;
+  int64_t table_start = huffman_table_offset - word_list_offset;
+  if (size <= 0 || table_start < 0 || table_start > size) {
+    return NULL;
+  }
 
-  return tree;
-}
+  // the table is made of fixed size records, which bounds the number of nodes, and every node needs an index
+  uint64_t record_count = (uint64_t)(size - table_start) / HUFFMAN_TABLE_RECORD_SIZE;
+  if (record_count >= HUFFMAN_NO_CHILD) {
+    return NULL;
+  }
 
-huffman_node *_huffman_read_huffman_table_helper(FILE *input) {
-  // read the node from the input file
-  huffman_node *node = malloc(sizeof(huffman_node));
-  fread(&node->freq, sizeof(int), 1, input);
-  fread(&node->data, sizeof(long), 1, input);
+  // read the word list and the huffman table with a single read
+  char *region = memory_alloc(MEMORY_TAG_HUFFMAN, size);
+  FSEEK64(input, word_list_offset, SEEK_SET);
+  if (fread(region, sizeof(char), size, input) != (size_t)size) {
+    memory_free(region);
+    return NULL;
+  }
 
-  // read the left and right offsets from the input file
-  long left_offset, right_offset;
-  fread(&left_offset, sizeof(long), 1, input);
-  fread(&right_offset, sizeof(long), 1, input);
+  huffman_decoder *decoder = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_decoder));
+  decoder->symbols = _huffman_parse_symbol_table(region, table_start);
+
+  unsigned int capacity = (unsigned int)record_count;
+  decoder->nodes = memory_alloc(MEMORY_TAG_HUFFMAN, (capacity > 0 ? capacity : 1) * sizeof(huffman_flat_node));
+  decoder->freqs = memory_alloc(MEMORY_TAG_HUFFMAN, (capacity > 0 ? capacity : 1) * sizeof(unsigned int));
+  decoder->node_count = 0;
+
+  // position of the record behind each node, doubles as the breadth first queue
+  int64_t *records = memory_alloc(MEMORY_TAG_HUFFMAN, (capacity > 0 ? capacity : 1) * sizeof(int64_t));
+  // the table is written in post-order, so the root is its last record whatever the size of the table
+  records[0] = size - (int64_t)HUFFMAN_TABLE_RECORD_SIZE;
+  unsigned int count = capacity > 0 ? 1 : 0;
+
+  for (unsigned int i = 0; i < count; i++) {
+    int64_t position = records[i];
+    if (position < table_start || (uint64_t)position + HUFFMAN_TABLE_RECORD_SIZE > (uint64_t)size) {
+      count = 0;
+      break;
+    }
 
-  // read the left and right subtrees from the input file
-  if (left_offset != -1) {
-    fseek(input, left_offset, SEEK_SET);
-    node->left = _huffman_read_huffman_table_helper(input);
-  } else {
-    node->left = NULL;
-  }
+    // a record is the frequency, the word offset and the two child offsets
+    int64_t offset, left_offset, right_offset;
+    memcpy(&decoder->freqs[i], region + position, sizeof(int));
+    memcpy(&offset, region + position + sizeof(int), sizeof(int64_t));
+    memcpy(&left_offset, region + position + sizeof(int) + sizeof(int64_t), sizeof(int64_t));
+    memcpy(&right_offset, region + position + sizeof(int) + 2 * sizeof(int64_t), sizeof(int64_t));
+
+    // children are numbered in the order they are reached
+    huffman_flat_node *node = &decoder->nodes[i];
+    node->left = HUFFMAN_NO_CHILD;
+    node->right = HUFFMAN_NO_CHILD;
+    node->symbol = 0;
+
+    if (left_offset == -1 && right_offset == -1) {
+      node->symbol = _huffman_find_symbol(decoder->symbols, offset - word_list_offset);
+      if (node->symbol == HUFFMAN_NO_SYMBOL) {
+        count = 0;
+        break;
+      }
+      continue;
+    }
 
-  if (right_offset != -1) {
-    fseek(input, right_offset, SEEK_SET);
-    node->right = _huffman_read_huffman_table_helper(input);
-  } else {
-    node->right = NULL;
+    // a node has both children or none, and more nodes than records means the children loop back
+    if (left_offset == -1 || right_offset == -1 || capacity - count < 2) {
+      count = 0;
+      break;
+    }
+    records[count] = left_offset - word_list_offset;
+    node->left = count++;
+    records[count] = right_offset - word_list_offset;
+    node->right = count++;
   }
 
-  return node;
-}
+  decoder->node_count = count;
+  memory_free(records);
+  memory_free(region);
 
-void _huffman_populate_tree_with_words(huffman_tree *tree, FILE *input) {
-  // read the number of words from the input file
-  unsigned int word_count;
-  fread(&word_count, sizeof(unsigned int), 1, input);
+  if (decoder->node_count == 0) {
+    huffman_delete_decoder(decoder);
+    return NULL;
+  }
 
-  // recursively populate the tree with the words
-  _huffman_populate_tree_with_words_helper(tree->root, input);
+  return decoder;
 }
 
-void _huffman_populate_tree_with_words_helper(huffman_node *node, FILE *input) {
-  if (node == NULL) {
+void huffman_delete_decoder(huffman_decoder *decoder) {
+  if (decoder == NULL) {
     return;
   }
 
-  if (node->data == (char *)-1) {
-    node->data = NULL;
-    _huffman_populate_tree_with_words_helper(node->left, input);
-    _huffman_populate_tree_with_words_helper(node->right, input);
-  } else {
-    unsigned int length;
-    fseek(input, (long)node->data, SEEK_SET);
-    fread(&length, sizeof(unsigned int), 1, input);
-    node->data = malloc(length + 1);
-    fread(node->data, sizeof(char), length, input);
-    node->data[length] = '\0';
-  }
+  huffman_delete_symbol_table(decoder->symbols);
+  memory_free(decoder->freqs);
+  memory_free(decoder->nodes);
+  memory_free(decoder);
 }
 
-void huffman_decode_file_helper(FILE *input, FILE *output, huffman_header *header, huffman_tree *tree) {
-  // traverse the huffman tree to decode the input file
-  huffman_node *current = tree->root;
-  unsigned int word_count = 0;
+huffman_symbol_table *_huffman_parse_symbol_table(const char *word_list, int64_t size) {
+  // the pool holds the words back to back, each followed by a NUL so they can be used as strings
+  huffman_symbol_table *symbols = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_symbol_table));
+  symbols->pool = memory_alloc(MEMORY_TAG_HUFFMAN, size + 1);
+  symbols->positions = memory_alloc(MEMORY_TAG_HUFFMAN, (size / sizeof(int) + 1) * sizeof(int64_t));
+  symbols->offsets = memory_alloc(MEMORY_TAG_HUFFMAN, (size / sizeof(int) + 1) * sizeof(unsigned int));
+  symbols->lengths = memory_alloc(MEMORY_TAG_HUFFMAN, (size / sizeof(int) + 1) * sizeof(unsigned int));
+  symbols->count = 0;
+
+  // walk the word list, each word is its length followed by its bytes
+  size_t pool_size = 0;
+  int64_t position = 0;
+  while (position + (int64_t)sizeof(int) <= size) {
+    int length;
+    memcpy(&length, word_list + position, sizeof(int));
+    if (length < 0 || position + (int64_t)sizeof(int) + length > size) {
+      break;
+    }
 
-  // printf("word_count: %d\n", header->word_count);
-  while (!feof(input)) {
-    // read the next byte from the input file
-    unsigned char byte;
-    fread(&byte, sizeof(unsigned char), 1, input);
-    // printf("byte: 0x%x\n", byte);
+    symbols->positions[symbols->count] = position;
+    symbols->offsets[symbols->count] = pool_size;
+    symbols->lengths[symbols->count] = length;
+    symbols->count++;
 
-    // traverse the huffman tree
-    for (int i = 0; i < 8; i++) {
-      // printf("bit: %d\n", (byte >> i) & 1);
+    memcpy(symbols->pool + pool_size, word_list + position + sizeof(int), length);
+    pool_size += length;
+    symbols->pool[pool_size++] = '\0';
 
-      if ((byte >> i) & 1) {
-        current = current->right;
-      } else {
-        current = current->left;
-      }
+    position += sizeof(int) + length;
+  }
 
-      if (current == NULL) {
-        printf("current is null\n");
-        current = tree->root;
-      } else if (current->data != NULL) {
-        fprintf(output, "%s", current->data);
-        // printf("current: %s\n", current->data);
-        current = tree->root;
-        word_count++;
-      }
+  symbols->pool_size = pool_size;
 
-      if (word_count >= header->word_count) {
-        break;
-      }
+  return symbols;
+}
+
+void huffman_delete_symbol_table(huffman_symbol_table *symbols) {
+  if (symbols == NULL) {
+    return;
+  }
+
+  memory_free(symbols->pool);
+  memory_free(symbols->positions);
+  memory_free(symbols->offsets);
+  memory_free(symbols->lengths);
+  memory_free(symbols);
+}
+
+unsigned int _huffman_find_symbol(huffman_symbol_table *symbols, int64_t position) {
+  // the positions are sorted
+  unsigned int low = 0, high = symbols->count;
+  while (low < high) {
+    unsigned int middle = low + (high - low) / 2;
+    if (symbols->positions[middle] < position) {
+      low = middle + 1;
+    } else {
+      high = middle;
     }
   }
+
+  if (low == symbols->count || symbols->positions[low] != position) {
+    return HUFFMAN_NO_SYMBOL;
+  }
+
+  return low;
 }
 
-void huffman_encode_file_per_word(char *input_file, char *output_file) {
-  // create a word frequency table
-  trie *word_freqs = _huffman_get_word_freq_table_from_file(input_file);
+trie *_huffman_decoder_create_code_table(huffman_decoder *decoder) {
+  trie *code_table = trie_create();
 
-  // create a huffman tree from the word frequency table
-  huffman_tree *tree = huffman_create_tree_from_word_freq_table(word_freqs);
+  // walk the flat tree from the root, node 0
+  _huffman_decoder_traverse_tree(decoder, 0, bitvector_create(0), 0, code_table);
 
-  // printf("Huffman tree:\n");
-  // huffman_print(tree);
-  // printf("\n====================\n");
+  return code_table;
+}
+
+void _huffman_decoder_traverse_tree(huffman_decoder *decoder, unsigned int index, bitvector *code, int depth,
+                                    trie *code_table) {
+  if (index == HUFFMAN_NO_CHILD) {
+    bitvector_destroy(code);
+    return;
+  }
 
-  // create code table from the huffman tree
-  trie *code_table = _huffman_word_create_code_table(tree);
+  huffman_flat_node *node = &decoder->nodes[index];
+  if (node->left == HUFFMAN_NO_CHILD && node->right == HUFFMAN_NO_CHILD) {
+    // insert the word code into the code table
+    bitvector *copy = bitvector_copy(code);
+    if (depth == 0) {
+      // a tree with a single leaf still needs one bit per word
+      bitvector_append(copy, 0);
+    }
+    trie_insert(code_table, decoder->symbols->pool + decoder->symbols->offsets[node->symbol], copy);
+  } else {
+    bitvector *copy_left = bitvector_copy(code);
+    bitvector_append(copy_left, 0);
+    _huffman_decoder_traverse_tree(decoder, node->left, copy_left, depth + 1, code_table);
+
+    bitvector *copy_right = bitvector_copy(code);
+    bitvector_append(copy_right, 1);
+    _huffman_decoder_traverse_tree(decoder, node->right, copy_right, depth + 1, code_table);
+  }
 
-  // encode the input file using the word code table
-  huffman_encode_file(input_file, output_file, tree, code_table);
+  // each call owns the code it was given
+  bitvector_destroy(code);
 }
 
-trie *_huffman_get_word_freq_table_from_file(char *input_file) {
-  trie *word_freq_table = trie_create();
+bool huffman_decode_file_helper(FILE *input, FILE *output, unsigned char *destination, size_t destination_size,
+                                uint64_t total_word_count, huffman_decoder *decoder) {
+  // walk the flat tree to decode the input file, the root is node 0
+  huffman_flat_node *nodes = decoder->nodes;
+  unsigned int current = 0;
+  uint64_t word_count = 0;
 
-  // open the input file for reading
-  FILE *input = fopen(input_file, "r");
+  // a reader thread loads the compressed data ahead and a writer thread stores the decoded words behind
+  pipeline *p = pipeline_start(input, destination != NULL ? NULL : output, READ_BUFFER_SIZE, NULL, 0, 0);
 
-  // if the file does not exist, return NULL
-  if (input == NULL) {
-    return NULL;
+  // decoded words go straight into the mapped output, or are gathered in large buffers and written in big chunks
+  huffman_output *buffered_output = destination != NULL ? huffman_output_create_mapped(destination, destination_size)
+                                                        : huffman_output_create_pipelined(p);
+
+  // the words live in one pool, leaves only hold their symbol id
+  huffman_symbol_table *symbols = decoder->symbols;
+
+  // a lone leaf is coded as a single bit, there is nothing to walk
+  if (nodes[0].left == HUFFMAN_NO_CHILD && nodes[0].right == HUFFMAN_NO_CHILD) {
+    for (; word_count < total_word_count; word_count++) {
+      huffman_output_write(buffered_output, symbols->pool + symbols->offsets[nodes[0].symbol],
+                           symbols->lengths[nodes[0].symbol]);
+    }
+    huffman_output_destroy(buffered_output);
+    if (!pipeline_finish(p)) {
+      printf("Error: could not write the decoded data\n");
+      return false;
+    }
+    return true;
   }
 
-  // read the file line by line and update the word frequency table
-  char line[LINE_BUFFER_SIZE];
-  while (fgets(line, LINE_BUFFER_SIZE, input) != NULL) {
-    int n = 0, offset = 0;
-    char word_buffer[LINE_BUFFER_SIZE] = {0};
-    char delim[2] = {0};
-
-    // printf("line: %s\n", line);
-    for (offset = 0; line[offset] != '\0' && offset < LINE_BUFFER_SIZE; offset += n) {
-      n = 0;
-      sscanf(line + offset, "%[^ \t\n]%n", word_buffer, &n);
-      // printf("word: %s\n", word_buffer);
-
-      if (strlen(word_buffer) > 0) {
-        int steps = 0;
-        int freq = (int)trie_search(word_freq_table, word_buffer, &steps, false);
-        if (freq == 0) {
-          trie_insert(word_freq_table, word_buffer, (void *)1);
-        } else {
-          trie_insert(word_freq_table, word_buffer, (void *)(freq + 1));
+  // bits left to read after an escape code, and the literal being read
+  int escape_bits = 0;
+  unsigned char literal = 0;
+  bool corrupted = false;
+
+  // printf("word_count: %d\n", total_word_count);
+  pipeline_buffer *in;
+  while (word_count < total_word_count && !corrupted && (in = pipeline_next_input(p)) != NULL) {
+    for (size_t position = 0; position < in->size && word_count < total_word_count && !corrupted; position++) {
+      unsigned char byte = in->data[position];
+      // printf("byte: 0x%x\n", byte);
+
+      // traverse the huffman tree
+      for (int i = 0; i < 8 && word_count < total_word_count; i++) {
+        // printf("bit: %d\n", (byte >> i) & 1);
+
+        if (escape_bits > 0) {
+          // read the literal byte that follows an escape code
+          literal |= ((byte >> i) & 1) << (HUFFMAN_ESCAPE_BITS - escape_bits);
+          escape_bits--;
+          if (escape_bits == 0) {
+            huffman_output_write(buffered_output, (char *)&literal, 1);
+            word_count++;
+          }
+          continue;
         }
-        word_buffer[0] = '\0';
-      }
 
-      sscanf(line + offset + n, "%c", delim);
-      n++;
-      // printf("delim: '%s'\n", delim);
-
-      if (strlen(delim) > 0) {
-        int steps = 0;
-        int freq = (int)trie_search(word_freq_table, delim, &steps, false);
-        if (freq == 0) {
-          trie_insert(word_freq_table, delim, (void *)1);
+        if ((byte >> i) & 1) {
+          current = nodes[current].right;
         } else {
-          trie_insert(word_freq_table, delim, (void *)(freq + 1));
+          current = nodes[current].left;
+        }
+
+        if (current == HUFFMAN_NO_CHILD) {
+          // a code that leads nowhere, nothing after it can be trusted
+          corrupted = true;
+          break;
+        } else if (nodes[current].left == HUFFMAN_NO_CHILD && nodes[current].right == HUFFMAN_NO_CHILD) {
+          unsigned int symbol = nodes[current].symbol;
+          if (symbols->lengths[symbol] == 0) {
+            // the escape symbol, the next bits hold the literal byte
+            escape_bits = HUFFMAN_ESCAPE_BITS;
+            literal = 0;
+          } else {
+            huffman_output_write(buffered_output, symbols->pool + symbols->offsets[symbol], symbols->lengths[symbol]);
+            word_count++;
+          }
+          current = 0;
         }
-        delim[0] = '\0';
       }
     }
+    pipeline_release_input(p, in);
   }
 
-  // close the file
-  fclose(input);
+  huffman_output_destroy(buffered_output);
+  if (!pipeline_finish(p)) {
+    printf("Error: could not write the decoded data\n");
+    return false;
+  }
 
-  // get the keys from the word frequency table
-  return word_freq_table;
+  // data that ends before the last word is as broken as a code leading out of the tree
+  return !corrupted && word_count == total_word_count;
 }
 
-huffman_tree *huffman_create_tree_from_word_freq_table(trie *word_freqs) {
-  // create a priority queue
-  priority_queue *queue = priority_queue_create(NULL, _freq_compare);
-  dynamic_array *words = trie_keys(word_freqs);
-  int steps = 0;
-
-  // insert the words into the priority queue
-  for (int i = 0; i < words->size; i++) {
-    huffman_node *node = malloc(sizeof(huffman_node));
-    node->data = words->array[i];
-    node->freq = (int)trie_search(word_freqs, node->data, &steps, false);
-    node->left = NULL;
-    node->right = NULL;
-    priority_queue_insert(queue, node);
-  }
+bool huffman_decode_file_parallel(FILE *input, int64_t data_size, huffman_output *output, uint64_t word_count,
+                                  huffman_decoder *decoder, int thread_count) {
+  // a round is a segment per thread, read with some room for the last word to run past it
+  size_t round_size = (size_t)thread_count * HUFFMAN_SEGMENT_SIZE;
+  size_t margin = HUFFMAN_SEGMENT_SIZE / 16;
+  unsigned char *data = memory_alloc(MEMORY_TAG_HUFFMAN, round_size + margin);
+  huffman_decode_segment *segments = memory_calloc(MEMORY_TAG_HUFFMAN, thread_count, sizeof(huffman_decode_segment));
+  pthread_t *threads = memory_alloc(MEMORY_TAG_HUFFMAN, thread_count * sizeof(pthread_t));
+
+  // the rounds start on a real boundary, counted in bits from the start of the compressed data
+  int64_t data_start = FTELL64(input);
+  uint64_t position = 0;
+  uint64_t words = 0;
+  while (words < word_count && (int64_t)(position / 8) < data_size) {
+    FSEEK64(input, data_start + (int64_t)(position / 8), SEEK_SET);
+    size_t length = fread(data, sizeof(unsigned char), round_size + margin, input);
+    bool last = (int64_t)(position / 8 + length) >= data_size;
+    uint64_t limit = (uint64_t)length * 8;
+    uint64_t start = position % 8;
+    uint64_t round_bits = last ? limit : (uint64_t)round_size * 8;
+
+    // the segments split the round evenly, a short round has fewer of them
+    uint64_t segment_bits = (round_bits - start + thread_count - 1) / thread_count;
+    if (segment_bits < margin * 8) {
+      segment_bits = margin * 8;
+    }
+    int segment_count = (int)((round_bits - start + segment_bits - 1) / segment_bits);
+    for (int k = 0; k < segment_count; k++) {
+      segments[k].decoder = decoder;
+      segments[k].data = data;
+      segments[k].limit = limit;
+      segments[k].start = start + k * segment_bits;
+      segments[k].stop = k + 1 == segment_count ? round_bits : start + (k + 1) * segment_bits;
+    }
+    for (int k = 1; k < segment_count; k++) {
+      pthread_create(&threads[k], NULL, _huffman_decode_segment_worker, &segments[k]);
+    }
+    _huffman_decode_segment_worker(&segments[0]);
+    for (int k = 1; k < segment_count; k++) {
+      pthread_join(threads[k], NULL);
+    }
 
-  // build the huffman tree
-  while (priority_queue_size(queue) > 1) {
-    huffman_node *left = NULL, *right = NULL, *parent = NULL;
+    // the first segment started on a real boundary, each next one joins at the first boundary both decodings share
+    uint64_t boundary = segments[0].end;
+    _huffman_append_segment(&segments[0], 0, output, &words, word_count);
+    for (int k = 1; k < segment_count && words < word_count; k++) {
+      huffman_decode_segment *segment = &segments[k];
+      size_t j = 0;
+      while (words < word_count) {
+        // both lists of boundaries are in increasing order
+        while (j < segment->sync_count && segment->sync_bits[j] < boundary) {
+          j++;
+        }
+        if (j < segment->sync_count && segment->sync_bits[j] == boundary) {
+          // from here on the segment decoded the real words
+          _huffman_append_segment(segment, j, output, &words, word_count);
+          boundary = segment->end;
+          break;
+        }
+        if (j == segment->sync_count) {
+          // no boundary in common within the window, the rest of the segment is decoded again
+          words += _huffman_decode_words(decoder, data, limit, &boundary, segment->stop, word_count - words, output);
+          break;
+        }
 
-    // extract the two nodes with the lowest frequency
-    priority_queue_extract(queue, (void **)&left);
-    priority_queue_extract(queue, (void **)&right);
+        // one more real word, until the decodings meet
+        if (_huffman_decode_words(decoder, data, limit, &boundary, UINT64_MAX, 1, output) == 0) {
+          break;
+        }
+        words++;
+      }
+    }
 
-    // create a parent node
-    parent = malloc(sizeof(huffman_node));
-    parent->data = NULL;
-    parent->freq = left->freq + right->freq;
-    parent->left = left;
-    parent->right = right;
+    // a round that did not get past its first word has data that ends in the middle of a code
+    if (boundary == start) {
+      break;
+    }
+    position = position / 8 * 8 + boundary;
+  }
 
-    // insert the parent node back into the priority queue
-    priority_queue_insert(queue, parent);
+  for (int k = 0; k < thread_count; k++) {
+    memory_free(segments[k].output);
   }
+  memory_free(threads);
+  memory_free(segments);
+  memory_free(data);
 
-  // extract the root node from the priority queue
-  huffman_node *root;
-  priority_queue_extract(queue, (void **)&root);
+  // a code leading out of the tree or data ending early stop the real decoding short of the count
+  return words == word_count;
+}
 
-  // deallocate the priority queue
-  priority_queue_destroy(queue);
+void *_huffman_decode_segment_worker(void *argument) {
+  huffman_decode_segment *segment = argument;
+  const huffman_flat_node *nodes = segment->decoder->nodes;
+  const huffman_symbol_table *symbols = segment->decoder->symbols;
+  uint64_t position = segment->start;
+  segment->size = 0;
+  segment->word_count = 0;
+  segment->sync_count = 0;
+
+  while (true) {
+    // the first boundaries are kept to find where the segment before joins this one
+    if (segment->sync_count < HUFFMAN_SYNC_WINDOW) {
+      segment->sync_bits[segment->sync_count] = position;
+      segment->sync_sizes[segment->sync_count] = segment->size;
+      segment->sync_words[segment->sync_count] = segment->word_count;
+      segment->sync_count++;
+    }
+    if (position >= segment->stop) {
+      break;
+    }
 
-  // create a huffman tree
-  huffman_tree *tree = malloc(sizeof(huffman_tree));
-  tree->root = root;
+    segment->tail_sizes[segment->word_count % HUFFMAN_TAIL_WORDS] = segment->size;
+    unsigned int symbol = _huffman_decode_word(nodes, segment->data, segment->limit, &position);
+    if (symbol == HUFFMAN_NO_SYMBOL) {
+      break;
+    }
 
-  return tree;
+    unsigned int length = symbols->lengths[symbol];
+    if (segment->size + length > segment->capacity) {
+      segment->capacity = segment->capacity > 0 ? segment->capacity * 2 : HUFFMAN_SEGMENT_SIZE;
+      if (segment->capacity < segment->size + length) {
+        segment->capacity = segment->size + length;
+      }
+      segment->output = memory_realloc(MEMORY_TAG_HUFFMAN, segment->output, segment->capacity);
+    }
+    memcpy(segment->output + segment->size, symbols->pool + symbols->offsets[symbol], length);
+    segment->size += length;
+    segment->word_count++;
+  }
+
+  segment->end = position;
+  return NULL;
 }
 
-trie *_huffman_word_create_code_table(huffman_tree *tree) {
-  // create a trie to store the word code table
-  trie *code_table = trie_create();
+void _huffman_append_segment(const huffman_decode_segment *segment, size_t from, huffman_output *output,
+                             uint64_t *words, uint64_t word_count) {
+  size_t from_size = segment->sync_sizes[from];
+  uint64_t from_words = segment->sync_words[from];
+  uint64_t count = segment->word_count - from_words;
+  if (*words + count <= word_count) {
+    huffman_output_write(output, segment->output + from_size, segment->size - from_size);
+    *words += count;
+    return;
+  }
 
-  // bitvector to store the word code
-  bitvector *code = bitvector_create(0);
+  // the padding of the last byte decodes to a few words past the last one, they are left out
+  uint64_t keep = word_count - *words;
+  if (segment->word_count - (from_words + keep) <= HUFFMAN_TAIL_WORDS) {
+    size_t size = segment->tail_sizes[(from_words + keep) % HUFFMAN_TAIL_WORDS];
+    huffman_output_write(output, segment->output + from_size, size - from_size);
+  } else {
+    // a header with fewer words than the data, the words to keep are decoded again
+    uint64_t position = segment->sync_bits[from];
+    _huffman_decode_words(segment->decoder, segment->data, segment->limit, &position, UINT64_MAX, keep, output);
+  }
+  *words += keep;
+}
 
-  // traverse the huffman tree to generate the word code table
-  _huffman_word_traverse_tree(tree->root, code, 0, code_table);
+uint64_t _huffman_decode_words(const huffman_decoder *decoder, const unsigned char *data, uint64_t limit,
+                               uint64_t *position, uint64_t stop, uint64_t max_words, huffman_output *output) {
+  const huffman_symbol_table *symbols = decoder->symbols;
+  uint64_t words = 0;
+  while (words < max_words && *position < stop) {
+    unsigned int symbol = _huffman_decode_word(decoder->nodes, data, limit, position);
+    if (symbol == HUFFMAN_NO_SYMBOL) {
+      break;
+    }
+    huffman_output_write(output, symbols->pool + symbols->offsets[symbol], symbols->lengths[symbol]);
+    words++;
+  }
+  return words;
+}
 
-  // trie_print(code_table);
+huffman_output *huffman_output_create(FILE *file) {
+  huffman_output *output = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_output));
+  output->file = file;
+  output->buffer = memory_alloc(MEMORY_TAG_HUFFMAN, OUTPUT_BUFFER_SIZE);
+  output->size = 0;
+  output->capacity = OUTPUT_BUFFER_SIZE;
+  output->pipeline = NULL;
+  output->pending = NULL;
+  return output;
+}
 
-  return code_table;
+huffman_output *huffman_output_create_pipelined(pipeline *p) {
+  huffman_output *output = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_output));
+  output->file = NULL;
+  output->pipeline = p;
+  output->pending = pipeline_output_buffer(p, OUTPUT_BUFFER_SIZE);
+  output->buffer = (char *)output->pending->data;
+  output->size = 0;
+  output->capacity = OUTPUT_BUFFER_SIZE;
+  return output;
 }
 
-void _huffman_word_traverse_tree(huffman_node *node, bitvector *code, int depth, trie *code_table) {
- if (node == NULL) {
-    bitvector_destroy(code);
+huffman_output *huffman_output_create_mapped(unsigned char *data, size_t size) {
+  huffman_output *output = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_output));
+  output->file = NULL;
+  output->buffer = (char *)data;
+  output->size = 0;
+  output->capacity = size;
+  output->pipeline = NULL;
+  output->pending = NULL;
+  return output;
+}
+
+void huffman_output_write(huffman_output *output, const char *data, size_t length) {
+  // the mapped file has the size of the whole output, a corrupted file cannot write past it
+  if (output->file == NULL && output->pipeline == NULL) {
+    if (length > output->capacity - output->size) {
+      length = output->capacity - output->size;
+    }
+    memcpy(output->buffer + output->size, data, length);
+    output->size += length;
     return;
   }
 
-  if (node->data != NULL) {
-    // insert the word code into the code table
-    bitvector *copy = bitvector_copy(code);
-    trie_insert(code_table, node->data, copy);
+  // make room in the buffer
+  if (output->size + length > OUTPUT_BUFFER_SIZE) {
+    huffman_output_flush(output);
+
+    // anything larger than the buffer goes straight to the file, or in a buffer of its own to keep the order
+    if (length > OUTPUT_BUFFER_SIZE && output->pipeline != NULL) {
+      pipeline_buffer *large = pipeline_output_buffer(output->pipeline, length);
+      memcpy(large->data, data, length);
+      large->size = length;
+      pipeline_write(output->pipeline, large);
+      return;
+    } else if (length > OUTPUT_BUFFER_SIZE) {
+      fwrite(data, sizeof(char), length, output->file);
+      return;
+    }
+  }
+
+  memcpy(output->buffer + output->size, data, length);
+  output->size += length;
+}
+
+void huffman_output_flush(huffman_output *output) {
+  if (output->size == 0 || (output->file == NULL && output->pipeline == NULL)) {
+    return;
+  }
+
+  if (output->pipeline != NULL) {
+    // hand the full buffer to the writer and carry on in a free one
+    output->pending->size = output->size;
+    pipeline_write(output->pipeline, output->pending);
+    output->pending = pipeline_output_buffer(output->pipeline, OUTPUT_BUFFER_SIZE);
+    output->buffer = (char *)output->pending->data;
+  } else {
+    fwrite(output->buffer, sizeof(char), output->size, output->file);
+  }
+  output->size = 0;
+}
+
+void huffman_output_destroy(huffman_output *output) {
+  if (output == NULL) {
+    return;
+  }
+
+  if (output->pipeline != NULL) {
+    // the last buffer goes to the writer as is, the pipeline owns its memory
+    output->pending->size = output->size;
+    pipeline_write(output->pipeline, output->pending);
+  } else if (output->file != NULL) {
+    huffman_output_flush(output);
+    memory_free(output->buffer);
+  }
+  memory_free(output);
+}
+
+uint64_t huffman_word_min_memory_limit(int thread_count) {
+  if (thread_count <= 0) {
+    thread_count = batch_default_thread_count();
+  }
+
+  // a chunk per thread and the carry while counting, the symbol buffer and the codes waiting to be written after
+  uint64_t buffers = (uint64_t)(thread_count + 1) * (READ_BUFFER_SIZE + 1) + READ_BUFFER_SIZE * sizeof(uint32_t) +
+                     2 * (uint64_t)OUTPUT_BUFFER_SIZE;
+  return 2 * buffers;
+}
+
+void huffman_encode_file_per_word(char *input_file, char *output_file, int thread_count, size_t max_vocab) {
+  // split the file into words once, keeping the symbol id of every word
+  huffman_word_tokens *tokens = _huffman_tokenize_file(input_file, thread_count, true, true);
+
+  // if the file does not exist, return
+  if (tokens == NULL) {
+    return;
+  }
+  if (tokens->spelled > 0) {
+    printf("--mem-limit: %llu words were spelled with characters to stay under the limit\n",
+           (unsigned long long)tokens->spelled);
+  }
+
+  huffman_tree *tree = NULL;
+  bitvector **codes = NULL;
+  if (max_vocab > 0) {
+    // the words left out are spelled with single characters of the same tree
+    bool *kept = memory_alloc(MEMORY_TAG_HUFFMAN, (tokens->vocabulary->count + 1) * sizeof(bool));
+    vocabulary *limited = _huffman_limit_vocabulary(tokens->vocabulary, max_vocab, kept);
+    tree = huffman_create_tree_from_vocabulary(limited);
+    bitvector **limited_codes = _huffman_word_create_code_array(tree, limited->count);
+    codes = _huffman_spell_codes(tokens->vocabulary, kept, limited, limited_codes);
+    _huffman_delete_code_array(limited_codes, limited->count);
+    vocabulary_destroy(limited);
+    memory_free(kept);
+  } else {
+    // create a huffman tree from the word frequencies
+    tree = huffman_create_tree_from_vocabulary(tokens->vocabulary);
+
+    // create the codes of the symbol ids from the huffman tree
+    codes = _huffman_word_create_code_array(tree, tokens->vocabulary->count);
+  }
+
+  // printf("Huffman tree:\n");
+  // huffman_print(tree);
+  // printf("\n====================\n");
+
+  // encode the symbol ids, the input file is not read again;
+  // the decoder counts leaves, and a word spelled with characters is one leaf per character,
+  // the tree was built from the number of times each leaf is written so its root holds the total
+  huffman_encode_word_tokens(tokens, output_file, tree, codes, tree->root != NULL ? tree->root->freq : 0);
+
+  _huffman_delete_code_array(codes, tokens->vocabulary->count);
+  huffman_delete_tree(tree);
+  huffman_delete_word_tokens(tokens);
+}
+
+void huffman_encode_file_auto(char *input_file, char *output_file, int thread_count, double sample_rate) {
+  huffman_estimate estimate;
+  if (!huffman_estimate_file(input_file, sample_rate, &estimate)) {
+    printf("Error: could not read '%s'\n", input_file);
+    return;
+  }
+
+  // word mode is ruled out when its estimate is UINT64_MAX, there is no size to show for it
+  char word_size[32] = "n/a";
+  if (estimate.word_size != UINT64_MAX) {
+    snprintf(word_size, sizeof(word_size), "%llu", (unsigned long long)estimate.word_size);
+  }
+  printf("-t auto: %s mode, estimated %llu bytes (char %llu, word %s, stored %llu)\n",
+         estimate.type == TYPE_WORD ? "word" : "char",
+         (unsigned long long)(estimate.type == TYPE_WORD ? estimate.word_size : estimate.char_size),
+         (unsigned long long)estimate.char_size, word_size, (unsigned long long)estimate.stored_size);
+
+  if (estimate.type == TYPE_WORD) {
+    huffman_encode_file_per_word(input_file, output_file, thread_count, 0);
+  } else {
+    block_options options = {
+      .type = TYPE_CHAR, .streams = BLOCK_DEFAULT_STREAMS, .coder = BLOCK_CODER_HUFFMAN, .checksums = false,
+    };
+    block_encode_file(input_file, output_file, &options);
+  }
+}
+
+bool huffman_estimate_file(char *input_file, double sample_rate, huffman_estimate *estimate) {
+  // open the input file for reading
+  FILE *input = fopen(input_file, "rb");
+
+  // if the file does not exist, return
+  if (input == NULL) {
+    return false;
+  }
+
+  // every byte is counted, NUL included since the block format keeps them
+  uint64_t freqs[BLOCK_ALPHABET_SIZE] = {0};
+  uint64_t size;
+  unsigned char *buffer = memory_alloc(MEMORY_TAG_HUFFMAN, READ_BUFFER_SIZE);
+  uint64_t counted = _huffman_sample_bytes(input, sample_rate, freqs, buffer, &size);
+  size_t length;
+
+  // char mode: the codes of the whole file, plus the table, the stream sizes and the index entry of every block;
+  // a block that does not shrink is stored, so char mode never costs much more than the file
+  unsigned char lengths[BLOCK_ALPHABET_SIZE];
+  _canonical_code_lengths(freqs, BLOCK_ALPHABET_SIZE, lengths);
+  uint64_t bits = 0;
+  for (int c = 0; c < BLOCK_ALPHABET_SIZE; c++) {
+    bits += freqs[c] * lengths[c];
+  }
+  if (counted > 0 && counted < size) {
+    bits = (uint64_t)((double)bits * size / counted);
+  }
+  uint64_t block_count = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  uint64_t block_overhead = sizeof(unsigned int) + BLOCK_DEFAULT_STREAMS * sizeof(unsigned int) +
+                            sizeof(block_index_entry);
+  uint64_t coded = (bits + 7) / 8 + block_count * BLOCK_ALPHABET_SIZE / 2;
+  estimate->stored_size = size;
+  estimate->char_size = (coded < size ? coded : size) + block_count * block_overhead + sizeof(block_file_header) +
+                        sizeof(block_trailer);
+
+  // word mode skips NUL bytes, so it is only an option for files without any; a sample that missed part of the file
+  // cannot tell, so the whole file is scanned for them
+  bool has_nul = freqs[0] > 0;
+  if (!has_nul && counted < size) {
+    FSEEK64(input, 0, SEEK_SET);
+    while (!has_nul && (length = fread(buffer, 1, READ_BUFFER_SIZE, input)) > 0) {
+      has_nul = memchr(buffer, '\0', length) != NULL;
+    }
+  }
+  estimate->word_size = UINT64_MAX;
+  if (!has_nul && size > 0) {
+    // count the words of the whole file, or of pieces spread over it, each cut at word boundaries
+    vocabulary *vocab = vocabulary_create();
+    uint64_t sampled = 0;
+    int pieces = size > (uint64_t)HUFFMAN_AUTO_SAMPLES * HUFFMAN_AUTO_SAMPLE_SIZE ? HUFFMAN_AUTO_SAMPLES : 1;
+    for (int k = 0; k < pieces; k++) {
+      uint64_t offset = pieces > 1 ? size / pieces * k : 0;
+      FSEEK64(input, offset, SEEK_SET);
+      size_t start = 0;
+      length = pieces > 1 ? fread(buffer, 1, HUFFMAN_AUTO_SAMPLE_SIZE, input) : 0;
+      if (pieces > 1) {
+        // drop the word cut at each end of the piece
+        while (offset > 0 && start < length && !IS_WORD_DELIMITER(buffer[start])) {
+          start++;
+        }
+        while (length > start && !IS_WORD_DELIMITER(buffer[length - 1])) {
+          length--;
+        }
+        _huffman_tokenize_words(vocab, NULL, (char *)buffer + start, length - start, NULL);
+        sampled += length - start;
+      } else {
+        // the whole file, chunk by chunk
+        size_t pending = 0;
+        while ((length = _huffman_read_chunk(input, (char *)buffer, &pending)) > 0) {
+          _huffman_tokenize_words(vocab, NULL, (char *)buffer, length, NULL);
+          sampled += length;
+          memmove(buffer, buffer + length, pending);
+        }
+      }
+    }
+
+    if (vocab->count > 0 && sampled > 0) {
+      // everything is scaled to the size of the file, which overstates the vocabulary of large files,
+      // so word mode is only picked where it clearly wins
+      huffman_tree *tree = huffman_create_tree_from_vocabulary(vocab);
+      double scale = (double)size / sampled;
+      double table = sizeof(huffman_header) + (2 * vocab->count - 1) * HUFFMAN_TABLE_RECORD_SIZE;
+      for (size_t i = 0; i < vocab->count; i++) {
+        table += sizeof(int) + strlen(vocab->words[i]);
+      }
+      estimate->word_size = (uint64_t)((_huffman_tree_cost(tree->root, 0) / 8.0 + table) * scale) + 1;
+      huffman_delete_tree(tree);
+    }
+    vocabulary_destroy(vocab);
+  }
+
+  memory_free(buffer);
+  fclose(input);
+
+  estimate->type = estimate->word_size < estimate->char_size ? TYPE_WORD : TYPE_CHAR;
+  return true;
+}
+
+uint64_t _huffman_tree_cost(huffman_node *node, int depth) {
+  if (node == NULL) {
+    return 0;
+  }
+
+  // a tree with a single leaf still spends one bit per word
+  if (node->data != NULL) {
+    return node->freq * (depth > 0 ? depth : 1);
+  }
+  return _huffman_tree_cost(node->left, depth + 1) + _huffman_tree_cost(node->right, depth + 1);
+}
+
+huffman_word_tokens *_huffman_tokenize_file(char *input_file, int thread_count, bool keep_symbols, bool spell) {
+  // open the input file for reading
+  FILE *input = fopen(input_file, "r");
+
+  // if the file does not exist, return NULL
+  if (input == NULL) {
+    return NULL;
+  }
+
+  if (thread_count <= 0) {
+    thread_count = batch_default_thread_count();
+  }
+
+  // the threads take turns reading chunks, the end of a word cut by a chunk is carried to the next one
+  huffman_word_reader reader = {.input = input, .carry = memory_alloc(MEMORY_TAG_HUFFMAN, READ_BUFFER_SIZE), .carry_length = 0, .next_sequence = 0,
+                                .spell = spell};
+  pthread_mutex_init(&reader.lock, NULL);
+
+  // tokenize the chunks with thread-local vocabularies, no locking around the tries
+  huffman_word_counter *counters = memory_calloc(MEMORY_TAG_HUFFMAN, thread_count, sizeof(huffman_word_counter));
+  pthread_t *threads = memory_alloc(MEMORY_TAG_HUFFMAN, thread_count * sizeof(pthread_t));
+  for (int i = 0; i < thread_count; i++) {
+    counters[i].reader = &reader;
+    counters[i].vocabulary = vocabulary_create();
+    counters[i].symbols = keep_symbols ? symbol_stream_create() : NULL;
+  }
+  for (int i = 1; i < thread_count; i++) {
+    pthread_create(&threads[i], NULL, _huffman_word_count_worker, &counters[i]);
+  }
+  _huffman_word_count_worker(&counters[0]);
+  for (int i = 1; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // merge the vocabularies in pairs, every round halves the vocabularies left
+  int stride = 1;
+  for (; stride < thread_count; stride *= 2) {
+    for (int i = 0; i + stride < thread_count; i += 2 * stride) {
+      counters[i].merge_source = &counters[i + stride];
+      pthread_create(&threads[i], NULL, _huffman_word_merge_worker, &counters[i]);
+    }
+    for (int i = 0; i + stride < thread_count; i += 2 * stride) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+
+  // number the words in byte order, then resolve the ids of every counter down the reduction
+  huffman_word_tokens *tokens = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_word_tokens));
+  tokens->vocabulary = counters[0].vocabulary;
+  tokens->counters = counters;
+  tokens->thread_count = thread_count;
+  tokens->chunk_count = reader.next_sequence;
+  tokens->spelled = 0;
+  for (int i = 0; i < thread_count; i++) {
+    tokens->spelled += counters[i].spelled;
+  }
+  counters[0].vocabulary = NULL;
+  counters[0].remap = vocabulary_sort(tokens->vocabulary);
+  for (stride /= 2; stride >= 1; stride /= 2) {
+    for (int i = 0; i + stride < thread_count; i += 2 * stride) {
+      huffman_word_counter *source = &counters[i + stride];
+      for (uint64_t j = 0; j < source->remap_count; j++) {
+        source->remap[j] = counters[i].remap[source->remap[j]];
+      }
+    }
+  }
+
+  // close the file
+  pthread_mutex_destroy(&reader.lock);
+  memory_free(reader.carry);
+  memory_free(threads);
+  fclose(input);
+
+  return tokens;
+}
+
+vocabulary *_huffman_limit_vocabulary(const vocabulary *vocab, size_t max_vocab, bool *kept) {
+  // rank the longer words by the characters they save, ties broken by symbol id so the order is stable
+  vocabulary_entry *ranked = memory_alloc(MEMORY_TAG_HUFFMAN, (vocab->count + 1) * sizeof(vocabulary_entry));
+  size_t ranked_count = 0;
+  for (size_t i = 0; i < vocab->count; i++) {
+    kept[i] = vocab->words[i][1] == '\0';
+    if (!kept[i]) {
+      ranked[ranked_count].word = vocab->words[i];
+      ranked[ranked_count].freq = vocab->freqs[i] * strlen(vocab->words[i]);
+      ranked[ranked_count].symbol = (uint32_t)i;
+      ranked_count++;
+    }
+  }
+  qsort(ranked, ranked_count, sizeof(vocabulary_entry), _huffman_benefit_compare);
+  for (size_t i = 0; i < ranked_count && i < max_vocab; i++) {
+    kept[ranked[i].symbol] = true;
+  }
+  memory_free(ranked);
+
+  // the kept words keep their counts, the characters of the others are counted once per occurrence
+  vocabulary *limited = vocabulary_create();
+  for (size_t i = 0; i < vocab->count; i++) {
+    if (kept[i]) {
+      vocabulary_add(limited, vocab->words[i], vocab->freqs[i]);
+      continue;
+    }
+    for (const char *c = vocab->words[i]; *c != '\0'; c++) {
+      char key[2] = {*c, '\0'};
+      vocabulary_add(limited, key, vocab->freqs[i]);
+    }
+  }
+
+  // byte order, like every other word list
+  memory_free(vocabulary_sort(limited));
+  return limited;
+}
+
+int _huffman_benefit_compare(const void *entry1, const void *entry2) {
+  const vocabulary_entry *a = entry1, *b = entry2;
+  if (a->freq != b->freq) {
+    return a->freq > b->freq ? -1 : 1;
+  }
+  return a->symbol < b->symbol ? -1 : a->symbol > b->symbol;
+}
+
+bitvector **_huffman_spell_codes(const vocabulary *vocab, const bool *kept, vocabulary *limited,
+                                 bitvector **limited_codes) {
+  bitvector **codes = memory_calloc(MEMORY_TAG_HUFFMAN, vocab->count + 1, sizeof(bitvector *));
+  int steps = 0;
+
+  for (size_t i = 0; i < vocab->count; i++) {
+    if (kept[i]) {
+      uintptr_t symbol = (uintptr_t)trie_search(limited->index, vocab->words[i], &steps, false) - 1;
+      codes[i] = bitvector_copy(limited_codes[symbol]);
+      continue;
+    }
+
+    // the codes of the characters back to back, each one a word for the decoder
+    codes[i] = bitvector_create(0);
+    for (const char *c = vocab->words[i]; *c != '\0'; c++) {
+      char key[2] = {*c, '\0'};
+      uintptr_t symbol = (uintptr_t)trie_search(limited->index, key, &steps, false) - 1;
+      bitvector_concat(codes[i], limited_codes[symbol]);
+    }
+  }
+
+  return codes;
+}
+
+void huffman_delete_word_tokens(huffman_word_tokens *tokens) {
+  if (tokens == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < tokens->thread_count; i++) {
+    vocabulary_destroy(tokens->counters[i].vocabulary);
+    symbol_stream_destroy(tokens->counters[i].symbols);
+    memory_free(tokens->counters[i].chunks);
+    memory_free(tokens->counters[i].remap);
+  }
+  vocabulary_destroy(tokens->vocabulary);
+  memory_free(tokens->counters);
+  memory_free(tokens);
+}
+
+trie *_huffman_get_word_freq_table_from_file(char *input_file, int thread_count) {
+  huffman_word_tokens *tokens = _huffman_tokenize_file(input_file, thread_count, false, false);
+
+  // if the file does not exist, return NULL
+  if (tokens == NULL) {
+    return NULL;
+  }
+
+  trie *word_freq_table = trie_create();
+  for (size_t i = 0; i < tokens->vocabulary->count; i++) {
+    trie_insert(word_freq_table, tokens->vocabulary->words[i], (void *)(uintptr_t)tokens->vocabulary->freqs[i]);
+  }
+
+  huffman_delete_word_tokens(tokens);
+  return word_freq_table;
+}
+
+void *_huffman_word_count_worker(void *argument) {
+  huffman_word_counter *counter = argument;
+  huffman_word_reader *reader = counter->reader;
+  char *buffer = memory_alloc(MEMORY_TAG_HUFFMAN, READ_BUFFER_SIZE + 1);
+
+  while (true) {
+    // read the next chunk after the bytes the previous reader left, and leave the end of its last word
+    pthread_mutex_lock(&reader->lock);
+    size_t pending = reader->carry_length;
+    memcpy(buffer, reader->carry, pending);
+    size_t length = _huffman_read_chunk(reader->input, buffer, &pending);
+    memcpy(reader->carry, buffer + length, pending);
+    reader->carry_length = pending;
+    uint64_t sequence = length > 0 ? reader->next_sequence++ : 0;
+    pthread_mutex_unlock(&reader->lock);
+
+    if (length == 0) {
+      break;
+    }
+
+    // remember where the symbols of the chunk go in the file, the encoder replays the chunks in order
+    if (counter->chunk_count == counter->chunk_capacity) {
+      counter->chunk_capacity = counter->chunk_capacity > 0 ? counter->chunk_capacity * 2 : 16;
+      counter->chunks = memory_realloc(MEMORY_TAG_HUFFMAN, counter->chunks, counter->chunk_capacity * sizeof(huffman_word_chunk));
+    }
+    huffman_word_chunk *chunk = &counter->chunks[counter->chunk_count++];
+    chunk->sequence = sequence;
+    chunk->symbol_count = _huffman_tokenize_words(counter->vocabulary, counter->symbols, buffer, length,
+                                                  reader->spell ? &counter->spelled : NULL);
+  }
+
+  memory_free(buffer);
+  return NULL;
+}
+
+void *_huffman_word_merge_worker(void *argument) {
+  huffman_word_counter *counter = argument;
+  huffman_word_counter *source = counter->merge_source;
+
+  // the source keeps the id its words got here, resolved to final ids once the reduction is done
+  source->remap_count = source->vocabulary->count;
+  source->remap = memory_alloc(MEMORY_TAG_HUFFMAN, (source->vocabulary->count + 1) * sizeof(uint32_t));
+  vocabulary_merge(counter->vocabulary, source->vocabulary, source->remap);
+  vocabulary_destroy(source->vocabulary);
+  source->vocabulary = NULL;
+  return NULL;
+}
+
+uint64_t _huffman_tokenize_words(vocabulary *vocab, symbol_stream *symbols, const char *data, size_t length,
+                                 uint64_t *spelled) {
+  char word_buffer[LINE_BUFFER_SIZE];
+  uint64_t word_count = 0;
+
+  for (size_t i = 0; i < length;) {
+    if (IS_WORD_DELIMITER(data[i])) {
+      // every delimiter is a word of its own
+      word_buffer[0] = data[i++];
+      word_buffer[1] = '\0';
+    } else if (data[i] == '\0') {
+      i++;
+      continue;
+    } else {
+      // copy the word, long words are split in pieces that fit the buffer
+      int n = 0;
+      while (i < length && n < LINE_BUFFER_SIZE - 1 && data[i] != '\0' && !IS_WORD_DELIMITER(data[i])) {
+        word_buffer[n++] = data[i++];
+      }
+      word_buffer[n] = '\0';
+    }
+
+    // close to the memory limit, a word not seen yet is spelled with its characters instead of growing the vocabulary
+    if (spelled != NULL && word_buffer[1] != '\0' && memory_exceeds(MEMORY_VOCABULARY_SHARE) &&
+        vocabulary_find(vocab, word_buffer) == VOCABULARY_NO_SYMBOL) {
+      for (const char *c = word_buffer; *c != '\0'; c++) {
+        char key[2] = {*c, '\0'};
+        uint32_t symbol = vocabulary_add(vocab, key, 1);
+        if (symbols != NULL) {
+          symbol_stream_write(symbols, symbol);
+        }
+        word_count++;
+      }
+      (*spelled)++;
+      continue;
+    }
+
+    // printf("word: %s\n", word_buffer);
+    uint32_t symbol = vocabulary_add(vocab, word_buffer, 1);
+    if (symbols != NULL) {
+      symbol_stream_write(symbols, symbol);
+    }
+    word_count++;
+  }
+
+  return word_count;
+}
+
+void huffman_encode_word_tokens(huffman_word_tokens *tokens, char *output_file, huffman_tree *tree, bitvector **codes,
+                                uint64_t word_count) {
+  // open the output file for writing
+  FILE *output = fopen(output_file, "wb");
+
+  // if the file does not exist, return
+  if (output == NULL) {
+    return;
+  }
+
+  // write the header to the output file
+  huffman_header *header = _huffman_write_header(tree, NULL, NULL, output);
+  FSEEK64(output, header->compressed_offset, SEEK_SET);
+
+  bitvector *output_buffer = bitvector_create(0);
+  uint32_t *buffer = memory_alloc(MEMORY_TAG_HUFFMAN, READ_BUFFER_SIZE * sizeof(uint32_t));
+  size_t *next_chunk = memory_calloc(MEMORY_TAG_HUFFMAN, tokens->thread_count, sizeof(size_t));
+  for (int t = 0; t < tokens->thread_count; t++) {
+    symbol_stream_rewind(tokens->counters[t].symbols);
+  }
+
+  // replay the chunks in file order, each thread holds its chunks in order in its own stream
+  for (uint64_t sequence = 0; sequence < tokens->chunk_count; sequence++) {
+    for (int t = 0; t < tokens->thread_count; t++) {
+      huffman_word_counter *counter = &tokens->counters[t];
+      if (next_chunk[t] < counter->chunk_count && counter->chunks[next_chunk[t]].sequence == sequence) {
+        huffman_word_chunk *chunk = &counter->chunks[next_chunk[t]++];
+        _huffman_encode_symbols(counter->symbols, chunk->symbol_count, counter->remap, codes, buffer, output_buffer, output);
+        break;
+      }
+    }
+  }
+
+  header->word_count = word_count;
+
+  // write the output buffer and the final header to the output file
+  _huffman_write_compressed(header, output_buffer, output);
+  fclose(output);
+
+  memory_free(next_chunk);
+  memory_free(buffer);
+  memory_free(header);
+  bitvector_destroy(output_buffer);
+}
+
+void _huffman_encode_symbols(symbol_stream *symbols, uint64_t count, const uint32_t *remap, bitvector **codes,
+                             uint32_t *buffer, bitvector *output_buffer, FILE *output) {
+  while (count > 0) {
+    size_t length = symbol_stream_read(symbols, buffer, count < READ_BUFFER_SIZE ? count : READ_BUFFER_SIZE);
+    if (length == 0) {
+      printf("Error: the symbol stream ended early\n");
+      return;
+    }
+    for (size_t i = 0; i < length; i++) {
+      bitvector_concat(output_buffer, codes[remap[buffer[i]]]);
+    }
+    count -= length;
+
+    // write the codes as they come, so the buffer stays the size of a chunk
+    if (output != NULL) {
+      _huffman_flush_compressed(output_buffer, output);
+    }
+  }
+}
+
+huffman_tree *huffman_create_tree_from_word_freq_table(trie *word_freqs) {
+  dynamic_array *words = trie_keys(word_freqs);
+  uint64_t *freqs = memory_alloc(MEMORY_TAG_HUFFMAN, (words->size + 1) * sizeof(uint64_t));
+  int steps = 0;
+
+  for (int i = 0; i < words->size; i++) {
+    freqs[i] = (uint64_t)(uintptr_t)trie_search(word_freqs, words->array[i], &steps, false);
+  }
+
+  huffman_tree *tree = _huffman_create_tree_from_words((char *const *)words->array, freqs, words->size);
+
+  memory_free(freqs);
+  dynamic_array_destroy(words, memory_free);
+  return tree;
+}
+
+huffman_tree *huffman_create_tree_from_vocabulary(vocabulary *vocab) {
+  return _huffman_create_tree_from_words(vocab->words, vocab->freqs, vocab->count);
+}
+
+huffman_tree *_huffman_create_tree_from_words(char *const *words, const uint64_t *freqs, size_t count) {
+  // create a priority queue
+  priority_queue *queue = priority_queue_create(NULL, _freq_compare);
+
+  // insert the words into the priority queue
+  for (size_t i = 0; i < count; i++) {
+    huffman_node *node = memory_alloc(MEMORY_TAG_TREE, sizeof(huffman_node));
+    node->data = memory_strdup(MEMORY_TAG_TREE, words[i]);
+    node->length = strlen(node->data);
+    node->symbol = (unsigned int)i;
+    node->freq = freqs[i];
+    node->offset = -1;
+    node->left = NULL;
+    node->right = NULL;
+    priority_queue_insert(queue, node);
+  }
+
+  // build the huffman tree
+  while (priority_queue_size(queue) > 1) {
+    huffman_node *left = NULL, *right = NULL, *parent = NULL;
+
+    // extract the two nodes with the lowest frequency
+    priority_queue_extract(queue, (void **)&left);
+    priority_queue_extract(queue, (void **)&right);
+
+    // create a parent node
+    parent = memory_alloc(MEMORY_TAG_TREE, sizeof(huffman_node));
+    parent->data = NULL;
+    parent->length = 0;
+    parent->freq = left->freq + right->freq;
+    parent->offset = -1;
+    parent->left = left;
+    parent->right = right;
+
+    // insert the parent node back into the priority queue
+    priority_queue_insert(queue, parent);
+  }
+
+  // extract the root node from the priority queue, an empty input has no root
+  huffman_node *root = NULL;
+  priority_queue_extract(queue, (void **)&root);
+
+  // deallocate the priority queue
+  priority_queue_destroy(queue);
+
+  // create a huffman tree
+  huffman_tree *tree = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_tree));
+  tree->root = root;
+
+  return tree;
+}
+
+bitvector **_huffman_word_create_code_array(huffman_tree *tree, size_t symbol_count) {
+  // create an array to store the code of every symbol id
+  bitvector **codes = memory_calloc(MEMORY_TAG_HUFFMAN, symbol_count + 1, sizeof(bitvector *));
+
+  // bitvector to store the word code
+  bitvector *code = bitvector_create(0);
+
+  // traverse the huffman tree to generate the word codes
+  _huffman_word_traverse_tree(tree->root, code, 0, codes);
+
+  return codes;
+}
+
+void _huffman_word_traverse_tree(huffman_node *node, bitvector *code, int depth, bitvector **codes) {
+ if (node == NULL) {
+    bitvector_destroy(code);
+    return;
+  }
+
+  if (node->data != NULL) {
+    // store the word code under the symbol id of the leaf
+    bitvector *copy = bitvector_copy(code);
+    if (depth == 0) {
+      // a tree with a single leaf still needs one bit per word
+      bitvector_append(copy, 0);
+    }
+    codes[node->symbol] = copy;
   } else {
     // traverse the left subtree
     bitvector *copy_left = bitvector_copy(code);
     bitvector_append(copy_left, 0);
-    _huffman_word_traverse_tree(node->left, copy_left, depth + 1, code_table);
+    _huffman_word_traverse_tree(node->left, copy_left, depth + 1, codes);
 
     // traverse the right subtree
     bitvector *copy_right = bitvector_copy(code);
     bitvector_append(copy_right, 1);
-    _huffman_word_traverse_tree(node->right, copy_right, depth + 1, code_table);
+    _huffman_word_traverse_tree(node->right, copy_right, depth + 1, codes);
+  }
+
+  // each call owns the code it was given
+  bitvector_destroy(code);
+}
+
+void _huffman_delete_code_array(bitvector **codes, size_t symbol_count) {
+  for (size_t i = 0; i < symbol_count; i++) {
+    bitvector_destroy(codes[i]);
   }
-}
\ No newline at end of file
+  memory_free(codes);
+}
+
+void huffman_delete_tree(huffman_tree *tree) {
+  if (tree == NULL) {
+    return;
+  }
+
+  // recursively delete the nodes and their data
+  _huffman_delete_tree_helper(tree->root);
+  memory_free(tree);
+}
+
+void _huffman_delete_tree_helper(huffman_node *node) {
+  if (node == NULL) {
+    return;
+  }
+
+  _huffman_delete_tree_helper(node->left);
+  _huffman_delete_tree_helper(node->right);
+  memory_free(node->data);
+  memory_free(node);
+}
+
+void huffman_train_dictionary(char *input_file, char *dictionary_file, int type) {
+  trie *freqs = NULL;
+
+  // count the symbols of the sample corpus
+  if (type == TYPE_WORD) {
+    freqs = _huffman_get_word_freq_table_from_file(input_file, 0);
+  } else {
+    uint64_t *char_freq_table = _huffman_get_char_freq_table_from_file(input_file);
+    if (char_freq_table != NULL) {
+      freqs = trie_create();
+      for (int i = 1; i < 256; i++) {
+        if (char_freq_table[i] > 0) {
+          char key[2] = {(char)i, '\0'};
+          trie_insert(freqs, key, (void *)(uintptr_t)char_freq_table[i]);
+        }
+      }
+      memory_free(char_freq_table);
+    }
+  }
+
+  if (freqs == NULL) {
+    printf("Error: could not read '%s'\n", input_file);
+    return;
+  }
+
+  _huffman_write_dictionary(freqs, dictionary_file, type);
+}
+
+void huffman_train_dictionary_from_counts(char *counts_file, char *dictionary_file) {
+  int type;
+  vocabulary *counts = counts_read(counts_file, &type);
+  if (counts == NULL) {
+    return;
+  }
+
+  // the counts stand in for the sample corpus
+  trie *freqs = trie_create();
+  for (size_t i = 0; i < counts->count; i++) {
+    trie_insert(freqs, counts->words[i], (void *)(uintptr_t)counts->freqs[i]);
+  }
+  vocabulary_destroy(counts);
+
+  _huffman_write_dictionary(freqs, dictionary_file, type);
+}
+
+void _huffman_write_dictionary(trie *freqs, char *dictionary_file, int type) {
+  // the empty word is the escape symbol, kept as rare as possible
+  trie_insert(freqs, "", (void *)1);
+
+  // create a huffman tree from the frequencies
+  huffman_tree *tree = huffman_create_tree_from_word_freq_table(freqs);
+  trie_destroy(freqs, NULL);
+
+  // open the dictionary file for writing
+  FILE *output = fopen(dictionary_file, "wb");
+
+  // if the file could not be created, return
+  if (output == NULL) {
+    printf("Error: could not create '%s'\n", dictionary_file);
+    return;
+  }
+
+  huffman_dictionary_header header = {0};
+  header.magic = HUFFMAN_DICTIONARY_MAGIC;
+  header.dictionary_id = _huffman_dictionary_id(tree->root, 2166136261u);
+  header.type = type;
+
+  // write a placeholder header, then the word list and the huffman table
+  fwrite(&header, sizeof(huffman_dictionary_header), 1, output);
+
+  header.word_list_offset = FTELL64(output);
+  _huffman_write_word_list(tree, output);
+
+  header.huffman_table_offset = FTELL64(output);
+  header.root_offset = _huffman_stored_root_offset(_huffman_write_huffman_table(tree, output));
+
+  // write the final header to the dictionary file
+  FSEEK64(output, 0, SEEK_SET);
+  fwrite(&header, sizeof(huffman_dictionary_header), 1, output);
+
+  fclose(output);
+  huffman_delete_tree(tree);
+}
+
+unsigned int _huffman_dictionary_id(huffman_node *node, unsigned int hash) {
+  if (node == NULL) {
+    return hash;
+  }
+
+  // FNV-1a over the symbols and frequencies of the leaves, in tree order
+  if (node->data != NULL) {
+    for (int i = 0; node->data[i] != '\0'; i++) {
+      hash = (hash ^ (unsigned char)node->data[i]) * 16777619u;
+    }
+    hash = (hash ^ (unsigned int)node->freq) * 16777619u;
+    return hash;
+  }
+
+  hash = _huffman_dictionary_id(node->left, hash);
+  return _huffman_dictionary_id(node->right, hash);
+}
+
+huffman_dictionary *huffman_read_dictionary(char *dictionary_file) {
+  // open the dictionary file for reading
+  FILE *input = fopen(dictionary_file, "rb");
+
+  // if the file does not exist, return NULL
+  if (input == NULL) {
+    return NULL;
+  }
+
+  huffman_dictionary *dictionary = memory_alloc(MEMORY_TAG_HUFFMAN, sizeof(huffman_dictionary));
+
+  // read and check the dictionary header
+  if (fread(&dictionary->header, sizeof(huffman_dictionary_header), 1, input) != 1 ||
+      dictionary->header.magic != HUFFMAN_DICTIONARY_MAGIC) {
+    memory_free(dictionary);
+    fclose(input);
+    return NULL;
+  }
+
+  // the huffman table runs to the end of the dictionary file
+  FSEEK64(input, 0, SEEK_END);
+  int64_t end = FTELL64(input);
+
+  // load the word list and the huffman table with a single read into a flat tree
+  dictionary->decoder = huffman_read_decoder(input, dictionary->header.word_list_offset,
+                                             dictionary->header.huffman_table_offset, end);
+  fclose(input);
+
+  if (dictionary->decoder == NULL) {
+    memory_free(dictionary);
+    return NULL;
+  }
+
+  return dictionary;
+}
+
+void huffman_delete_dictionary(huffman_dictionary *dictionary) {
+  if (dictionary == NULL) {
+    return;
+  }
+
+  huffman_delete_decoder(dictionary->decoder);
+  memory_free(dictionary);
+}
+
+void huffman_encode_file_with_dictionary(char *input_file, char *output_file, char *dictionary_file) {
+  // load the dictionary
+  huffman_dictionary *dictionary = huffman_read_dictionary(dictionary_file);
+
+  if (dictionary == NULL) {
+    printf("Error: '%s' is not a dictionary\n", dictionary_file);
+    return;
+  }
+
+  // create the code table, the escape code ends up at the root of the trie
+  trie *code_table = _huffman_decoder_create_code_table(dictionary->decoder);
+  bitvector *escape_code = code_table->root->data;
+
+  // open the input file for reading
+  FILE *input = fopen(input_file, "r");
+
+  // if the file does not exist, return
+  if (input == NULL) {
+    trie_destroy(code_table, (void (*)(void *))bitvector_destroy);
+    huffman_delete_dictionary(dictionary);
+    return;
+  }
+
+  // open the output file for writing
+  FILE *output = fopen(output_file, "wb");
+
+  // if the file does not exist, return
+  if (output == NULL) {
+    fclose(input);
+    trie_destroy(code_table, (void (*)(void *))bitvector_destroy);
+    huffman_delete_dictionary(dictionary);
+    return;
+  }
+
+  huffman_dictionary_file_header header = {0};
+  header.magic = HUFFMAN_DICTIONARY_FILE_MAGIC;
+  header.dictionary_id = dictionary->header.dictionary_id;
+
+  bitvector *output_buffer = bitvector_create(0);
+
+  // write a placeholder header, the word count is only known at the end
+  fwrite(&header, sizeof(huffman_dictionary_file_header), 1, output);
+
+  // encode the input file using the longest word of the dictionary at each position
+  char line[LINE_BUFFER_SIZE];
+  while (fgets(line, LINE_BUFFER_SIZE, input) != NULL) {
+    int length = strlen(line);
+    int steps = 0;
+    for (int i = 0; i < length; i += steps) {
+      bitvector *code = trie_search(code_table, (char *)(line + i), &steps, false);
+
+      if (steps == 0) {
+        // symbol missing from the dictionary, escape it as a raw byte
+        bitvector_concat(output_buffer, escape_code);
+        for (int bit = 0; bit < HUFFMAN_ESCAPE_BITS; bit++) {
+          bitvector_append(output_buffer, ((unsigned char)line[i] >> bit) & 1);
+        }
+        steps = 1;
+      } else {
+        bitvector_concat(output_buffer, code);
+      }
+
+      header.word_count++;
+    }
+
+    // write the codes as they come, so the buffer never holds the whole file
+    if (output_buffer->size >= (size_t)OUTPUT_BUFFER_SIZE * 8) {
+      _huffman_flush_compressed(output_buffer, output);
+    }
+  }
+
+  // write the rest of the compressed data and the final header
+  fwrite(output_buffer->bits, output_buffer->size / 8 + 1, 1, output);
+  FSEEK64(output, 0, SEEK_SET);
+  fwrite(&header, sizeof(huffman_dictionary_file_header), 1, output);
+
+  // close the files
+  fclose(input);
+  fclose(output);
+
+  bitvector_destroy(output_buffer);
+  trie_destroy(code_table, (void (*)(void *))bitvector_destroy);
+  huffman_delete_dictionary(dictionary);
+}
+
+bool huffman_decode_file_with_dictionary(char *input_file, char *output_file, char *dictionary_file) {
+  // load the dictionary
+  huffman_dictionary *dictionary = huffman_read_dictionary(dictionary_file);
+
+  if (dictionary == NULL) {
+    printf("Error: '%s' is not a dictionary\n", dictionary_file);
+    return false;
+  }
+
+  // open the input file for reading
+  FILE *input = fopen(input_file, "rb");
+
+  // if the file does not exist, return
+  if (input == NULL) {
+    printf("Error: could not read '%s'\n", input_file);
+    huffman_delete_dictionary(dictionary);
+    return false;
+  }
+
+  // read and check the header against the dictionary
+  huffman_dictionary_file_header header;
+  if (fread(&header, sizeof(huffman_dictionary_file_header), 1, input) != 1 ||
+      header.magic != HUFFMAN_DICTIONARY_FILE_MAGIC) {
+    printf("Error: '%s' was not compressed with a dictionary\n", input_file);
+    fclose(input);
+    huffman_delete_dictionary(dictionary);
+    return false;
+  }
+
+  if (header.dictionary_id != dictionary->header.dictionary_id) {
+    printf("Error: '%s' was compressed with another dictionary (id %08x)\n", input_file, header.dictionary_id);
+    fclose(input);
+    huffman_delete_dictionary(dictionary);
+    return false;
+  }
+
+  // open the output file for writing
+  FILE *output = fopen(output_file, "w");
+
+  // if the file does not exist, return
+  if (output == NULL) {
+    fclose(input);
+    huffman_delete_dictionary(dictionary);
+    return false;
+  }
+
+  // decode the input file using the dictionary tree
+  bool decoded = huffman_decode_file_helper(input, output, NULL, 0, header.word_count, dictionary->decoder);
+  if (!decoded) {
+    printf("Error: '%s' is corrupted or truncated, its data does not decode to its %llu words\n", input_file,
+           (unsigned long long)header.word_count);
+  }
+
+  // close the files
+  fclose(input);
+  fclose(output);
+  if (!decoded) {
+    remove(output_file);
+  }
+
+  huffman_delete_dictionary(dictionary);
+  return decoded;
+}
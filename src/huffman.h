@@ -1,30 +1,95 @@
 #ifndef HUFFMAN_H
 #define HUFFMAN_H
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "trie.h"
 #include "bitvector.h"
 #include "priority_queue.h"
 #include "dynamic_array.h"
+#include "pipeline.h"
+#include "symbol_stream.h"
+#include "vocabulary.h"
 
 #define MAX_WORD_LENGTH 50
 #define LINE_BUFFER_SIZE 1024
+#define READ_BUFFER_SIZE (1 << 20)
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define HUFFMAN_MAX_CHUNKS (1 << 14)      // Most chunks counted on their own, larger files get larger chunks
+#define HUFFMAN_SEGMENT_SIZE (1 << 20)    // Compressed bytes a thread decodes from a guessed start
+#define HUFFMAN_SYNC_WINDOW 1024          // Word boundaries a segment records to find where it joins the one before
+#define HUFFMAN_TAIL_WORDS 8              // Last words a segment can give back, padding decodes to fewer
+#define HUFFMAN_AUTO_SAMPLES 8            // Pieces of a large file whose words -t auto counts
+#define HUFFMAN_AUTO_SAMPLE_SIZE (1 << 20)  // Bytes per piece
+#define HUFFMAN_SAMPLE_CHUNK_SIZE (1 << 16)  // Bytes read at each offset when the symbols are counted on a sample
+
+// file offsets past 2 GiB, long is only 32 bits on Windows
+#ifdef _WIN32
+#define FSEEK64 _fseeki64
+#define FTELL64 _ftelli64
+#else
+#define FSEEK64 fseeko
+#define FTELL64 ftello
+#endif
+
+#define IS_WORD_DELIMITER(c) ((c) == ' ' || (c) == '\t' || (c) == '\n')
+
+#define TYPE_CHAR 0
+#define TYPE_WORD 1
+#define TYPE_TOKEN 2
+#define TYPE_CONTEXT 3
+#define TYPE_LZ 4
+#define TYPE_AUTO 5                       // Picks TYPE_CHAR or TYPE_WORD by estimated size, never stored in a file
+
+#define HUFFMAN_DICTIONARY_MAGIC 0x44465548       // "HUFD", dictionary files
+#define HUFFMAN_DICTIONARY_FILE_MAGIC 0x43465548  // "HUFC", files compressed with a dictionary
+#define HUFFMAN_ESCAPE_BITS 8                     // Raw bits following an escape code
+
+#define HUFFMAN_TABLE_RECORD_SIZE (sizeof(int) + 3 * sizeof(int64_t))  // Frequency, word offset and child offsets
+#define HUFFMAN_NO_CHILD 0xFFFFFFFFu              // Child index of a leaf in a flat tree
+#define HUFFMAN_NO_SYMBOL 0xFFFFFFFFu             // Symbol lookup failure
 
 #define PARENT_AT(i) ((i - 1) / 2)
 #define LEFT_CHILD_OF(i) (2 * i + 1)
 #define RIGHT_CHILD_OF(i) (2 * i + 2)
 
+/**
+ * Structure to represent the estimated sizes of a file compressed in each mode, in bytes
+ */
+typedef struct huffman_estimate {
+  uint64_t char_size;               // Char mode in the block format, blocks that do not shrink stored as is
+  uint64_t word_size;               // Word mode, UINT64_MAX if the file holds bytes it cannot encode
+  uint64_t stored_size;             // The file as is
+  int type;                         // TYPE_CHAR or TYPE_WORD, whichever is smaller
+} huffman_estimate;
+
 /**
  * Structure to represent a huffman node
  */
 typedef struct huffman_node {
   char *data;
-  int freq;
+  size_t length;                    // Length of the data, so leaves are written without strlen
+  unsigned int symbol;              // Index of the word in the symbol table or vocabulary
+  uint64_t freq;
+  int64_t offset;                   // Offset of the word in the word list, -1 for inner nodes
   struct huffman_node *left;
   struct huffman_node *right;
 } huffman_node;
 
+/**
+ * Structure to represent the word list of a compressed file, loaded with a single read
+ */
+typedef struct huffman_symbol_table {
+  char *pool;                       // Every word back to back, each followed by a NUL
+  size_t pool_size;                 // Size of the pool
+  int64_t *positions;               // Position of each word in the stored word list
+  unsigned int *offsets;            // Offset of each word in the pool
+  unsigned int *lengths;            // Length of each word
+  unsigned int count;               // Number of words
+} huffman_symbol_table;
+
 /**
  * Structure to represent a huffman tree
  */
@@ -32,65 +97,720 @@ typedef struct huffman_tree {
   huffman_node *root;
 } huffman_tree;
 
+/**
+ * Structure to represent a node of a flat huffman tree, children are indices in breadth first order
+ */
+typedef struct huffman_flat_node {
+  unsigned int left;                // Index of the left child, HUFFMAN_NO_CHILD for leaves
+  unsigned int right;               // Index of the right child, HUFFMAN_NO_CHILD for leaves
+  unsigned int symbol;              // Index of the word in the symbol table, for leaves
+} huffman_flat_node;
+
+/**
+ * Structure to represent a huffman tree read from a file, the root is node 0
+ */
+typedef struct huffman_decoder {
+  huffman_flat_node *nodes;         // Nodes in breadth first order
+  unsigned int node_count;          // Number of nodes
+  unsigned int *freqs;              // Frequency of each node as stored, saturated at INT_MAX
+  huffman_symbol_table *symbols;    // Words of the leaves
+} huffman_decoder;
+
 /**
  * Structure to represent a huffman header
  */
 typedef struct huffman_header {
-  unsigned int root_offset;          // Index of the root node
-  long word_list_offset;            // Offset of the word list
-  long huffman_table_offset;        // Offset of the huffman table
-  long compressed_offset;           // Offset of the compressed data
-  unsigned int word_count;          // Number of words
+  unsigned int root_offset;          // Offset of the root record for older readers, 0 if it does not fit
+  int64_t word_list_offset;         // Offset of the word list
+  int64_t huffman_table_offset;     // Offset of the huffman table
+  int64_t compressed_offset;        // Offset of the compressed data
+  uint64_t word_count;              // Number of words, older files only set the low 32 bits
 } huffman_header;
 
+/**
+ * Structure to gather decoded data and write it to a file in large chunks
+ */
+typedef struct huffman_output {
+  FILE *file;                       // NULL when the buffer is the mapped file itself
+  char *buffer;                     // OUTPUT_BUFFER_SIZE bytes, or the mapped file
+  size_t size;                      // Bytes waiting in the buffer
+  size_t capacity;                  // Size of the buffer
+  pipeline *pipeline;               // Writer thread the full buffers go to, NULL to write them directly
+  pipeline_buffer *pending;         // Pipeline buffer holding the buffer above
+} huffman_output;
+
+/**
+ * Structure to hold the buffers a thread reuses between the files it compresses
+ */
+typedef struct huffman_scratch {
+  uint64_t *char_freq_table;        // Character frequency table, cleared for each file
+  bitvector *output_buffer;         // Compressed bits, reset for each file
+} huffman_scratch;
+
+/**
+ * Structure to represent a thread writing the codes of every n-th chunk of a file in place
+ */
+typedef struct huffman_char_encoder {
+  const char *input_file;           // Opened by every thread, so each has its own position
+  const uint64_t *codes;            // Code of every character, the first bit in the least significant bit
+  const unsigned char *lengths;     // Length of every code, 0 for characters left out
+  size_t chunk_size;                // Bytes per chunk, the last one may be shorter
+  size_t chunk_count;               // Number of chunks
+  const uint64_t *chunk_bits;       // Bit where the codes of every chunk start, then the total
+  unsigned char *output;            // Compressed data, mapped
+  unsigned char *edges;             // First and last byte of every chunk, shared with its neighbours
+  size_t first;                     // First chunk of this thread
+  size_t step;                      // Number of threads
+  bool failed;                      // Set when a chunk did not match its count
+} huffman_char_encoder;
+
+/**
+ * Structure to share an input file between the threads counting its words
+ */
+typedef struct huffman_word_reader {
+  FILE *input;
+  pthread_mutex_t lock;             // Guards the file, the carried bytes and the sequence
+  char *carry;                      // Start of the word cut at the end of the last chunk
+  size_t carry_length;              // Length of the carried bytes
+  uint64_t next_sequence;           // Position in the file of the next chunk
+  bool spell;                       // Spell new words with characters once memory runs short
+} huffman_word_reader;
+
+/**
+ * Structure to represent a chunk of the input tokenized by a thread
+ */
+typedef struct huffman_word_chunk {
+  uint64_t sequence;                // Position of the chunk in the file
+  uint64_t symbol_count;            // Number of words in the chunk
+} huffman_word_chunk;
+
+/**
+ * Structure to represent a thread tokenizing chunks with its own vocabulary
+ */
+typedef struct huffman_word_counter {
+  huffman_word_reader *reader;      // Shared input
+  vocabulary *vocabulary;           // Words of the chunks this thread read, NULL once merged into another counter
+  symbol_stream *symbols;           // Symbol ids of the chunks in this vocabulary, NULL when not kept
+  huffman_word_chunk *chunks;       // Chunks this thread read, in file order
+  size_t chunk_count;               // Number of chunks
+  size_t chunk_capacity;            // Capacity of the chunk array
+  struct huffman_word_counter *merge_source;  // Counter to fold into this one during the reduction
+  uint32_t *remap;                  // Symbol id of each word of this vocabulary, in the final vocabulary once resolved
+  size_t remap_count;               // Number of words of this vocabulary
+  uint64_t spelled;                 // Words spelled with characters to stay under the memory limit
+} huffman_word_counter;
+
+/**
+ * Structure to represent a file split into words, with the symbol ids of every word in file order
+ */
+typedef struct huffman_word_tokens {
+  vocabulary *vocabulary;           // Every word of the file, in byte order
+  huffman_word_counter *counters;   // Symbol streams and chunks of the threads
+  int thread_count;                 // Number of counters
+  uint64_t chunk_count;             // Number of chunks over all the counters
+  uint64_t spelled;                 // Words spelled with characters to stay under the memory limit
+} huffman_word_tokens;
+
+/**
+ * Structure to represent a thread decoding a segment of the compressed data from a guessed word boundary
+ * Codes resynchronize after a few words, from then on the words match those of a decoding from the real start
+ */
+typedef struct huffman_decode_segment {
+  const huffman_decoder *decoder;
+  const unsigned char *data;        // Compressed data of the round
+  uint64_t limit;                   // Number of bits of data
+  uint64_t start;                   // Bit where the decoding starts, only a real boundary for the first segment
+  uint64_t stop;                    // The decoding ends at the first boundary at or past this bit
+  uint64_t end;                     // Boundary where the decoding ended
+  char *output;                     // Decoded words
+  size_t size;                      // Bytes decoded
+  size_t capacity;                  // Capacity of the output
+  uint64_t word_count;              // Words decoded
+  uint64_t sync_bits[HUFFMAN_SYNC_WINDOW];   // First word boundaries, from the start
+  size_t sync_sizes[HUFFMAN_SYNC_WINDOW];    // Bytes decoded at each of them
+  uint64_t sync_words[HUFFMAN_SYNC_WINDOW];  // Words decoded at each of them
+  size_t sync_count;                // Number of boundaries recorded
+  size_t tail_sizes[HUFFMAN_TAIL_WORDS];     // Bytes decoded before each of the last words, by word % HUFFMAN_TAIL_WORDS
+} huffman_decode_segment;
+
+/**
+ * Structure to represent the header of a dictionary file
+ */
+typedef struct huffman_dictionary_header {
+  unsigned int magic;               // HUFFMAN_DICTIONARY_MAGIC
+  unsigned int dictionary_id;       // Identifier checked when decompressing
+  unsigned int type;                // Type the dictionary was trained with
+  unsigned int root_offset;         // Offset of the root record for older readers, 0 if it does not fit
+  int64_t word_list_offset;         // Offset of the word list
+  int64_t huffman_table_offset;     // Offset of the huffman table
+} huffman_dictionary_header;
+
+/**
+ * Structure to represent the header of a file compressed with a dictionary
+ */
+typedef struct huffman_dictionary_file_header {
+  unsigned int magic;               // HUFFMAN_DICTIONARY_FILE_MAGIC
+  unsigned int dictionary_id;       // Identifier of the dictionary used
+  uint64_t word_count;              // Number of words, escapes included
+} huffman_dictionary_file_header;
+
+/**
+ * Structure to represent a dictionary loaded in memory
+ */
+typedef struct huffman_dictionary {
+  huffman_dictionary_header header;
+  huffman_decoder *decoder;
+} huffman_dictionary;
+
 /**
  * Function to create a character code table from a huffman tree
  * @param input_file The input file
  * @param output_file The output file
+ * @param thread_count The number of threads writing the codes, 0 for one per core
+ * @param sample_rate The share of the file the tree is built from, 1 to count every character
+ */
+void huffman_encode_file_per_char(char *input_file, char *output_file, int thread_count, double sample_rate);
+
+/**
+ * Function to encode a file with character codes, in place if possible and through the stream otherwise
+ * @param input_file The input file
+ * @param output_file The output file
+ * @param tree The huffman tree, with a leaf for every character of the file
+ * @param chunk_freqs The character frequency table of every chunk
+ * @param chunk_size The bytes per chunk
+ * @param chunk_count The number of chunks
+ * @param thread_count The number of threads, 0 for one per core
+ */
+void _huffman_encode_file_chars(char *input_file, char *output_file, huffman_tree *tree, const uint64_t *chunk_freqs,
+                                size_t chunk_size, size_t chunk_count, int thread_count);
+
+/**
+ * Function to count the symbols of a file into a counts file, without compressing it
+ * The counts files of the shards of a corpus add up with counts_merge_files into the table of the whole corpus
+ * @param input_file The input file
+ * @param counts_file The counts file
+ * @param type The type of symbols (TYPE_CHAR or TYPE_WORD)
+ * @param thread_count The number of threads counting the words, 0 for one per core
+ * @param sample_rate The share of the file counted with TYPE_CHAR, 1 to count every character
+ */
+void huffman_count_file(char *input_file, char *counts_file, int type, int thread_count, double sample_rate);
+
+/**
+ * Function to create a vocabulary of single characters from a character frequency table
+ * @param char_freq_table The character frequency table
+ * @return The vocabulary, in byte order
+ */
+vocabulary *_huffman_char_vocabulary(const uint64_t *char_freq_table);
+
+/**
+ * Function to compress a file with the table of a counts file instead of its own frequencies
+ * The shards of a corpus compressed with its merged counts share their codes, every symbol of the file
+ * must be in the counts
+ * @param input_file The input file
+ * @param output_file The output file
+ * @param counts_file The counts file
+ * @param thread_count The number of threads, 0 for one per core
+ * @return true if successful, false if a file could not be read or a symbol is missing from the counts, the output
+ *         file is then removed
+ */
+bool huffman_encode_file_with_counts(char *input_file, char *output_file, char *counts_file, int thread_count);
+
+/**
+ * Function to create a character frequency table for every chunk of a file
+ * @param input_file The input file
+ * @param chunk_size Set to the bytes per chunk, a multiple of READ_BUFFER_SIZE
+ * @param chunk_count Set to the number of chunks
+ * @return The tables, 256 counts per chunk, NULL if the file could not be read
+ */
+uint64_t *_huffman_get_chunk_freq_tables(char *input_file, size_t *chunk_size, size_t *chunk_count);
+
+/**
+ * Function to encode a file with character codes straight into the mapped output
+ * The code lengths times the chunk tables give the exact size of the output and where the codes of every chunk
+ * start, so the output is sized once and the chunks are encoded in place on several threads
+ * @param input_file The input file
+ * @param output_file The output file
+ * @param tree The huffman tree
+ * @param chunk_freqs The character frequency table of every chunk
+ * @param chunk_size The bytes per chunk
+ * @param chunk_count The number of chunks
+ * @param thread_count The number of threads, 0 for one per core
+ * @return true if the file was handled, false if the codes are too long or the output cannot be mapped
+ */
+bool huffman_encode_file_mapped(char *input_file, char *output_file, huffman_tree *tree, const uint64_t *chunk_freqs,
+                                size_t chunk_size, size_t chunk_count, int thread_count);
+
+/**
+ * Thread encoding its share of the chunks of a file
+ * @param argument The huffman_char_encoder of the thread
+ * @return NULL
+ */
+void *_huffman_char_encode_worker(void *argument);
+
+/**
+ * Function to encode a file in one pass with the codes as machine words, for a tree that was not built
+ * from the counts of every chunk, such as one from a sample
+ * @param input_file The input file
+ * @param output_file The output file
+ * @param tree The huffman tree, with a leaf for every character of the file
+ * @return true if the file was handled, false if a code is longer than 64 bits
+ */
+bool huffman_encode_file_streamed(char *input_file, char *output_file, huffman_tree *tree);
+
+/**
+ * Function to write the codes of a chunk at its position in the compressed data
+ * The bytes the chunk shares with its neighbours go to its edges, to be merged once every chunk is written
+ * @param data The chunk
+ * @param length The length of the chunk
+ * @param codes The code of every character
+ * @param lengths The length of every code
+ * @param output The compressed data
+ * @param start The bit where the codes of the chunk start
+ * @param end The bit where the codes of the next chunk start
+ * @param edges The first and the last byte of the chunk, written
+ * @return true if successful, false if the codes of the chunk do not end at the end bit
  */
-void huffman_encode_file_per_char(char *input_file, char *output_file);
+bool _huffman_encode_chars(const unsigned char *data, size_t length, const uint64_t *codes,
+                           const unsigned char *lengths, unsigned char *output, uint64_t start, uint64_t end,
+                           unsigned char *edges);
+
+/**
+ * Function to write 32 bits of codes, the first byte going to the edges if it is shared
+ * @param out The position in the compressed data, advanced
+ * @param accumulator The bits waiting, shifted
+ * @param count The number of bits waiting, at least 32
+ * @param head The first byte of the chunk if it is shared, NULL otherwise
+ * @param edges The edges of the chunk
+ */
+static inline void _huffman_store_word(unsigned char **out, uint64_t *accumulator, int *count,
+                                       const unsigned char *head, unsigned char *edges) {
+  unsigned char *bytes = *out;
+  if (bytes == head) {
+    edges[0] |= (unsigned char)*accumulator;
+  } else {
+    bytes[0] = (unsigned char)*accumulator;
+  }
+  bytes[1] = (unsigned char)(*accumulator >> 8);
+  bytes[2] = (unsigned char)(*accumulator >> 16);
+  bytes[3] = (unsigned char)(*accumulator >> 24);
+  *out += 4;
+  *accumulator >>= 32;
+  *count -= 32;
+}
+
+/**
+ * Function to create the code of every character of a huffman tree as a machine word
+ * @param node The node
+ * @param code The bits of the path to the node
+ * @param depth The depth of the node
+ * @param codes The code of every character, written
+ * @param lengths The length of every code, written
+ * @return true if successful, false if a code is longer than 64 bits
+ */
+bool _huffman_char_code_words(huffman_node *node, uint64_t code, int depth, uint64_t *codes, unsigned char *lengths);
 
 /**
  * Function to create a character frequency table from a file
  * @param input_file The input file
  * @return The character frequency table
  */
-int *_huffman_get_char_freq_table_from_file(char *input_file);
+uint64_t *_huffman_get_char_freq_table_from_file(char *input_file);
+
+/**
+ * Function to create a character frequency table from evenly spaced chunks of a file
+ * Every character but NUL gets a count of at least one, so the characters the sample missed still have a code,
+ * unless the sample covered the whole file
+ * @param input_file The input file
+ * @param sample_rate The share of the file read, in chunks of HUFFMAN_SAMPLE_CHUNK_SIZE bytes
+ * @return The character frequency table of the sample
+ */
+uint64_t *_huffman_sample_char_freq_table(char *input_file, double sample_rate);
+
+/**
+ * Function to count the bytes of a file, or of chunks spread over it
+ * @param input The input file
+ * @param sample_rate The share of the file read, 1 or more to read all of it
+ * @param freqs The frequency of every byte, NUL included, added to
+ * @param buffer A buffer of READ_BUFFER_SIZE bytes
+ * @param size The size of the file, written
+ * @return The number of bytes counted
+ */
+uint64_t _huffman_sample_bytes(FILE *input, double sample_rate, uint64_t *freqs, unsigned char *buffer,
+                               uint64_t *size);
 
 /**
  * Function to create a word code table from a huffman tree
  * @param input_file The input file
  * @param output_file The output file
+ * @param thread_count The number of threads counting the words, 0 for one per core
+ * @param max_vocab The most words of several characters in the tree, 0 for no limit
+ */
+void huffman_encode_file_per_word(char *input_file, char *output_file, int thread_count, size_t max_vocab);
+
+/**
+ * Function to give the smallest memory limit word compression can keep to
+ * Its read buffers, one per thread, and its encoding buffers do not shrink with the limit, and the vocabulary
+ * grows to half of the limit before new words are spelled, so the limit must be twice the buffers
+ * @param thread_count The number of threads counting the words, 0 for one per core
+ * @return The smallest limit in bytes
+ */
+uint64_t huffman_word_min_memory_limit(int thread_count);
+
+/**
+ * Function to compress a file in char or word mode, whichever is estimated smaller
+ * Char mode uses the block format, so parts of the file that do not compress are stored as is
+ * @param input_file The input file
+ * @param output_file The output file
+ * @param thread_count The number of threads, 0 for one per core
+ * @param sample_rate The share of the file whose bytes are counted, 1 to count all of them
+ */
+void huffman_encode_file_auto(char *input_file, char *output_file, int thread_count, double sample_rate);
+
+/**
+ * Function to estimate the size of a file compressed in each mode without encoding it
+ * The bytes are counted on the whole file or on a sample; the words of files larger than HUFFMAN_AUTO_SAMPLES
+ * pieces are counted on pieces spread over the file; sampled counts are scaled to its size
+ * Word mode drops NUL bytes, so it is ruled out for any file holding one, even one the sample missed
+ * @param input_file The input file
+ * @param sample_rate The share of the file whose bytes are counted, 1 to count all of them
+ * @param estimate The estimated sizes, written
+ * @return true if successful, false if the file could not be read
+ */
+bool huffman_estimate_file(char *input_file, double sample_rate, huffman_estimate *estimate);
+
+/**
+ * Function to count the bits of the codes of a huffman tree
+ * @param node The node
+ * @param depth The depth of the node
+ * @return The sum of the frequency times the code length of every leaf
+ */
+uint64_t _huffman_tree_cost(huffman_node *node, int depth);
+
+/**
+ * Function to keep the words of a vocabulary that save the most, the others being spelled with single characters
+ * Words of one character are always kept, of the others the max_vocab with the highest frequency times length
+ * @param vocab The vocabulary
+ * @param max_vocab The most words of several characters to keep
+ * @param kept Set for every symbol id of the vocabulary, true if the word is kept
+ * @return The vocabulary of the tree, the kept words and the characters of the others, in byte order
+ */
+vocabulary *_huffman_limit_vocabulary(const vocabulary *vocab, size_t max_vocab, bool *kept);
+
+/**
+ * Function to compare two vocabulary entries by decreasing benefit, then by symbol id
+ * @param entry1 The first entry
+ * @param entry2 The second entry
+ * @return The comparison of the entries
+ */
+int _huffman_benefit_compare(const void *entry1, const void *entry2);
+
+/**
+ * Function to create the codes of every word of a vocabulary from the codes of a limited one
+ * @param vocab The vocabulary
+ * @param kept Whether each word is in the limited vocabulary
+ * @param limited The limited vocabulary
+ * @param limited_codes The codes of the limited vocabulary, by symbol id
+ * @return The codes by symbol id of the vocabulary, the words left out get the codes of their characters
+ */
+bitvector **_huffman_spell_codes(const vocabulary *vocab, const bool *kept, vocabulary *limited,
+                                 bitvector **limited_codes);
+
+/**
+ * Function to split a file into words once, for both the frequencies and the encoding
+ * Each thread reads whole chunks cut after a delimiter and tokenizes them with its own vocabulary,
+ * the vocabularies are then merged in pairs, log2(thread_count) rounds of parallel merges
+ * @param input_file The input file
+ * @param thread_count The number of threads, 0 for one per core
+ * @param keep_symbols Keep the symbol ids of the words, otherwise only count them
+ * @param spell Spell the new words with characters once memory runs short, the symbols then stay decodable
+ * @return The tokens, NULL if the file could not be read
+ */
+huffman_word_tokens *_huffman_tokenize_file(char *input_file, int thread_count, bool keep_symbols, bool spell);
+
+/**
+ * Function to delete the tokens of a file from memory
+ * @param tokens The tokens
+ */
+void huffman_delete_word_tokens(huffman_word_tokens *tokens);
+
+/**
+ * Function to create a word frequency table from a file
+ * @param input_file The input file
+ * @param thread_count The number of threads, 0 for one per core
+ * @return The word frequency table, NULL if the file could not be read
+ */
+trie *_huffman_get_word_freq_table_from_file(char *input_file, int thread_count);
+
+/**
+ * Thread tokenizing the chunks it takes from the shared reader until the end of the file
+ * @param argument The huffman_word_counter of the thread
+ * @return NULL
+ */
+void *_huffman_word_count_worker(void *argument);
+
+/**
+ * Thread folding the vocabulary of the merge source of a counter into its own
+ * @param argument The huffman_word_counter of the thread
+ * @return NULL
+ */
+void *_huffman_word_merge_worker(void *argument);
+
+/**
+ * Function to add the words of a buffer to a vocabulary
+ * Words are runs of non delimiters, each delimiter is a word of its own
+ * @param vocab The vocabulary
+ * @param symbols Receives the symbol id of every word, NULL to only count them
+ * @param data The buffer, which must not end in the middle of a word
+ * @param length The length of the buffer
+ * @param spelled Counts the new words spelled with characters once the memory in use passes
+ *                MEMORY_VOCABULARY_SHARE of the limit, NULL to never spell them
+ * @return The number of words, a spelled word counting one per character
+ */
+uint64_t _huffman_tokenize_words(vocabulary *vocab, symbol_stream *symbols, const char *data, size_t length,
+                                 uint64_t *spelled);
+
+/**
+ * Function to encode the symbol ids of a stream with the codes of their words
+ * @param symbols The symbol stream, rewound
+ * @param count The number of symbols to encode
+ * @param remap The final symbol id of each id of the stream
+ * @param codes The codes by final symbol id
+ * @param buffer Room for READ_BUFFER_SIZE symbol ids
+ * @param output_buffer The compressed bits
+ * @param output The output file the whole bytes are flushed to, NULL to keep them in the buffer
+ */
+void _huffman_encode_symbols(symbol_stream *symbols, uint64_t count, const uint32_t *remap, bitvector **codes,
+                             uint32_t *buffer, bitvector *output_buffer, FILE *output);
+
+/**
+ * Function to compress the tokens of a file with word codes
+ * @param tokens The tokens
+ * @param output_file The output file
+ * @param tree The huffman tree of the vocabulary
+ * @param codes The codes by symbol id
+ * @param word_count The number of leaves the codes add up to, for the header
  */
-void huffman_encode_file_per_word(char *input_file, char *output_file);
+void huffman_encode_word_tokens(huffman_word_tokens *tokens, char *output_file, huffman_tree *tree, bitvector **codes,
+                                uint64_t word_count);
 
-trie *_huffman_get_word_freq_table_from_file(char *input_file);
+/**
+ * Function to update a character frequency table with the bytes of a buffer
+ * @param char_freq_table The character frequency table
+ * @param data The buffer
+ * @param length The length of the buffer
+ */
+void _huffman_count_chars(uint64_t *char_freq_table, const char *data, size_t length);
+
+/**
+ * Function to read the next chunk of a file, cut after its last delimiter so no word is split
+ * The caller moves the pending bytes that follow the chunk to the start of the buffer before the next call
+ * @param input The input file
+ * @param buffer The buffer, with room for READ_BUFFER_SIZE + 1 bytes
+ * @param pending The number of bytes at the start of the buffer, updated with the bytes after the chunk
+ * @return The length of the chunk, 0 at the end of the file
+ */
+size_t _huffman_read_chunk(FILE *input, char *buffer, size_t *pending);
 
 /**
  * Function to decompress a file using huffman decoding
+ * Files coded per character decode to one byte per word, their output is mapped at its final size
  * @param input_file The input file
  * @param output_file The output file
+ * @param thread_count The number of threads decoding the blocks of a block file, 0 for one per core; files without
+ *                     blocks are decoded on one thread unless more are asked for
+ * @return true if successful, false if the file is missing, corrupted or could not be written
  */
-void huffman_decode_file(char *input_file, char *output_file);
+bool huffman_decode_file(char *input_file, char *output_file, int thread_count);
 
 char **_huffman_read_word_list(FILE *input);
 
-huffman_tree *huffman_read_huffman_table(FILE *input);
+/**
+ * Function to load the word list and the huffman table of a file with a single read into a flat tree
+ * @param input The input file
+ * @param word_list_offset The offset of the word list
+ * @param huffman_table_offset The offset of the huffman table, right after the word list
+ * @param huffman_table_end The offset right after the huffman table, the root is the record just before it
+ * @return The decoder, NULL if the table is corrupted: a record out of the table, a leaf without its word, a node
+ *         with a single child or children looping back
+ */
+huffman_decoder *huffman_read_decoder(FILE *input, int64_t word_list_offset, int64_t huffman_table_offset,
+                                      int64_t huffman_table_end);
+
+/**
+ * Function to delete a decoder from memory
+ * @param decoder The decoder
+ */
+void huffman_delete_decoder(huffman_decoder *decoder);
+
+/**
+ * Function to parse a word list already in memory into a symbol table
+ * @param word_list The word list
+ * @param size The size of the word list
+ * @return The symbol table
+ */
+huffman_symbol_table *_huffman_parse_symbol_table(const char *word_list, int64_t size);
+
+/**
+ * Function to delete a symbol table from memory
+ * @param symbols The symbol table
+ */
+void huffman_delete_symbol_table(huffman_symbol_table *symbols);
 
-void _huffman_populate_tree_with_words(huffman_tree *tree, FILE *input);
+/**
+ * Function to find the symbol id of the word stored at a position of the word list
+ * @param symbols The symbol table
+ * @param position The position of the word, relative to the start of the word list
+ * @return The symbol id, HUFFMAN_NO_SYMBOL if no word starts there
+ */
+unsigned int _huffman_find_symbol(huffman_symbol_table *symbols, int64_t position);
+
+/**
+ * Function to create the code table of a decoder, to encode with a tree read from a file
+ * @param decoder The decoder
+ * @return The code table
+ */
+trie *_huffman_decoder_create_code_table(huffman_decoder *decoder);
 
-void _huffman_populate_tree_with_words_helper(huffman_node *node, FILE *input);
+void _huffman_decoder_traverse_tree(huffman_decoder *decoder, unsigned int index, bitvector *code, int depth,
+                                    trie *code_table);
 
-void huffman_decode_file_helper(FILE *input, FILE *output, huffman_header *header, huffman_tree *tree);
+/**
+ * Function to decode the compressed data of a file, from the current position of the input
+ * A reader thread loads the next chunks and a writer thread stores the decoded ones while this one decodes
+ * @param input The input file
+ * @param output The output file
+ * @param destination The mapped output the words are decoded into instead, NULL to write the output file
+ * @param destination_size The size of the mapped output
+ * @param word_count The number of words to decode
+ * @param decoder The decoder
+ * @return true if successful, false if a code leads out of the tree, decoding then stops, if the data ends before
+ *         the last word or if the output could not be written
+ */
+bool huffman_decode_file_helper(FILE *input, FILE *output, unsigned char *destination, size_t destination_size,
+                                uint64_t word_count, huffman_decoder *decoder);
+
+/**
+ * Function to decode the compressed data of a file on several threads, from the current position of the input
+ * The data is read in rounds of one segment per thread, every segment but the first starts at a guessed boundary,
+ * then the segments are joined where the decoding of the one before meets a boundary the next one found
+ * @param input The input file
+ * @param data_size The number of bytes of compressed data
+ * @param output The output buffer
+ * @param word_count The number of words to decode
+ * @param decoder The decoder, without escape symbol nor lone leaf
+ * @param thread_count The number of threads
+ * @return true if successful, false if the data does not decode to word_count words
+ */
+bool huffman_decode_file_parallel(FILE *input, int64_t data_size, huffman_output *output, uint64_t word_count,
+                                  huffman_decoder *decoder, int thread_count);
+
+/**
+ * Thread decoding a segment
+ * @param argument The huffman_decode_segment of the thread
+ * @return NULL
+ */
+void *_huffman_decode_segment_worker(void *argument);
+
+/**
+ * Function to append the words a segment decoded from one of its boundaries, up to the word count of the file
+ * @param segment The segment
+ * @param from The index of the boundary in the sync window, where the real words start
+ * @param output The output buffer
+ * @param words The number of words written so far, updated
+ * @param word_count The number of words of the file
+ */
+void _huffman_append_segment(const huffman_decode_segment *segment, size_t from, huffman_output *output,
+                             uint64_t *words, uint64_t word_count);
+
+/**
+ * Function to decode words one at a time from a real boundary, when joining segments
+ * @param decoder The decoder
+ * @param data The compressed data
+ * @param limit The number of bits of data
+ * @param position The boundary to start from, advanced
+ * @param stop Decoding ends at the first boundary at or past this bit
+ * @param max_words The most words to decode
+ * @param output The output buffer
+ * @return The number of words decoded
+ */
+uint64_t _huffman_decode_words(const huffman_decoder *decoder, const unsigned char *data, uint64_t limit,
+                               uint64_t *position, uint64_t stop, uint64_t max_words, huffman_output *output);
+
+/**
+ * Function to decode one word by walking the tree bit by bit
+ * @param nodes The nodes of the flat tree
+ * @param data The compressed data
+ * @param limit The number of bits of data
+ * @param position The bit where the word starts, advanced past it
+ * @return The symbol of the word, HUFFMAN_NO_SYMBOL if the data ends first or the tree is broken
+ */
+static inline unsigned int _huffman_decode_word(const huffman_flat_node *nodes, const unsigned char *data,
+                                                uint64_t limit, uint64_t *position) {
+  unsigned int current = 0;
+  uint64_t bit = *position;
+  do {
+    if (bit >= limit) {
+      return HUFFMAN_NO_SYMBOL;
+    }
+    current = (data[bit >> 3] >> (bit & 7)) & 1 ? nodes[current].right : nodes[current].left;
+    bit++;
+    if (current == HUFFMAN_NO_CHILD) {
+      return HUFFMAN_NO_SYMBOL;
+    }
+  } while (nodes[current].left != HUFFMAN_NO_CHILD || nodes[current].right != HUFFMAN_NO_CHILD);
+  *position = bit;
+  return nodes[current].symbol;
+}
+
+/**
+ * Function to create an output buffer in front of a file
+ * @param file The output file
+ * @return The output buffer
+ */
+huffman_output *huffman_output_create(FILE *file);
+
+/**
+ * Function to create an output buffer in front of the writer thread of a pipeline
+ * The buffers are filled in place and handed to the writer when full
+ * @param p The pipeline
+ * @return The output buffer
+ */
+huffman_output *huffman_output_create_pipelined(pipeline *p);
+
+/**
+ * Function to create an output buffer over a mapped file, the data is written in place and never flushed
+ * @param data The mapped file
+ * @param size The size of the mapped file, what does not fit is dropped
+ * @return The output buffer
+ */
+huffman_output *huffman_output_create_mapped(unsigned char *data, size_t size);
+
+/**
+ * Function to append data to an output buffer, flushing it when full
+ * @param output The output buffer
+ * @param data The data
+ * @param length The length of the data
+ */
+void huffman_output_write(huffman_output *output, const char *data, size_t length);
+
+/**
+ * Function to write the buffered data to the file
+ * @param output The output buffer
+ */
+void huffman_output_flush(huffman_output *output);
 
-huffman_node *_huffman_read_huffman_table_helper(FILE *input);
+/**
+ * Function to flush and delete an output buffer, the file is left open
+ * @param output The output buffer
+ */
+void huffman_output_destroy(huffman_output *output);
 
 /**
  * Function to create a huffman tree from a character frequency table
  * @param char_freq_table The character frequency table
  * @return The huffman tree
  */
-huffman_tree *_huffman_create_tree_from_char_freq_table(int *char_freq_table);
+huffman_tree *_huffman_create_tree_from_char_freq_table(uint64_t *char_freq_table);
 
 /**
  * Function to create a huffman tree from a character frequency table
@@ -117,6 +837,68 @@ void _huffman_char_traverse_tree(huffman_node *node, bitvector *code, int depth,
  */
 void huffman_encode_file(char *input_file, char *output_file, huffman_tree *tree, trie *code_table);
 
+/**
+ * Function to encode a text with a code table, NUL bytes are skipped like when counting the characters
+ * @param text The text, NUL terminated
+ * @param length The length of the text
+ * @param code_table The code table
+ * @param output_buffer The bitvector the codes are appended to
+ * @return The number of words encoded
+ */
+size_t _huffman_encode_text(const char *text, size_t length, trie *code_table, bitvector *output_buffer);
+
+/**
+ * Function to write the whole bytes of the output buffer, the last partial byte stays in the buffer
+ * @param output_buffer The output buffer
+ * @param output The output file, at the position of the bytes
+ */
+void _huffman_flush_compressed(bitvector *output_buffer, FILE *output);
+
+/**
+ * Function to hand the whole bytes of the output buffer to the writer thread of a pipeline
+ * @param output_buffer The output buffer
+ * @param p The pipeline
+ */
+void _huffman_flush_compressed_pipelined(bitvector *output_buffer, pipeline *p);
+
+/**
+ * Function to read the word count of a header, ignoring the high half older files left uninitialized
+ * @param header The huffman header
+ * @param file_size The size of the compressed file
+ * @return The word count
+ */
+uint64_t _huffman_header_word_count(const huffman_header *header, int64_t file_size);
+
+/**
+ * Function to write the rest of the compressed data and the final header to a file
+ * @param header The huffman header
+ * @param output_buffer The compressed data not flushed yet
+ * @param output The output file, at the position of the data
+ */
+void _huffman_write_compressed(huffman_header *header, bitvector *output_buffer, FILE *output);
+
+/**
+ * Function to create the scratch buffers of a compressing thread
+ * @return The scratch buffers
+ */
+huffman_scratch *huffman_scratch_create();
+
+/**
+ * Function to delete scratch buffers from memory
+ * @param scratch The scratch buffers
+ */
+void huffman_scratch_destroy(huffman_scratch *scratch);
+
+/**
+ * Function to compress a file already loaded in memory
+ * @param data The contents of the file, NUL terminated
+ * @param length The length of the contents
+ * @param output_file The output file
+ * @param type The type of symbols (TYPE_CHAR or TYPE_WORD)
+ * @param scratch The scratch buffers of the calling thread
+ */
+void huffman_encode_buffer(char *data, size_t length, char *output_file, int type, huffman_scratch *scratch);
+
 /**
  * Function to write a huffman header to a file
  * @param code_table The code table
@@ -141,9 +923,17 @@ void _huffman_write_word_list_helper(huffman_node *node, FILE *output);
  */
 void _huffman_write_code_list(trie *code_table, FILE *output);
 
-long _huffman_write_huffman_table(huffman_tree *tree, FILE *output);
+int64_t _huffman_write_huffman_table(huffman_tree *tree, FILE *output);
 
-long _huffman_write_huffman_table_helper(huffman_node *node, FILE *output);
+/**
+ * Function to give the root offset stored in a header, readers take the root from the end of the table instead
+ * The offset only fits 32 bits and the first field of a file must not look like a magic, so either case stores 0
+ * @param root_offset The offset of the root record
+ * @return The value to store
+ */
+unsigned int _huffman_stored_root_offset(int64_t root_offset);
+
+int64_t _huffman_write_huffman_table_helper(huffman_node *node, FILE *output);
 
 /**
  * Function to create a huffman tree from a word frequency table
@@ -154,12 +944,30 @@ long _huffman_write_huffman_table_helper(huffman_node *node, FILE *output);
  */
 huffman_tree *huffman_create_tree_from_word_freq_table(trie *word_freqs);
 
+/**
+ * Function to create a huffman tree from a vocabulary, the leaves keep the symbol ids of their words
+ * @param vocab The vocabulary
+ * @return The huffman tree
+ */
+huffman_tree *huffman_create_tree_from_vocabulary(vocabulary *vocab);
+
+/**
+ * Function to create a huffman tree from words and their frequencies
+ * @param words The words, copied into the leaves
+ * @param freqs The frequencies
+ * @param count The number of words
+ * @return The huffman tree, the leaf of words[i] has symbol i
+ */
+huffman_tree *_huffman_create_tree_from_words(char *const *words, const uint64_t *freqs, size_t count);
+
 /**
  * Function to delete a huffman tree from memory
  * @param tree The huffman tree
  */
 void huffman_delete_tree(huffman_tree *tree);
 
+void _huffman_delete_tree_helper(huffman_node *node);
+
 void huffman_print(huffman_tree *tree);
 
 /**
@@ -178,8 +986,80 @@ void huffman_write_char_tree(huffman_tree *tree, FILE *output);
 
 void huffman_write_char_tree_helper(huffman_node *node, FILE *output);
 
-trie *_huffman_word_create_code_table(huffman_tree *tree);
+/**
+ * Function to create the word codes of a huffman tree, indexed by symbol id
+ * @param tree The huffman tree
+ * @param symbol_count The number of symbols
+ * @return The codes, to be deleted with _huffman_delete_code_array
+ */
+bitvector **_huffman_word_create_code_array(huffman_tree *tree, size_t symbol_count);
+
+void _huffman_word_traverse_tree(huffman_node *node, bitvector *code, int depth, bitvector **codes);
+
+/**
+ * Function to delete word codes from memory
+ * @param codes The codes
+ * @param symbol_count The number of symbols
+ */
+void _huffman_delete_code_array(bitvector **codes, size_t symbol_count);
+
+/**
+ * Function to train a dictionary from a sample corpus
+ * The dictionary holds a word list and a huffman table shared by many small files,
+ * plus an escape symbol used for anything the corpus did not contain
+ * @param input_file The sample corpus
+ * @param dictionary_file The dictionary file to write
+ * @param type The type of symbols (TYPE_CHAR or TYPE_WORD)
+ */
+void huffman_train_dictionary(char *input_file, char *dictionary_file, int type);
 
-void _huffman_word_traverse_tree(huffman_node *node, bitvector *code, int depth, trie *code_table);
+/**
+ * Function to train a dictionary from a counts file, such as the merged counts of every shard of a corpus
+ * The shards then share the table of the dictionary instead of each carrying it in their header
+ * @param counts_file The counts file
+ * @param dictionary_file The dictionary file to write
+ */
+void huffman_train_dictionary_from_counts(char *counts_file, char *dictionary_file);
+
+/**
+ * Function to write a dictionary from symbol frequencies, adding the escape symbol
+ * @param freqs The frequency of every symbol, destroyed
+ * @param dictionary_file The dictionary file to write
+ * @param type The type of symbols (TYPE_CHAR or TYPE_WORD)
+ */
+void _huffman_write_dictionary(trie *freqs, char *dictionary_file, int type);
+
+/**
+ * Function to read a dictionary from a file
+ * @param dictionary_file The dictionary file
+ * @return The dictionary, or NULL if the file is not a dictionary
+ */
+huffman_dictionary *huffman_read_dictionary(char *dictionary_file);
+
+/**
+ * Function to delete a dictionary from memory
+ * @param dictionary The dictionary
+ */
+void huffman_delete_dictionary(huffman_dictionary *dictionary);
+
+unsigned int _huffman_dictionary_id(huffman_node *node, unsigned int hash);
+
+/**
+ * Function to compress a file using a dictionary, skipping the frequency pass
+ * The output only carries the dictionary id, the symbol count and the compressed data
+ * @param input_file The input file
+ * @param output_file The output file
+ * @param dictionary_file The dictionary file
+ */
+void huffman_encode_file_with_dictionary(char *input_file, char *output_file, char *dictionary_file);
+
+/**
+ * Function to decompress a file compressed with a dictionary
+ * @param input_file The input file
+ * @param output_file The output file
+ * @param dictionary_file The dictionary file
+ * @return true if successful, false if a file is missing or corrupted, or the dictionary is another one
+ */
+bool huffman_decode_file_with_dictionary(char *input_file, char *output_file, char *dictionary_file);
 
 #endif // HUFFMAN_H
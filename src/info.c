@@ -0,0 +1,259 @@
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "info.h"
+#include "block.h"
+#include "memory.h"
+
+bool info_print_file(char *input_file, unsigned int top_count, FILE *output) {
+    // open the input file for reading
+    FILE *input = fopen(input_file, "rb");
+
+    // if the file does not exist, return
+    if (input == NULL) {
+        printf("Error: could not read '%s'\n", input_file);
+        return false;
+    }
+
+    FSEEK64(input, 0, SEEK_END);
+    int64_t file_size = FTELL64(input);
+    FSEEK64(input, 0, SEEK_SET);
+
+    // every format starts with its magic but files without blocks, which start with their root offset
+    unsigned int magic = 0;
+    fread(&magic, sizeof(unsigned int), 1, input);
+    FSEEK64(input, 0, SEEK_SET);
+
+    if (magic == BLOCK_MAGIC) {
+        // the index tells the sizes, the reference of a char block tells whether it ships a table
+        block_file_header header;
+        unsigned int block_count;
+        uint32_t *checksums;
+        block_index_entry *index = _block_read_index(input, &header, &block_count, &checksums);
+        if (index == NULL) {
+            printf("Error: '%s' is a corrupted block file\n", input_file);
+            fclose(input);
+            return false;
+        }
+        uint64_t original_size = 0;
+        unsigned int shipped = 0, stored = 0;
+        for (unsigned int i = 0; i < block_count; i++) {
+            original_size += index[i].original_size;
+            unsigned int reference;
+            FSEEK64(input, index[i].offset, SEEK_SET);
+            if (block_shares_tables(&header) && fread(&reference, sizeof(unsigned int), 1, input) == 1) {
+                shipped += reference == i;
+                stored += reference == BLOCK_STORED;
+            }
+        }
+        const char *types[] = {"char", "word", "token", "context", "lz"};
+        fprintf(output, "'%s': block file, %s blocks coded with %s in %d stream%s%s\n", input_file,
+                header.type <= TYPE_LZ ? types[header.type] : "unknown",
+                header.coder == BLOCK_CODER_ANS ? "ans" : "huffman", header.streams, header.streams > 1 ? "s" : "",
+                block_has_checksums(&header) ? ", with checksums" : "");
+        fprintf(output, "original size: %llu bytes\n", (unsigned long long)original_size);
+        fprintf(output, "compressed size: %lld bytes (%.3f bits per byte)\n", (long long)file_size,
+                original_size > 0 ? file_size * 8.0 / original_size : 0.0);
+        fprintf(output, "blocks: %u of %u bytes\n", block_count, header.block_size);
+        if (block_shares_tables(&header)) {
+            fprintf(output, "tables: %u shipped, %u blocks reuse one, %u blocks stored\n", shipped,
+                    block_count - shipped - stored, stored);
+        }
+        memory_free(checksums);
+        memory_free(index);
+        fclose(input);
+        return true;
+    }
+
+    if (magic == HUFFMAN_DICTIONARY_MAGIC) {
+        // a dictionary keeps the frequencies of its sample corpus
+        fclose(input);
+        huffman_dictionary *dictionary = huffman_read_dictionary(input_file);
+        if (dictionary == NULL) {
+            printf("Error: '%s' is a corrupted dictionary\n", input_file);
+            return false;
+        }
+        fprintf(output, "'%s': dictionary %08x, trained with -t %u\n", input_file, dictionary->header.dictionary_id,
+                dictionary->header.type);
+        info_print_tree(dictionary->decoder, 0, 0, top_count, output);
+        huffman_delete_dictionary(dictionary);
+        return true;
+    }
+
+    if (magic == HUFFMAN_DICTIONARY_FILE_MAGIC) {
+        // the tree is in the dictionary, the file only counts its symbols
+        huffman_dictionary_file_header header;
+        if (fread(&header, sizeof(huffman_dictionary_file_header), 1, input) != 1) {
+            printf("Error: '%s' is not a compressed file\n", input_file);
+            fclose(input);
+            return false;
+        }
+        fprintf(output, "'%s': compressed with dictionary %08x, use --info on the dictionary for its table\n",
+                input_file, header.dictionary_id);
+        fprintf(output, "symbols: %llu\n", (unsigned long long)header.word_count);
+        fprintf(output, "compressed size: %lld bytes (%.3f bits per symbol)\n", (long long)file_size,
+                header.word_count > 0 ? (file_size - sizeof(header)) * 8.0 / header.word_count : 0.0);
+        fclose(input);
+        return true;
+    }
+
+    huffman_header header;
+    if (fread(&header, sizeof(huffman_header), 1, input) != 1) {
+        printf("Error: '%s' is not a compressed file\n", input_file);
+        fclose(input);
+        return false;
+    }
+    header.word_count = _huffman_header_word_count(&header, file_size);
+    fprintf(output, "'%s': file without blocks\n", input_file);
+    if (header.word_count == 0) {
+        fprintf(output, "original size: 0 bytes\n");
+        fclose(input);
+        return true;
+    }
+
+    // the word list and the tree are the whole header, the data is never read
+    huffman_decoder *decoder = huffman_read_decoder(input, header.word_list_offset, header.huffman_table_offset,
+                                                    header.compressed_offset);
+    fclose(input);
+    if (decoder == NULL) {
+        printf("Error: '%s' has a corrupted huffman table\n", input_file);
+        return false;
+    }
+    fprintf(output, "compressed size: %lld bytes (header %lld bytes)\n", (long long)file_size,
+            (long long)header.compressed_offset);
+    info_print_tree(decoder, header.word_count, file_size - header.compressed_offset, top_count, output);
+    huffman_delete_decoder(decoder);
+    return true;
+}
+
+void info_print_tree(const huffman_decoder *decoder, uint64_t word_count, int64_t data_size, unsigned int top_count,
+                     FILE *output) {
+    const huffman_symbol_table *symbols = decoder->symbols;
+    const huffman_flat_node *nodes = decoder->nodes;
+
+    // children come after their parent in breadth first order, a lone leaf is coded as a single bit
+    unsigned int *depths = memory_alloc(MEMORY_TAG_OTHER, decoder->node_count * sizeof(unsigned int));
+    info_leaf *leaves = memory_alloc(MEMORY_TAG_OTHER, decoder->node_count * sizeof(info_leaf));
+    unsigned int leaf_count = 0;
+    depths[0] = 0;
+    for (unsigned int i = 0; i < decoder->node_count; i++) {
+        if (nodes[i].left != HUFFMAN_NO_CHILD) {
+            depths[nodes[i].left] = depths[i] + 1;
+        }
+        if (nodes[i].right != HUFFMAN_NO_CHILD) {
+            depths[nodes[i].right] = depths[i] + 1;
+        }
+        if (nodes[i].left == HUFFMAN_NO_CHILD && nodes[i].right == HUFFMAN_NO_CHILD) {
+            leaves[leaf_count].symbol = nodes[i].symbol;
+            leaves[leaf_count].freq = decoder->freqs[i];
+            leaves[leaf_count].depth = depths[i] > 0 ? depths[i] : 1;
+            leaf_count++;
+        }
+    }
+
+    // the stored frequencies give the sizes, unless one saturated
+    uint64_t total = 0, original_size = 0, coded_bits = 0;
+    uint64_t histogram[INFO_MAX_CODE_LENGTH + 1] = {0};
+    unsigned int histogram_symbols[INFO_MAX_CODE_LENGTH + 1] = {0};
+    unsigned int max_depth = 0;
+    bool saturated = false, escape = false;
+    for (unsigned int i = 0; i < leaf_count; i++) {
+        uint64_t freq = leaves[i].freq;
+        unsigned int length = symbols->lengths[leaves[i].symbol];
+        total += freq;
+        original_size += freq * (length > 0 ? length : 1);
+        coded_bits += freq * (leaves[i].depth + (length > 0 ? 0 : HUFFMAN_ESCAPE_BITS));
+        unsigned int slot = leaves[i].depth < INFO_MAX_CODE_LENGTH ? leaves[i].depth : INFO_MAX_CODE_LENGTH;
+        histogram[slot] += freq;
+        histogram_symbols[slot]++;
+        max_depth = leaves[i].depth > max_depth ? leaves[i].depth : max_depth;
+        saturated |= leaves[i].freq == INT_MAX;
+        escape |= length == 0;
+    }
+    double entropy = 0;
+    for (unsigned int i = 0; i < leaf_count; i++) {
+        if (leaves[i].freq > 0) {
+            double p = (double)leaves[i].freq / total;
+            entropy -= p * log2(p);
+        }
+    }
+
+    if (word_count > 0) {
+        fprintf(output, "original size: %llu bytes%s\n", (unsigned long long)original_size,
+                saturated || total != word_count ? " (estimated, the stored frequencies saturated)" : "");
+        fprintf(output, "symbols: %llu\n", (unsigned long long)word_count);
+    } else {
+        fprintf(output, "sample size: %llu bytes\n", (unsigned long long)original_size);
+        fprintf(output, "symbols: %llu\n", (unsigned long long)total);
+    }
+    fprintf(output, "vocabulary: %u symbols%s, codes of 1 to %u bits\n", leaf_count,
+            escape ? " (one of them the escape code)" : "", max_depth > 0 ? max_depth : 1);
+    fprintf(output, "entropy: %.3f bits per symbol\n", entropy);
+    fprintf(output, "coded: %.3f bits per symbol", total > 0 ? (double)coded_bits / total : 0.0);
+    if (data_size > 0 && word_count > 0) {
+        fprintf(output, ", %.3f with the padding of the data", data_size * 8.0 / word_count);
+    }
+    fprintf(output, "\n");
+
+    fprintf(output, "code lengths:\n");
+    for (unsigned int length = 1; length <= INFO_MAX_CODE_LENGTH; length++) {
+        if (histogram_symbols[length] > 0) {
+            fprintf(output, "  %2u%s bits: %8u symbols, %6.2f%% of the text\n", length,
+                    length == INFO_MAX_CODE_LENGTH ? "+" : " ", histogram_symbols[length],
+                    total > 0 ? histogram[length] * 100.0 / total : 0.0);
+        }
+    }
+
+    // the most frequent symbols first, shorter codes first among equals
+    if (top_count > leaf_count) {
+        top_count = leaf_count;
+    }
+    if (top_count > 0) {
+        qsort(leaves, leaf_count, sizeof(info_leaf), _info_leaf_compare);
+        fprintf(output, "top %u:\n", top_count);
+    }
+    for (unsigned int i = 0; i < top_count; i++) {
+        fprintf(output, "  %4u. ", i + 1);
+        _info_print_symbol(symbols->pool + symbols->offsets[leaves[i].symbol], symbols->lengths[leaves[i].symbol],
+                           output);
+        fprintf(output, " %u (%.2f%%), %u bits\n", leaves[i].freq, total > 0 ? leaves[i].freq * 100.0 / total : 0.0,
+                leaves[i].depth);
+    }
+
+    memory_free(leaves);
+    memory_free(depths);
+}
+
+void _info_print_symbol(const char *text, unsigned int length, FILE *output) {
+    if (length == 0) {
+        fprintf(output, "(escape)");
+        return;
+    }
+    fputc('"', output);
+    for (unsigned int i = 0; i < length; i++) {
+        unsigned char c = text[i];
+        if (c == '\n') {
+            fprintf(output, "\\n");
+        } else if (c == '\t') {
+            fprintf(output, "\\t");
+        } else if (c == '"' || c == '\\') {
+            fprintf(output, "\\%c", c);
+        } else if (c < 0x20 || c == 0x7F) {
+            fprintf(output, "\\x%02x", c);
+        } else {
+            fputc(c, output);
+        }
+    }
+    fputc('"', output);
+}
+
+int _info_leaf_compare(const void *leaf1, const void *leaf2) {
+    const info_leaf *a = leaf1;
+    const info_leaf *b = leaf2;
+    if (a->freq != b->freq) {
+        return a->freq < b->freq ? 1 : -1;
+    }
+    return (a->depth > b->depth) - (a->depth < b->depth);
+}
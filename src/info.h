@@ -0,0 +1,62 @@
+#ifndef INFO_H
+#define INFO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "huffman.h"
+
+#define INFO_DEFAULT_TOP 10             // Most frequent symbols listed unless --top says otherwise
+#define INFO_MAX_CODE_LENGTH 64         // Longest code length given its own line in the histogram, longer ones share it
+
+/**
+ * Structure to represent a leaf of a tree, for the statistics
+ */
+typedef struct info_leaf {
+    unsigned int symbol;                // Index of the word in the symbol table
+    unsigned int freq;                  // Frequency as stored
+    unsigned int depth;                 // Length of the code
+} info_leaf;
+
+/**
+ * Prints statistics of a compressed file read from its header alone, never from its data.
+ * Files without blocks and dictionaries keep the frequency of every symbol in their tree, which gives the
+ * original size, the symbol and vocabulary counts, a histogram of the code lengths, the entropy against the
+ * bits spent per symbol and the most frequent symbols. Files compressed with a dictionary only know their
+ * symbol count, block files only their index.
+ * @param input_file The compressed file, or a dictionary.
+ * @param top_count The number of most frequent symbols to list.
+ * @param output Where the statistics go.
+ * @return true if successful, false if the file is missing or is not a compressed file.
+ */
+bool info_print_file(char *input_file, unsigned int top_count, FILE *output);
+
+/**
+ * Prints the statistics of a tree.
+ * @param decoder The tree.
+ * @param word_count The number of symbols coded with it, 0 to count them from the tree.
+ * @param data_size The size of the coded data in bytes, 0 if unknown.
+ * @param top_count The number of most frequent symbols to list.
+ * @param output Where the statistics go.
+ */
+void info_print_tree(const huffman_decoder *decoder, uint64_t word_count, int64_t data_size, unsigned int top_count,
+                     FILE *output);
+
+/**
+ * Prints a symbol between quotes, with control characters escaped.
+ * @param text The symbol.
+ * @param length The length of the symbol.
+ * @param output Where it goes.
+ */
+void _info_print_symbol(const char *text, unsigned int length, FILE *output);
+
+/**
+ * Compares two leaves by decreasing frequency, then by code length.
+ * @param leaf1 The first leaf.
+ * @param leaf2 The second leaf.
+ * @return The order of the leaves.
+ */
+int _info_leaf_compare(const void *leaf1, const void *leaf2);
+
+#endif // INFO_H
@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+#include "memory.h"
+
+lz_matcher *lz_matcher_create(const lz_options *options) {
+    lz_matcher *matcher = memory_alloc(MEMORY_TAG_BLOCK, sizeof(lz_matcher));
+
+    // the window is rounded up to a power of two so positions wrap with a mask
+    unsigned int window = options->window > 0 ? options->window : LZ_DEFAULT_WINDOW;
+    if (window > LZ_MAX_WINDOW) {
+        window = LZ_MAX_WINDOW;
+    }
+    matcher->window = 1;
+    while (matcher->window < window) {
+        matcher->window <<= 1;
+    }
+
+    matcher->head = memory_alloc(MEMORY_TAG_BLOCK, (1 << LZ_HASH_BITS) * sizeof(int));
+    matcher->prev = memory_alloc(MEMORY_TAG_BLOCK, matcher->window * sizeof(int));
+    matcher->max_chain = options->level == LZ_LEVEL_THOROUGH ? LZ_THOROUGH_CHAIN : LZ_FAST_CHAIN;
+    matcher->lazy = options->level == LZ_LEVEL_THOROUGH;
+    return matcher;
+}
+
+void lz_matcher_destroy(lz_matcher *matcher) {
+    if (matcher == NULL) {
+        return;
+    }
+    memory_free(matcher->head);
+    memory_free(matcher->prev);
+    memory_free(matcher);
+}
+
+static inline unsigned int _lz_hash(const unsigned char *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(uint32_t));
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+void _lz_insert(lz_matcher *matcher, const unsigned char *data, size_t position) {
+    unsigned int hash = _lz_hash(data + position);
+    matcher->prev[position & (matcher->window - 1)] = matcher->head[hash];
+    matcher->head[hash] = position;
+}
+
+unsigned int _lz_find(lz_matcher *matcher, const unsigned char *data, size_t length, size_t position,
+                      unsigned int *distance) {
+    size_t limit = length - position < LZ_MAX_MATCH ? length - position : LZ_MAX_MATCH;
+    unsigned int best = 0;
+    int candidate = matcher->head[_lz_hash(data + position)];
+
+    for (int chain = matcher->max_chain; candidate >= 0 && chain > 0; chain--) {
+        // chains go back in time, anything else is a slot reused by a newer position
+        if ((size_t)candidate >= position || position - candidate > matcher->window) {
+            break;
+        }
+
+        // the byte that would make the match longer than the best one is checked first
+        const unsigned char *a = data + candidate;
+        const unsigned char *b = data + position;
+        if (a[best] == b[best]) {
+            unsigned int match = 0;
+            while (match < limit && a[match] == b[match]) {
+                match++;
+            }
+            if (match > best) {
+                best = match;
+                *distance = position - candidate;
+                if (match == limit) {
+                    break;
+                }
+            }
+        }
+
+        candidate = matcher->prev[candidate & (matcher->window - 1)];
+    }
+
+    return best;
+}
+
+size_t lz_parse(lz_matcher *matcher, const unsigned char *data, size_t length, lz_token *tokens) {
+    // every call starts with empty chains, so matches stay inside the data
+    for (int i = 0; i < 1 << LZ_HASH_BITS; i++) {
+        matcher->head[i] = -1;
+    }
+
+    size_t count = 0;
+    size_t position = 0;
+    while (position < length) {
+        if (position + LZ_MIN_MATCH > length) {
+            tokens[count].length = 0;
+            tokens[count++].value = data[position++];
+            continue;
+        }
+
+        unsigned int distance = 0;
+        unsigned int match = _lz_find(matcher, data, length, position, &distance);
+        _lz_insert(matcher, data, position);
+        size_t inserted = position + 1;
+
+        // a longer match one byte later is worth a literal
+        if (matcher->lazy && match >= LZ_MIN_MATCH && position + 1 + LZ_MIN_MATCH <= length) {
+            unsigned int next_distance = 0;
+            unsigned int next = _lz_find(matcher, data, length, position + 1, &next_distance);
+            _lz_insert(matcher, data, position + 1);
+            inserted = position + 2;
+            if (next > match) {
+                tokens[count].length = 0;
+                tokens[count++].value = data[position++];
+                match = next;
+                distance = next_distance;
+            }
+        }
+
+        if (match >= LZ_MIN_MATCH) {
+            tokens[count].length = match;
+            tokens[count++].value = distance;
+            for (size_t i = inserted; i < position + match && i + LZ_MIN_MATCH <= length; i++) {
+                _lz_insert(matcher, data, i);
+            }
+            position += match;
+        } else {
+            tokens[count].length = 0;
+            tokens[count++].value = data[position++];
+        }
+    }
+
+    return count;
+}
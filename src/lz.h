@@ -0,0 +1,134 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define LZ_MIN_MATCH 4                          // Shortest match worth a length and a distance
+#define LZ_MAX_MATCH (1 << 16)                  // Longest match
+#define LZ_HASH_BITS 16                         // Bits of the hash of the next LZ_MIN_MATCH bytes
+#define LZ_DEFAULT_WINDOW (1 << 18)             // How far back matches are looked for
+#define LZ_MAX_WINDOW (1 << 20)                 // Largest window, a block never reaches further
+
+#define LZ_LEVEL_FAST 1                         // Short hash chains, greedy parsing
+#define LZ_LEVEL_THOROUGH 2                     // Long hash chains, one step lazy parsing
+#define LZ_FAST_CHAIN 8                         // Candidates tried per position when fast
+#define LZ_THOROUGH_CHAIN 256                   // Candidates tried per position when thorough
+
+#define LZ_BUCKET_DIRECT 16                     // Values below get a code of their own, the rest share log2 buckets
+#define LZ_LENGTH_CODES 40                      // Codes of the match lengths, up to LZ_MAX_MATCH
+#define LZ_DISTANCE_CODES 48                    // Codes of the distances, up to LZ_MAX_WINDOW
+#define LZ_LITERAL_LENGTH_SYMBOLS (256 + LZ_LENGTH_CODES)  // Literals then length codes, in one alphabet
+
+/**
+ * Structure to represent the options of the match finder
+ */
+typedef struct lz_options {
+    int level;                  // LZ_LEVEL_FAST or LZ_LEVEL_THOROUGH, 0 to leave the stage out
+    unsigned int window;        // How far back matches are looked for, in bytes
+} lz_options;
+
+/**
+ * Structure to represent a literal or a match
+ */
+typedef struct lz_token {
+    unsigned int length;        // Length of the match, 0 for a literal
+    unsigned int value;         // Distance of the match, or the literal byte
+} lz_token;
+
+/**
+ * Structure to represent a hash chain match finder
+ */
+typedef struct lz_matcher {
+    int *head;                  // Last position of each hash, -1 if none
+    int *prev;                  // Previous position with the same hash, indexed by position & (window - 1)
+    unsigned int window;        // Window size, a power of two
+    int max_chain;              // Candidates tried per position
+    bool lazy;                  // Try the next position before taking a match
+} lz_matcher;
+
+/**
+ * Creates a new match finder.
+ * @param options The options.
+ * @return The new match finder.
+ */
+lz_matcher *lz_matcher_create(const lz_options *options);
+
+/**
+ * Destroys the match finder.
+ * @param matcher The match finder to destroy.
+ */
+void lz_matcher_destroy(lz_matcher *matcher);
+
+/**
+ * Cuts data into literals and matches, matches never reach before the start of the data.
+ * @param matcher The match finder.
+ * @param data The data.
+ * @param length The length of the data.
+ * @param tokens The tokens, room for length of them.
+ * @return The number of tokens.
+ */
+size_t lz_parse(lz_matcher *matcher, const unsigned char *data, size_t length, lz_token *tokens);
+
+/**
+ * Finds the longest match for a position.
+ * @param matcher The match finder.
+ * @param data The data.
+ * @param length The length of the data.
+ * @param position The position.
+ * @param distance The distance of the match, written.
+ * @return The length of the match, below LZ_MIN_MATCH if there is none.
+ */
+unsigned int _lz_find(lz_matcher *matcher, const unsigned char *data, size_t length, size_t position,
+                      unsigned int *distance);
+
+/**
+ * Adds a position to the hash chains.
+ * @param matcher The match finder.
+ * @param data The data.
+ * @param position The position, with LZ_MIN_MATCH bytes after it.
+ */
+void _lz_insert(lz_matcher *matcher, const unsigned char *data, size_t position);
+
+/**
+ * Splits a value into its code and extra bits.
+ * @param value The value.
+ * @param code The code, written.
+ * @param extra_bits The number of extra bits, written.
+ * @return The extra bits.
+ */
+static inline unsigned int lz_bucket(unsigned int value, unsigned int *code, int *extra_bits) {
+    if (value < LZ_BUCKET_DIRECT) {
+        *code = value;
+        *extra_bits = 0;
+        return 0;
+    }
+
+    // two codes per power of two, told apart by the bit after the highest
+    int high = 4;
+    while ((value >> (high + 1)) > 0) {
+        high++;
+    }
+    *code = LZ_BUCKET_DIRECT + (high - 4) * 2 + ((value >> (high - 1)) & 1);
+    *extra_bits = high - 1;
+    return value & ((1u << (high - 1)) - 1);
+}
+
+/**
+ * Returns the smallest value of a code and its number of extra bits.
+ * @param code The code.
+ * @param extra_bits The number of extra bits, written.
+ * @return The smallest value.
+ */
+static inline unsigned int lz_bucket_base(unsigned int code, int *extra_bits) {
+    if (code < LZ_BUCKET_DIRECT) {
+        *extra_bits = 0;
+        return code;
+    }
+
+    int high = (code - LZ_BUCKET_DIRECT) / 2 + 4;
+    *extra_bits = high - 1;
+    return (1u << high) | (((code - LZ_BUCKET_DIRECT) & 1) << (high - 1));
+}
+
+#endif // LZ_H
@@ -3,36 +3,128 @@
 #include <stdlib.h>
 
 #include "huffman.h"
+#include "batch.h"
+#include "block.h"
+#include "counts.h"
+#include "grep.h"
+#include "info.h"
+#include "memory.h"
 
 #define INVALID_ARGUMENTS -1
 #define INVALID_OPTION -2
 #define INVALID_TYPE -3
+#define VERIFY_FAILED -4
+#define DECODE_FAILED -5
+#define ENCODE_FAILED -6
+#define NO_MATCH 1
 
 #define OPTION_DECOMPRESS 0
 #define OPTION_COMPRESS 1
-#define TYPE_CHAR 0
-#define TYPE_WORD 1
-#define TYPE_TOKEN 2
+#define OPTION_TRAIN 2
+#define OPTION_VERIFY 3
+#define OPTION_COUNT 4
+#define OPTION_MERGE_COUNTS 5
+#define OPTION_GREP 6
+#define OPTION_INFO 7
 
 /*
-    usage: ./huffmaning [-D or --decompress | -C or --compress] [-t or --type] <input file> <output file>
+    usage: ./huffmaning [-D or --decompress | -C or --compress | --train] [-t or --type] [--dict <file>] [--streams <n>] [--coder <coder>] [--lz <level>] [--window <bytes>] [--checksum] [--block-size <bytes>] [--append] [--max-vocab <n>] [--sample <rate>] [--counts <file>] [--mem-limit <bytes>] [--mem-report] <input file> <output file>
+           ./huffmaning [-D or --decompress | -C or --compress] [-t or --type] [-j <threads>] --batch <input files or @list files>
+           ./huffmaning --verify [-j <threads>] <input file>
+           ./huffmaning --count-only [-t or --type] [-j <threads>] [--sample <rate>] <input file> <counts file>
+           ./huffmaning --merge-counts <counts files> <merged counts file>
+           ./huffmaning --grep <word> [--dict <file>] <input file>
+           ./huffmaning --info [--top <n>] <input file>
     -D or --decompress: decompress the input file
     -C or --compress: compress the input file
+    --train: train a dictionary from the input file (a sample corpus) and write it to the output file
+    --dict <file>: compress or decompress using a trained dictionary instead of a per-file table
     -t or --type: type compression or decompression
         -t 0: compress or decompress using the huffman algorithm per character
         -t 1: compress or decompress using the huffman algorithm per word
         -t 2: compress or decompress using the huffman algorithm per token
+        -t 3: compress per character with a huffman table per preceding character (grouped when
+              contexts look alike), in the block format
+        -t auto: compress per word or per character in the block format, whichever the symbol counts estimate
+                 smaller (words are counted on pieces of large files); blocks that do not shrink are stored
     <input file>: file to be compressed or decompressed
     <output file>: file to be written the result
+    --batch: compress or decompress every input file in one process, writing <input file>.huffed
+             (or removing .huffed when decompressing); @<list file> reads the input files from a file, one per line
+    -j or --threads <threads>: number of worker threads in batch mode, for counting words with -t 1, for
+                               writing the codes with -t 0 and for decoding, one per core by default (older files
+                               without blocks are decoded on one thread unless -j is given, then from guessed code
+                               boundaries joined where the codes resynchronize)
+    --streams <n>: compress into blocks with their own canonical code, each split into n interleaved
+                   bitstreams (1 to 8) that are decoded side by side; only -t 0 and -t 3, decompression
+                   detects it
+    --coder <coder>: entropy coder of the blocks, huffman (default) or ans for tabled asymmetric numeral
+                     systems, which get closer to the entropy on skewed data; implies --streams 4
+    --lz <level>: replace repeated strings with matches before the huffman coding, fast (short hash
+                  chains) or thorough (long hash chains and lazy matching); only -t 0, in the block format
+    --window <bytes>: how far back --lz looks for matches, up to 1 MiB (256 KiB by default)
+    --checksum: store a CRC32C of every block, checked when decompressing; only -t 0 and -t 3, in the
+                block format
+    --block-size <bytes>: input bytes per block, from 4 KiB to 64 MiB (1 MiB by default); smaller blocks follow
+                          data that changes along the file more closely, with -t 0 a block keeps the table of the
+                          one before unless a table of its own pays for itself; implies the block format
+    --append: add the input file as new blocks at the end of the output file, a block file, instead of replacing
+              it; the blocks already there are not read again, the new ones keep the type, streams, coder, block size
+              and checksums of the file and go on with its last table when it still fits (-t 0); a missing output
+              file is created with the other options
+    --max-vocab <n>: with -t 1, keep the n words of several characters that save the most (frequency times
+                     length), the others are spelled with single characters so the table stays small
+    --verify: decode every block of a block file on -j threads without writing it, checking the checksums
+              if the file has them
+    --count-only: count the symbols of the input file (-t 0 or -t 1) into a counts file, without compressing it
+    --sample <rate>: with -t 0, -t auto and --count-only -t 0, count the characters on evenly spaced chunks
+                     making up this share of the input (0.5 reads half of it) instead of reading it all before
+                     encoding; characters the sample missed still get a code
+    --merge-counts: add up the counts files of the shards of a corpus into one
+    --grep <word>: print the lines of a compressed file without blocks (-t 0 or -t 1, or compressed with --dict)
+                   where the word appears whole, each after the offset of the line in the original file and a
+                   colon; the codes are decoded to symbols and only the matching lines are turned back into text,
+                   a word the table of the file cannot spell is not searched for at all. Exits with 1 if no line
+                   matches
+    --info: print statistics of a compressed file or a dictionary from its header, without reading the data: the
+            original size, the symbol and vocabulary counts, the code lengths, the entropy against the bits spent
+            per symbol and the most frequent symbols (files with blocks only report their index)
+    --top <n>: number of most frequent symbols --info lists (10 by default), implies --info
+    --counts <file>: compress with the table of a counts file, usually merged from all the shards, so the
+                     shards share one codebook; every symbol of the input file must be counted in it. With --train,
+                     write a dictionary from the counts instead (./huffmaning --train --counts <file> <dictionary>),
+                     so the shared table is stored once rather than in the header of every shard
+    --mem-limit <bytes>: keep -t 1 compression under about this much memory: past a quarter of it the word ids
+                         are spilled to temporary files, past half of it the words not seen yet are spelled with
+                         single characters instead of growing the vocabulary; the read and encoding buffers do
+                         not shrink, so the limit must be at least twice their size (about 16 MB with -j 1)
+    --mem-report: print the current and peak memory of every subsystem (trie, vocabulary, symbol streams...) on exit
 */
 int main(int argc, char *argv[]) {
     int option = -1;
     int type = -1;
-    char *input_file;
-    char *output_file;
+    char *input_file = NULL;
+    char *output_file = NULL;
+    char *dictionary_file = NULL;
+    char *counts_file = NULL;
+    char *grep_word = NULL;
+    long top_count = INFO_DEFAULT_TOP;
+    bool batch_mode = false;
+    int thread_count = 0;
+    int streams = 0;
+    int coder = -1;
+    lz_options lz = { .level = 0, .window = LZ_DEFAULT_WINDOW };
+    bool checksums = false;
+    bool append = false;
+    long max_vocab = 0;
+    unsigned long long mem_limit = 0;
+    long block_size = 0;
+    double sample_rate = 1;
+    char **arguments = memory_alloc(MEMORY_TAG_OTHER, argc * sizeof(char *));
+    int argument_count = 0;
 
-    if (argc < 4) {
-        printf("Usage: ./huffmaning [-D or --decompress | -C or --compress] [-t or --type] <input_file> <output_file>\n");
+    if (argc < 3) {
+        printf("Usage: ./huffmaning [-D or --decompress | -C or --compress | --train] [-t or --type] [--dict <file>] <input_file> <output_file>\n");
         return 0;
     }
 
@@ -42,21 +134,244 @@ int main(int argc, char *argv[]) {
             option = OPTION_DECOMPRESS;
         } else if (strcmp(argv[i], "-C") == 0 || strcmp(argv[i], "--compress") == 0) {
             option = OPTION_COMPRESS;
+        } else if (strcmp(argv[i], "--train") == 0) {
+            option = OPTION_TRAIN;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            option = OPTION_VERIFY;
+        } else if (strcmp(argv[i], "--count-only") == 0) {
+            option = OPTION_COUNT;
+        } else if (strcmp(argv[i], "--merge-counts") == 0) {
+            option = OPTION_MERGE_COUNTS;
+        } else if (strcmp(argv[i], "--grep") == 0) {
+            option = OPTION_GREP;
+            i++;
+            if (i < argc) {
+                grep_word = argv[i];
+            } else {
+                printf("Error: missing argument for --grep option\n");
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--info") == 0) {
+            option = OPTION_INFO;
+        } else if (strcmp(argv[i], "--top") == 0) {
+            option = OPTION_INFO;
+            i++;
+            if (i < argc && atol(argv[i]) >= 0 && strspn(argv[i], "0123456789") == strlen(argv[i])) {
+                top_count = atol(argv[i]);
+            } else {
+                printf("Error: --top must be a number of symbols\n");
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--checksum") == 0) {
+            checksums = true;
+        } else if (strcmp(argv[i], "--append") == 0) {
+            append = true;
+        } else if (strcmp(argv[i], "--dict") == 0) {
+            i++;
+            if (i < argc) {
+                dictionary_file = argv[i];
+            } else {
+                printf("Error: missing argument for --dict option\n");
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--counts") == 0) {
+            i++;
+            if (i < argc) {
+                counts_file = argv[i];
+            } else {
+                printf("Error: missing argument for --counts option\n");
+                return INVALID_ARGUMENTS;
+            }
         } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--type") == 0) {
             i++;
             if (i < argc) {
-                type = atoi(argv[i]);
+                type = strcmp(argv[i], "auto") == 0 ? TYPE_AUTO : atoi(argv[i]);
             } else if (option == OPTION_DECOMPRESS){
                 printf("Error: missing argument for -t or --type option\n");
                 return -1;
             }
-        } else if (i == argc - 2) {
-            input_file = argv[i];
-        } else if (i == argc - 1) {
-            output_file = argv[i];
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch_mode = true;
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0) {
+            i++;
+            if (i < argc) {
+                thread_count = atoi(argv[i]);
+            } else {
+                printf("Error: missing argument for -j or --threads option\n");
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--streams") == 0) {
+            i++;
+            if (i < argc) {
+                streams = atoi(argv[i]);
+            } else {
+                printf("Error: missing argument for --streams option\n");
+                return INVALID_ARGUMENTS;
+            }
+            if (streams < 1 || streams > BLOCK_MAX_STREAMS) {
+                printf("Error: --streams must be between 1 and %d\n", BLOCK_MAX_STREAMS);
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--coder") == 0) {
+            i++;
+            if (i < argc && strcmp(argv[i], "huffman") == 0) {
+                coder = BLOCK_CODER_HUFFMAN;
+            } else if (i < argc && strcmp(argv[i], "ans") == 0) {
+                coder = BLOCK_CODER_ANS;
+            } else {
+                printf("Error: --coder must be huffman or ans\n");
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--lz") == 0) {
+            i++;
+            if (i < argc && strcmp(argv[i], "fast") == 0) {
+                lz.level = LZ_LEVEL_FAST;
+            } else if (i < argc && strcmp(argv[i], "thorough") == 0) {
+                lz.level = LZ_LEVEL_THOROUGH;
+            } else {
+                printf("Error: --lz must be fast or thorough\n");
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--max-vocab") == 0) {
+            i++;
+            if (i < argc && atol(argv[i]) > 0) {
+                max_vocab = atol(argv[i]);
+            } else {
+                printf("Error: --max-vocab must be a positive number of words\n");
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--mem-limit") == 0) {
+            i++;
+            if (i < argc && strtoull(argv[i], NULL, 10) > 0 && strspn(argv[i], "0123456789") == strlen(argv[i])) {
+                mem_limit = strtoull(argv[i], NULL, 10);
+            } else {
+                printf("Error: --mem-limit must be a positive number of bytes\n");
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--mem-report") == 0) {
+            memory_report_at_exit();
+        } else if (strcmp(argv[i], "--block-size") == 0) {
+            i++;
+            if (i < argc && atol(argv[i]) >= BLOCK_MIN_SIZE && atol(argv[i]) <= BLOCK_MAX_SIZE) {
+                block_size = atol(argv[i]);
+            } else {
+                printf("Error: --block-size must be between %d and %d\n", BLOCK_MIN_SIZE, BLOCK_MAX_SIZE);
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--sample") == 0) {
+            i++;
+            if (i < argc && atof(argv[i]) > 0 && atof(argv[i]) <= 1) {
+                sample_rate = atof(argv[i]);
+            } else {
+                printf("Error: --sample must be a share of the input between 0 and 1\n");
+                return INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--window") == 0) {
+            i++;
+            if (i < argc && atoi(argv[i]) > 0 && atoi(argv[i]) <= LZ_MAX_WINDOW) {
+                lz.window = atoi(argv[i]);
+            } else {
+                printf("Error: --window must be between 1 and %d\n", LZ_MAX_WINDOW);
+                return INVALID_ARGUMENTS;
+            }
+        } else {
+            arguments[argument_count++] = argv[i];
+        }
+    }
+
+    // the buffers of the word coder do not shrink with the limit, a limit they do not fit in cannot be kept
+    if (mem_limit > 0) {
+        uint64_t min_limit = huffman_word_min_memory_limit(thread_count);
+        if (mem_limit < min_limit) {
+            printf("Error: --mem-limit must be at least %llu bytes, the buffers of -t 1 take half of that\n",
+                   (unsigned long long)min_limit);
+            return INVALID_ARGUMENTS;
+        }
+        memory_set_limit(mem_limit);
+    }
+
+    if (batch_mode) {
+        if (option != OPTION_COMPRESS && option != OPTION_DECOMPRESS) {
+            printf("Error: --batch needs -C or -D\n");
+            return INVALID_OPTION;
         }
+        if (option == OPTION_COMPRESS && type != TYPE_CHAR && type != TYPE_WORD) {
+            printf("Error: invalid type\n");
+            return INVALID_TYPE;
+        }
+
+        dynamic_array *input_files = batch_expand_arguments(arguments, argument_count);
+        batch_run(input_files, option == OPTION_COMPRESS, type, thread_count);
+        dynamic_array_destroy(input_files, memory_free);
+        memory_free(arguments);
+        return 0;
+    }
+
+    if (option == OPTION_VERIFY) {
+        if (argument_count != 1) {
+            printf("Error: --verify needs a single input file\n");
+            memory_free(arguments);
+            return INVALID_ARGUMENTS;
+        }
+        bool valid = block_verify_file(arguments[0], thread_count);
+        printf("'%s' %s\n", arguments[0], valid ? "is valid" : "is corrupted");
+        memory_free(arguments);
+        return valid ? 0 : VERIFY_FAILED;
+    }
+
+    if (option == OPTION_GREP) {
+        if (argument_count != 1) {
+            printf("Error: --grep needs a word and a single input file\n");
+            memory_free(arguments);
+            return INVALID_ARGUMENTS;
+        }
+        int64_t match_count = grep_file(arguments[0], dictionary_file, grep_word, stdout);
+        memory_free(arguments);
+        return match_count > 0 ? 0 : match_count == 0 ? NO_MATCH : INVALID_ARGUMENTS;
+    }
+
+    if (option == OPTION_INFO) {
+        if (argument_count != 1) {
+            printf("Error: --info needs a single input file\n");
+            memory_free(arguments);
+            return INVALID_ARGUMENTS;
+        }
+        bool printed = info_print_file(arguments[0], top_count, stdout);
+        memory_free(arguments);
+        return printed ? 0 : INVALID_ARGUMENTS;
+    }
+
+    if (option == OPTION_MERGE_COUNTS) {
+        // every argument but the last is a counts file to add up
+        if (argument_count < 2) {
+            printf("Error: --merge-counts needs counts files and an output file\n");
+            memory_free(arguments);
+            return INVALID_ARGUMENTS;
+        }
+        bool merged = counts_merge_files(arguments, argument_count - 1, arguments[argument_count - 1]);
+        memory_free(arguments);
+        return merged ? 0 : INVALID_ARGUMENTS;
     }
 
+    if (option == OPTION_TRAIN && counts_file != NULL) {
+        // the counts replace the sample corpus, the only argument is the dictionary
+        if (argument_count != 1) {
+            printf("Error: --train --counts needs a single dictionary file\n");
+            memory_free(arguments);
+            return INVALID_ARGUMENTS;
+        }
+        huffman_train_dictionary_from_counts(counts_file, arguments[0]);
+        memory_free(arguments);
+        return 0;
+    }
+
+    // the last two arguments are the input and output files
+    if (argument_count >= 2) {
+        input_file = arguments[argument_count - 2];
+        output_file = arguments[argument_count - 1];
+    }
+    memory_free(arguments);
+
     if (option == -1 || input_file == NULL || output_file == NULL) {
         printf("Error: missing required options or arguments\n");
         return 0;
@@ -64,17 +379,126 @@ int main(int argc, char *argv[]) {
 
     switch (option) {
         case OPTION_DECOMPRESS:
-            huffman_decode_file(input_file, output_file);
+            if (dictionary_file != NULL) {
+                if (!huffman_decode_file_with_dictionary(input_file, output_file, dictionary_file)) {
+                    return DECODE_FAILED;
+                }
+            } else if (!huffman_decode_file(input_file, output_file, thread_count)) {
+                return DECODE_FAILED;
+            }
+            break;
+        case OPTION_COUNT:
+            if (type != TYPE_CHAR && type != TYPE_WORD) {
+                printf("Error: invalid type\n");
+                return INVALID_TYPE;
+            }
+            if (sample_rate < 1 && type != TYPE_CHAR) {
+                printf("Error: --sample only counts characters\n");
+                return INVALID_TYPE;
+            }
+            huffman_count_file(input_file, output_file, type, thread_count, sample_rate);
+            break;
+        case OPTION_TRAIN:
+            if (type != TYPE_CHAR && type != TYPE_WORD) {
+                printf("Error: invalid type\n");
+                return INVALID_TYPE;
+            }
+            huffman_train_dictionary(input_file, output_file, type);
             break;
         case OPTION_COMPRESS:
+            if (max_vocab > 0 && (type != TYPE_WORD || dictionary_file != NULL)) {
+                printf("Error: --max-vocab only supports -t 1\n");
+                return INVALID_TYPE;
+            }
+            if (append && (type == TYPE_AUTO || counts_file != NULL || dictionary_file != NULL || max_vocab > 0 ||
+                           sample_rate < 1)) {
+                printf("Error: --append only supports the block format\n");
+                return INVALID_ARGUMENTS;
+            }
+            if (append && type == -1) {
+                // the type of an existing file is in its header
+                type = TYPE_CHAR;
+            }
+            if (sample_rate < 1 && ((type != TYPE_CHAR && type != TYPE_AUTO) || counts_file != NULL ||
+                                    dictionary_file != NULL || lz.level != 0 || streams > 0 || coder != -1 ||
+                                    checksums || block_size > 0)) {
+                // the other modes read the input once already
+                printf("Error: --sample only supports -t 0 and -t auto\n");
+                return INVALID_TYPE;
+            }
+            if (counts_file != NULL) {
+                if (dictionary_file != NULL || max_vocab > 0 || lz.level != 0 || streams > 0 || coder != -1 ||
+                    checksums || block_size > 0) {
+                    printf("Error: --counts cannot be combined with --dict, --max-vocab or the block options\n");
+                    return INVALID_ARGUMENTS;
+                }
+                // the counts file knows the type of its symbols
+                if (!huffman_encode_file_with_counts(input_file, output_file, counts_file, thread_count)) {
+                    return ENCODE_FAILED;
+                }
+                break;
+            }
+            if (dictionary_file != NULL) {
+                // the dictionary already knows its symbols, no type needed
+                huffman_encode_file_with_dictionary(input_file, output_file, dictionary_file);
+                break;
+            }
+            if (type == TYPE_AUTO) {
+                if (max_vocab > 0 || lz.level != 0 || streams > 0 || coder != -1 || checksums || block_size > 0) {
+                    printf("Error: -t auto picks its own options\n");
+                    return INVALID_ARGUMENTS;
+                }
+                huffman_encode_file_auto(input_file, output_file, thread_count, sample_rate);
+                break;
+            }
+            if (lz.level != 0) {
+                if (type != TYPE_CHAR || coder == BLOCK_CODER_ANS) {
+                    printf("Error: --lz only supports -t 0 with --coder huffman\n");
+                    return INVALID_TYPE;
+                }
+                // matches depend on what came before them, so the block is a single stream
+                block_options options = {
+                    .type = TYPE_LZ, .streams = 1, .coder = BLOCK_CODER_HUFFMAN, .lz = lz, .checksums = checksums,
+                    .block_size = block_size,
+                };
+                bool encoded = append ? block_append_file(input_file, output_file, &options)
+                                      : block_encode_file(input_file, output_file, &options);
+                if (!encoded) {
+                    return ENCODE_FAILED;
+                }
+                break;
+            }
+            if (streams > 0 || coder != -1 || type == TYPE_CONTEXT || checksums || block_size > 0 || append) {
+                if (type != TYPE_CHAR && type != TYPE_CONTEXT) {
+                    printf("Error: --streams, --coder, --checksum and --block-size only support -t 0 and -t 3\n");
+                    return INVALID_TYPE;
+                }
+                if (type == TYPE_CONTEXT && coder == BLOCK_CODER_ANS) {
+                    printf("Error: -t 3 only supports --coder huffman\n");
+                    return INVALID_TYPE;
+                }
+                block_options options = {
+                    .type = type,
+                    .streams = streams > 0 ? streams : BLOCK_DEFAULT_STREAMS,
+                    .coder = coder != -1 ? coder : BLOCK_CODER_HUFFMAN,
+                    .checksums = checksums,
+                    .block_size = block_size,
+                };
+                bool encoded = append ? block_append_file(input_file, output_file, &options)
+                                      : block_encode_file(input_file, output_file, &options);
+                if (!encoded) {
+                    return ENCODE_FAILED;
+                }
+                break;
+            }
             switch (type) {
                 case TYPE_CHAR:
                     // Compress per character
-                    huffman_encode_file_per_char(input_file, output_file);
+                    huffman_encode_file_per_char(input_file, output_file, thread_count, sample_rate);
                     break;
                 case TYPE_WORD:
                     // Compress per word
-                    huffman_encode_file_per_word(input_file, output_file);
+                    huffman_encode_file_per_word(input_file, output_file, thread_count, max_vocab);
                     break;
                 case TYPE_TOKEN:
                     // Compress per token
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+
+#include "mapped_file.h"
+#include "memory.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+mapped_file *mapped_file_create(FILE *file, uint64_t size) {
+    // an empty mapping is not allowed, and the mapping must cover the whole file in the address space
+    if (size == 0 || size > SIZE_MAX || fflush(file) != 0) {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    // the mapping object grows the file to its size
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, NULL);
+    if (mapping == NULL) {
+        return NULL;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)size);
+    if (data == NULL) {
+        CloseHandle(mapping);
+        return NULL;
+    }
+#else
+    int descriptor = fileno(file);
+
+    // reserve the blocks, writing a page of a sparse file on a full disk would kill the process
+    int error = posix_fallocate(descriptor, 0, (off_t)size);
+    if (error == EINVAL || error == EOPNOTSUPP) {
+        error = ftruncate(descriptor, (off_t)size) == 0 ? 0 : errno;
+    }
+    if (error != 0) {
+        return NULL;
+    }
+
+    // the pages are faulted in by one call rather than one by one as they are written
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void *data = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, flags, descriptor, 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+#endif
+
+    mapped_file *mapped = memory_alloc(MEMORY_TAG_PIPELINE, sizeof(mapped_file));
+    mapped->data = data;
+    mapped->size = size;
+#ifdef _WIN32
+    mapped->mapping = mapping;
+#endif
+    return mapped;
+}
+
+bool mapped_file_close(mapped_file *file) {
+    if (file == NULL) {
+        return true;
+    }
+
+#ifdef _WIN32
+    bool success = UnmapViewOfFile(file->data) != 0;
+    CloseHandle(file->mapping);
+#else
+    bool success = munmap(file->data, (size_t)file->size) == 0;
+#endif
+    memory_free(file);
+    return success;
+}
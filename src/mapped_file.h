@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Structure to represent an output file of a known size mapped in memory, written in place
+ */
+typedef struct mapped_file {
+    unsigned char *data;                // The whole file, from offset 0
+    uint64_t size;                      // Size of the file
+#ifdef _WIN32
+    void *mapping;                      // Handle of the file mapping
+#endif
+} mapped_file;
+
+/**
+ * Sizes an open file and maps it for writing.
+ * The disk space is reserved up front, so running out of space is reported here and not when a page
+ * is written. Bytes past the previous end of the file read as zeros.
+ * @param file The file, opened for writing and reading; whatever was written to the stream is flushed.
+ * @param size The size of the file.
+ * @return The mapping, NULL if the file is empty or cannot be mapped, the caller then writes the stream.
+ */
+mapped_file *mapped_file_create(FILE *file, uint64_t size);
+
+/**
+ * Unmaps a file, its contents go to the disk with the rest of the page cache.
+ * @param file The mapping.
+ * @return true if successful, false if the pages could not be written back.
+ */
+bool mapped_file_close(mapped_file *file);
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,134 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+// slot MEMORY_TAG_COUNT holds the total of all the tags
+static _Atomic uint64_t memory_currents[MEMORY_TAG_COUNT + 1];
+static _Atomic uint64_t memory_peaks[MEMORY_TAG_COUNT + 1];
+static _Atomic uint64_t memory_limit;
+
+static const char *memory_tag_names[MEMORY_TAG_COUNT] = {
+    "trie", "trie keys", "bitvector", "dynamic array", "priority queue", "huffman tree", "huffman buffers",
+    "vocabulary", "symbol streams", "blocks", "pipeline", "other",
+};
+
+void *memory_alloc(int tag, size_t size) {
+    if (size > SIZE_MAX - MEMORY_HEADER_SIZE) {
+        return NULL;
+    }
+    unsigned char *block = malloc(size + MEMORY_HEADER_SIZE);
+    if (block == NULL) {
+        return NULL;
+    }
+    // the header holds the size and the tag, the caller gets the bytes after it
+    memcpy(block, &size, sizeof(size_t));
+    memcpy(block + sizeof(size_t), &tag, sizeof(int));
+    _memory_count(tag, (int64_t)size);
+    return block + MEMORY_HEADER_SIZE;
+}
+
+void *memory_calloc(int tag, size_t count, size_t size) {
+    if (size > 0 && count > (SIZE_MAX - MEMORY_HEADER_SIZE) / size) {
+        return NULL;
+    }
+    void *data = memory_alloc(tag, count * size);
+    if (data != NULL) {
+        memset(data, 0, count * size);
+    }
+    return data;
+}
+
+void *memory_realloc(int tag, void *data, size_t size) {
+    if (data == NULL) {
+        return memory_alloc(tag, size);
+    }
+    if (size > SIZE_MAX - MEMORY_HEADER_SIZE) {
+        return NULL;
+    }
+    unsigned char *block = (unsigned char *)data - MEMORY_HEADER_SIZE;
+    size_t old_size;
+    memcpy(&old_size, block, sizeof(size_t));
+    memcpy(&tag, block + sizeof(size_t), sizeof(int));
+
+    block = realloc(block, size + MEMORY_HEADER_SIZE);
+    if (block == NULL) {
+        return NULL;
+    }
+    memcpy(block, &size, sizeof(size_t));
+    _memory_count(tag, (int64_t)size - (int64_t)old_size);
+    return block + MEMORY_HEADER_SIZE;
+}
+
+char *memory_strdup(int tag, const char *text) {
+    size_t length = strlen(text);
+    char *copy = memory_alloc(tag, length + 1);
+    if (copy != NULL) {
+        memcpy(copy, text, length + 1);
+    }
+    return copy;
+}
+
+void memory_free(void *data) {
+    if (data == NULL) {
+        return;
+    }
+    unsigned char *block = (unsigned char *)data - MEMORY_HEADER_SIZE;
+    size_t size;
+    int tag;
+    memcpy(&size, block, sizeof(size_t));
+    memcpy(&tag, block + sizeof(size_t), sizeof(int));
+    _memory_count(tag, -(int64_t)size);
+    free(block);
+}
+
+void memory_set_limit(uint64_t limit) {
+    atomic_store(&memory_limit, limit);
+}
+
+bool memory_exceeds(unsigned int percent) {
+    uint64_t limit = atomic_load_explicit(&memory_limit, memory_order_relaxed);
+    return limit > 0 &&
+           atomic_load_explicit(&memory_currents[MEMORY_TAG_COUNT], memory_order_relaxed) > limit / 100 * percent;
+}
+
+uint64_t memory_current(int tag) {
+    return atomic_load(&memory_currents[tag]);
+}
+
+uint64_t memory_peak(int tag) {
+    return atomic_load(&memory_peaks[tag]);
+}
+
+void memory_print_report(FILE *output) {
+    fprintf(output, "memory: %12s %12s\n", "current", "peak");
+    for (int tag = 0; tag <= MEMORY_TAG_COUNT; tag++) {
+        if (memory_peak(tag) > 0) {
+            fprintf(output, "  %-16s %12llu %12llu\n", tag < MEMORY_TAG_COUNT ? memory_tag_names[tag] : "total",
+                    (unsigned long long)memory_current(tag), (unsigned long long)memory_peak(tag));
+        }
+    }
+}
+
+void memory_report_at_exit() {
+    atexit(_memory_print_report_to_stdout);
+}
+
+void _memory_count(int tag, int64_t delta) {
+    // the total has its own peak, the tags rarely peak at the same time
+    int slots[2] = {tag, MEMORY_TAG_COUNT};
+    for (int i = 0; i < 2; i++) {
+        uint64_t current = atomic_fetch_add_explicit(&memory_currents[slots[i]], (uint64_t)delta,
+                                                     memory_order_relaxed) + (uint64_t)delta;
+        uint64_t peak = atomic_load_explicit(&memory_peaks[slots[i]], memory_order_relaxed);
+        while (delta > 0 && current > peak &&
+               !atomic_compare_exchange_weak_explicit(&memory_peaks[slots[i]], &peak, current, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+        }
+    }
+}
+
+void _memory_print_report_to_stdout() {
+    memory_print_report(stdout);
+}
@@ -0,0 +1,119 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define MEMORY_TAG_TRIE 0               // Trie nodes
+#define MEMORY_TAG_TRIE_KEYS 1          // Keys and prefixes built by trie_keys
+#define MEMORY_TAG_BITVECTOR 2          // Bitvectors, codes and output buffers
+#define MEMORY_TAG_ARRAY 3              // Dynamic arrays
+#define MEMORY_TAG_QUEUE 4              // Priority queues
+#define MEMORY_TAG_TREE 5               // Huffman tree nodes and their words
+#define MEMORY_TAG_HUFFMAN 6            // Other buffers of the huffman coder
+#define MEMORY_TAG_VOCABULARY 7         // Vocabulary words and counts
+#define MEMORY_TAG_SYMBOLS 8            // Symbol streams
+#define MEMORY_TAG_BLOCK 9              // Block format, canonical codes, ANS and LZ77
+#define MEMORY_TAG_PIPELINE 10          // Reader and writer threads, queues and mapped files
+#define MEMORY_TAG_OTHER 11             // Everything else
+#define MEMORY_TAG_COUNT 12
+
+#define MEMORY_HEADER_SIZE 16           // Bytes in front of every allocation, keeping the alignment of malloc
+#define MEMORY_SPILL_SHARE 25           // Percent of the limit past which symbol streams spill to temporary files
+#define MEMORY_VOCABULARY_SHARE 50      // Percent of the limit past which new words are spelled with characters
+
+/**
+ * Allocates memory counted against a tag.
+ * Every allocation carries its size and tag in a header, so it is freed with memory_free alone.
+ * @param tag The subsystem the memory belongs to, MEMORY_TAG_*.
+ * @param size The number of bytes.
+ * @return The memory, NULL if it could not be allocated.
+ */
+void *memory_alloc(int tag, size_t size);
+
+/**
+ * Allocates zeroed memory counted against a tag.
+ * @param tag The subsystem the memory belongs to.
+ * @param count The number of elements.
+ * @param size The size of an element.
+ * @return The memory, NULL if it could not be allocated.
+ */
+void *memory_calloc(int tag, size_t count, size_t size);
+
+/**
+ * Resizes memory, which stays counted against the tag it was allocated with.
+ * @param tag The subsystem of the memory, used when data is NULL.
+ * @param data The memory, NULL to allocate it.
+ * @param size The new number of bytes.
+ * @return The memory, NULL if it could not be resized, data is then left as it was.
+ */
+void *memory_realloc(int tag, void *data, size_t size);
+
+/**
+ * Copies a string into memory counted against a tag.
+ * @param tag The subsystem the copy belongs to.
+ * @param text The string.
+ * @return The copy.
+ */
+char *memory_strdup(int tag, const char *text);
+
+/**
+ * Frees memory allocated by memory_alloc, memory_calloc, memory_realloc or memory_strdup.
+ * @param data The memory, NULL does nothing.
+ */
+void memory_free(void *data);
+
+/**
+ * Sets the memory the process should stay under, the word coder switches to strategies using less memory
+ * (spilling the symbols to temporary files, spelling new words with characters) as it gets close.
+ * @param limit The limit in bytes, 0 for none.
+ */
+void memory_set_limit(uint64_t limit);
+
+/**
+ * Checks whether the memory in use passed a share of the limit.
+ * @param percent The share of the limit.
+ * @return true if a limit is set and the memory in use is past the share.
+ */
+bool memory_exceeds(unsigned int percent);
+
+/**
+ * Returns the memory a tag uses now.
+ * @param tag The tag, MEMORY_TAG_COUNT for all of them.
+ * @return The number of bytes.
+ */
+uint64_t memory_current(int tag);
+
+/**
+ * Returns the most memory a tag used at once.
+ * @param tag The tag, MEMORY_TAG_COUNT for all of them.
+ * @return The number of bytes.
+ */
+uint64_t memory_peak(int tag);
+
+/**
+ * Prints the current and peak memory of every tag that allocated any.
+ * @param output Where the report goes.
+ */
+void memory_print_report(FILE *output);
+
+/**
+ * Prints the report to the standard output when the process exits.
+ */
+void memory_report_at_exit();
+
+/**
+ * Counts bytes against a tag, raising its peak.
+ * @param tag The tag.
+ * @param delta The bytes allocated, negative when freed.
+ */
+void _memory_count(int tag, int64_t delta);
+
+/**
+ * Prints the report to the standard output, for atexit.
+ */
+void _memory_print_report_to_stdout();
+
+#endif // MEMORY_H
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "huffman.h"
+#include "memory.h"
+
+pipeline *pipeline_start(FILE *input, FILE *output, size_t chunk_size, const pipeline_extent *extents,
+                         size_t extent_count, size_t padding) {
+    pipeline *p = memory_calloc(MEMORY_TAG_PIPELINE, 1, sizeof(pipeline));
+    p->input = input;
+    p->output = output;
+    p->chunk_size = chunk_size;
+    p->extents = extents;
+    p->extent_count = extent_count;
+    p->padding = padding;
+
+    // every queue can hold all the buffers of its side, so pushes never wait
+    p->inputs = blocking_queue_create(PIPELINE_DEPTH);
+    p->free_inputs = blocking_queue_create(PIPELINE_DEPTH);
+    p->outputs = blocking_queue_create(PIPELINE_DEPTH);
+    p->free_outputs = blocking_queue_create(PIPELINE_DEPTH);
+    for (int i = 0; i < PIPELINE_DEPTH; i++) {
+        blocking_queue_push(p->free_inputs, &p->buffers[i]);
+        blocking_queue_push(p->free_outputs, &p->buffers[PIPELINE_DEPTH + i]);
+    }
+
+    pthread_create(&p->reader, NULL, _pipeline_reader, p);
+    pthread_create(&p->writer, NULL, _pipeline_writer, p);
+    return p;
+}
+
+void _pipeline_reserve(pipeline_buffer *buffer, size_t capacity, size_t padding) {
+    if (buffer->data != NULL && capacity <= buffer->capacity) {
+        return;
+    }
+    memory_free(buffer->data);
+    buffer->capacity = capacity;
+    buffer->data = memory_alloc(MEMORY_TAG_PIPELINE, capacity + padding);
+}
+
+void *_pipeline_reader(void *argument) {
+    pipeline *p = argument;
+
+    for (size_t i = 0; p->extents == NULL || i < p->extent_count; i++) {
+        pipeline_buffer *buffer;
+        if (!blocking_queue_pop(p->free_inputs, (void **)&buffer)) {
+            break;
+        }
+
+        if (p->extents == NULL) {
+            _pipeline_reserve(buffer, p->chunk_size, p->padding);
+            buffer->size = fread(buffer->data, sizeof(unsigned char), p->chunk_size, p->input);
+            if (buffer->size == 0) {
+                blocking_queue_push(p->free_inputs, buffer);
+                break;
+            }
+        } else {
+            // a region cut short by the end of the file comes out short, the stage checks its size
+            _pipeline_reserve(buffer, p->extents[i].size, p->padding);
+            FSEEK64(p->input, p->extents[i].offset, SEEK_SET);
+            buffer->size = fread(buffer->data, sizeof(unsigned char), p->extents[i].size, p->input);
+        }
+        // the padding after the data is zeroed, whatever the previous use of the buffer left there
+        memset(buffer->data + buffer->size, 0, p->padding);
+
+        if (!blocking_queue_push(p->inputs, buffer)) {
+            break;
+        }
+    }
+
+    blocking_queue_close(p->inputs);
+    return NULL;
+}
+
+void *_pipeline_writer(void *argument) {
+    pipeline *p = argument;
+    pipeline_buffer *buffer;
+
+    while (blocking_queue_pop(p->outputs, (void **)&buffer)) {
+        if (!p->write_failed && fwrite(buffer->data, sizeof(unsigned char), buffer->size, p->output) != buffer->size) {
+            p->write_failed = true;
+        }
+        blocking_queue_push(p->free_outputs, buffer);
+    }
+
+    return NULL;
+}
+
+pipeline_buffer *pipeline_next_input(pipeline *p) {
+    pipeline_buffer *buffer;
+    if (!blocking_queue_pop(p->inputs, (void **)&buffer)) {
+        return NULL;
+    }
+    return buffer;
+}
+
+void pipeline_release_input(pipeline *p, pipeline_buffer *buffer) {
+    blocking_queue_push(p->free_inputs, buffer);
+}
+
+pipeline_buffer *pipeline_output_buffer(pipeline *p, size_t capacity) {
+    pipeline_buffer *buffer;
+    blocking_queue_pop(p->free_outputs, (void **)&buffer);
+    _pipeline_reserve(buffer, capacity, 0);
+    buffer->size = 0;
+    return buffer;
+}
+
+void pipeline_write(pipeline *p, pipeline_buffer *buffer) {
+    blocking_queue_push(p->outputs, buffer);
+}
+
+bool pipeline_finish(pipeline *p) {
+    // interrupt the reader if the stage stopped early, it may be waiting on either queue
+    blocking_queue_close(p->free_inputs);
+    blocking_queue_close(p->inputs);
+    pthread_join(p->reader, NULL);
+
+    // the writer drains what the stage handed over before it stops
+    blocking_queue_close(p->outputs);
+    pthread_join(p->writer, NULL);
+    bool valid = !p->write_failed;
+
+    for (int i = 0; i < 2 * PIPELINE_DEPTH; i++) {
+        memory_free(p->buffers[i].data);
+    }
+    blocking_queue_destroy(p->inputs);
+    blocking_queue_destroy(p->free_inputs);
+    blocking_queue_destroy(p->outputs);
+    blocking_queue_destroy(p->free_outputs);
+    memory_free(p);
+    return valid;
+}
@@ -0,0 +1,125 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "blocking_queue.h"
+
+#define PIPELINE_DEPTH 3                // Buffers on each side of the stage, one being processed and two in flight
+
+/**
+ * Structure to represent a region of the input file the reader loads as one buffer
+ */
+typedef struct pipeline_extent {
+    int64_t offset;                     // Offset in the input file
+    size_t size;                        // Number of bytes
+} pipeline_extent;
+
+/**
+ * Structure to represent a buffer moving between the threads of a pipeline
+ */
+typedef struct pipeline_buffer {
+    unsigned char *data;
+    size_t size;                        // Bytes used, for inputs the bytes actually read
+    size_t capacity;                    // Bytes allocated, padding excluded
+} pipeline_buffer;
+
+/**
+ * Structure to represent a reader thread and a writer thread around the stage run by the caller
+ * The reader fills input buffers ahead of the stage, the writer drains output buffers behind it,
+ * so disk reads, processing and disk writes of consecutive buffers overlap
+ */
+typedef struct pipeline {
+    FILE *input;
+    FILE *output;
+    size_t chunk_size;                  // Bytes per input buffer when reading the file in order
+    const pipeline_extent *extents;     // Regions to read instead, NULL to read the whole file in order
+    size_t extent_count;                // Number of regions
+    size_t padding;                     // Zeroed bytes kept readable after the data of every input buffer
+    pipeline_buffer buffers[2 * PIPELINE_DEPTH];  // Inputs then outputs
+    blocking_queue *inputs;             // Filled input buffers, in file order
+    blocking_queue *free_inputs;        // Input buffers the reader can fill again
+    blocking_queue *outputs;            // Output buffers waiting to be written, in file order
+    blocking_queue *free_outputs;       // Output buffers the stage can fill again
+    pthread_t reader;
+    pthread_t writer;
+    bool write_failed;                  // Set by the writer when the output file could not be written
+} pipeline;
+
+/**
+ * Starts the reader and the writer of a pipeline.
+ * @param input The input file.
+ * @param output The output file, positioned where the first output buffer goes.
+ * @param chunk_size The bytes per input buffer when reading the file in order.
+ * @param extents The regions to read, NULL to read the whole file in order.
+ * @param extent_count The number of regions.
+ * @param padding The zeroed bytes kept after the data of every input buffer.
+ * @return The pipeline.
+ */
+pipeline *pipeline_start(FILE *input, FILE *output, size_t chunk_size, const pipeline_extent *extents,
+                         size_t extent_count, size_t padding);
+
+/**
+ * Waits for the next input buffer.
+ * @param p The pipeline.
+ * @return The buffer, NULL at the end of the input.
+ */
+pipeline_buffer *pipeline_next_input(pipeline *p);
+
+/**
+ * Gives an input buffer back to the reader.
+ * @param p The pipeline.
+ * @param buffer The input buffer.
+ */
+void pipeline_release_input(pipeline *p, pipeline_buffer *buffer);
+
+/**
+ * Waits for a free output buffer, grown to hold at least a number of bytes.
+ * @param p The pipeline.
+ * @param capacity The number of bytes needed.
+ * @return The buffer, empty.
+ */
+pipeline_buffer *pipeline_output_buffer(pipeline *p, size_t capacity);
+
+/**
+ * Hands an output buffer to the writer, buffers are written in the order they are handed over.
+ * @param p The pipeline.
+ * @param buffer The output buffer.
+ */
+void pipeline_write(pipeline *p, pipeline_buffer *buffer);
+
+/**
+ * Writes the output buffers left, stops the threads and destroys the pipeline.
+ * The stage may stop before the end of the input, the reader is interrupted.
+ * @param p The pipeline.
+ * @return true if successful, false if the output file could not be written.
+ */
+bool pipeline_finish(pipeline *p);
+
+/**
+ * Reader thread, fills input buffers until the end of the input or until interrupted.
+ * @param argument The pipeline.
+ * @return NULL.
+ */
+void *_pipeline_reader(void *argument);
+
+/**
+ * Writer thread, writes output buffers until the queue is closed.
+ * @param argument The pipeline.
+ * @return NULL.
+ */
+void *_pipeline_writer(void *argument);
+
+/**
+ * Grows a buffer, keeping room for padding bytes after its capacity.
+ * @param buffer The buffer.
+ * @param capacity The number of bytes needed.
+ * @param padding The number of bytes after the capacity.
+ */
+void _pipeline_reserve(pipeline_buffer *buffer, size_t capacity, size_t padding);
+
+#endif // PIPELINE_H
@@ -3,6 +3,7 @@
 #include <string.h>
 
 #include "priority_queue.h"
+#include "memory.h"
 
 #define PARENT_AT(i) ((i - 1) / 2)
 #define LEFT_CHILD_OF(i) (2 * i + 1)
@@ -10,7 +11,7 @@
 
 priority_queue* priority_queue_create(void (*destroy)(void* data), int (*compare)(const void* key1, const void* key2)) {
     // allocate memory for the queue
-    priority_queue* queue = malloc(sizeof(priority_queue));
+    priority_queue* queue = memory_alloc(MEMORY_TAG_QUEUE, sizeof(priority_queue));
 
     // if allocation fails, return NULL
     if (queue == NULL) {
@@ -43,8 +44,8 @@ void priority_queue_destroy(priority_queue* queue) {
     }
 
     // free the memory
-    free(queue->heap);
-    free(queue);
+    memory_free(queue->heap);
+    memory_free(queue);
 }
 
 int priority_queue_insert(priority_queue* queue, const void* data) {
@@ -61,7 +62,7 @@ int priority_queue_insert(priority_queue* queue, const void* data) {
         // calculate new capacity
         int new_capacity = queue->capacity == 0 ? 1 : queue->capacity * 2;
         // reallocate memory
-        temp = realloc(queue->heap, new_capacity * sizeof(void*));
+        temp = memory_realloc(MEMORY_TAG_QUEUE, queue->heap, new_capacity * sizeof(void*));
 
         // if reallocation fails
         if (temp == NULL) {
@@ -141,7 +142,7 @@ int priority_queue_extract(priority_queue* queue, void** data) {
         int new_capacity = queue->capacity / 2;
 
         // reallocate memory
-        temp = realloc(queue->heap, new_capacity * sizeof(void*));
+        temp = memory_realloc(MEMORY_TAG_QUEUE, queue->heap, new_capacity * sizeof(void*));
 
         // if reallocation fails
         if (temp == NULL) {
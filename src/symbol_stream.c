@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbol_stream.h"
+#include "memory.h"
+
+symbol_stream *symbol_stream_create() {
+    symbol_stream *stream = memory_alloc(MEMORY_TAG_SYMBOLS, sizeof(symbol_stream));
+    stream->capacity = SYMBOL_STREAM_INITIAL_CAPACITY;
+    stream->symbols = memory_alloc(MEMORY_TAG_SYMBOLS, stream->capacity * sizeof(uint32_t));
+    stream->count = 0;
+    stream->position = 0;
+    stream->spill = NULL;
+    stream->spilled = 0;
+    return stream;
+}
+
+void symbol_stream_destroy(symbol_stream *stream) {
+    if (stream == NULL) {
+        return;
+    }
+    // temporary files are removed when closed
+    if (stream->spill != NULL) {
+        fclose(stream->spill);
+    }
+    memory_free(stream->symbols);
+    memory_free(stream);
+}
+
+void _symbol_stream_grow(symbol_stream *stream) {
+    // under a memory limit the buffer stops growing once the process passes its share
+    if (stream->capacity >= SYMBOL_STREAM_MEMORY_LIMIT || memory_exceeds(MEMORY_SPILL_SHARE)) {
+        if (stream->spill == NULL) {
+            stream->spill = tmpfile();
+        }
+        // without a temporary file the symbols keep growing in memory
+        if (stream->spill != NULL && fwrite(stream->symbols, sizeof(uint32_t), stream->count, stream->spill) == stream->count) {
+            stream->spilled += stream->count;
+            stream->count = 0;
+            return;
+        }
+    }
+    stream->capacity *= 2;
+    stream->symbols = memory_realloc(MEMORY_TAG_SYMBOLS, stream->symbols, stream->capacity * sizeof(uint32_t));
+}
+
+bool symbol_stream_rewind(symbol_stream *stream) {
+    stream->position = 0;
+    if (stream->spill == NULL) {
+        return true;
+    }
+
+    // the symbols still in memory go after the spilled ones, then everything is read from the file
+    if (fwrite(stream->symbols, sizeof(uint32_t), stream->count, stream->spill) != stream->count) {
+        printf("Error: could not write the temporary symbol file\n");
+        return false;
+    }
+    stream->spilled += stream->count;
+    stream->count = 0;
+    rewind(stream->spill);
+    return true;
+}
+
+size_t symbol_stream_read(symbol_stream *stream, uint32_t *symbols, size_t count) {
+    if (stream->spill != NULL) {
+        return fread(symbols, sizeof(uint32_t), count, stream->spill);
+    }
+
+    if (count > stream->count - stream->position) {
+        count = stream->count - stream->position;
+    }
+    memcpy(symbols, stream->symbols + stream->position, count * sizeof(uint32_t));
+    stream->position += count;
+    return count;
+}
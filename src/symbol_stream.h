@@ -0,0 +1,72 @@
+#ifndef SYMBOL_STREAM_H
+#define SYMBOL_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define SYMBOL_STREAM_INITIAL_CAPACITY (1 << 16)
+#define SYMBOL_STREAM_MEMORY_LIMIT (1 << 24)    // Symbols kept in memory before spilling to a temporary file
+
+/**
+ * Structure to represent a sequence of 32-bit symbols written once and read back once, in order
+ * Symbols stay in memory until SYMBOL_STREAM_MEMORY_LIMIT, then the buffer is spilled to a temporary file
+ * Under a memory limit the buffer is spilled earlier, once the process passes MEMORY_SPILL_SHARE of it
+ */
+typedef struct symbol_stream {
+    uint32_t *symbols;          // Symbols held in memory
+    size_t count;               // Number of symbols in memory
+    size_t capacity;            // Capacity of the memory buffer
+    size_t position;            // Next symbol of the memory buffer to read
+    FILE *spill;                // Temporary file of the symbols that did not fit, NULL if none
+    uint64_t spilled;           // Number of symbols in the temporary file
+} symbol_stream;
+
+/**
+ * Creates a new empty symbol stream.
+ * @return The new symbol stream.
+ */
+symbol_stream *symbol_stream_create();
+
+/**
+ * Destroys the symbol stream and its temporary file.
+ * @param stream The symbol stream to destroy.
+ */
+void symbol_stream_destroy(symbol_stream *stream);
+
+/**
+ * Grows the memory buffer, or spills it to the temporary file once it reached the limit.
+ * @param stream The symbol stream.
+ */
+void _symbol_stream_grow(symbol_stream *stream);
+
+/**
+ * Appends a symbol to the stream.
+ * @param stream The symbol stream.
+ * @param symbol The symbol.
+ */
+static inline void symbol_stream_write(symbol_stream *stream, uint32_t symbol) {
+    if (stream->count == stream->capacity) {
+        _symbol_stream_grow(stream);
+    }
+    stream->symbols[stream->count++] = symbol;
+}
+
+/**
+ * Ends the writes and moves back to the first symbol.
+ * @param stream The symbol stream.
+ * @return true if successful, false if the temporary file could not be written.
+ */
+bool symbol_stream_rewind(symbol_stream *stream);
+
+/**
+ * Reads the next symbols of a rewound stream.
+ * @param stream The symbol stream.
+ * @param symbols The buffer receiving the symbols.
+ * @param count The number of symbols to read.
+ * @return The number of symbols read, less than count only at the end of the stream.
+ */
+size_t symbol_stream_read(symbol_stream *stream, uint32_t *symbols, size_t count);
+
+#endif // SYMBOL_STREAM_H
@@ -1,13 +1,14 @@
 
 #include "trie.h"
+#include "memory.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 trie* trie_create() {
-    trie* t = malloc(sizeof(trie));
-    t->root = malloc(sizeof(trie_node));
+    trie* t = memory_alloc(MEMORY_TAG_TRIE, sizeof(trie));
+    t->root = memory_alloc(MEMORY_TAG_TRIE, sizeof(trie_node));
     for (int i = 0; i < 256; i++) {
         t->root->children[i] = NULL;
     }
@@ -19,9 +20,9 @@ void trie_destroy(trie* t, void (*destroy_data)(void* data)) {
     if (t == NULL) {
         return;
     }
+    // the helper frees the root node too
     _trie_destroy_helper(t->root, destroy_data);
-    free(t->root);
-    free(t);
+    memory_free(t);
 }
 
 void _trie_destroy_helper(trie_node* node, void (*destroy_data)(void* data)) {
@@ -34,14 +35,19 @@ void _trie_destroy_helper(trie_node* node, void (*destroy_data)(void* data)) {
     if (node->data != NULL && destroy_data != NULL) {
         destroy_data(node->data);
     }
-    free(node);
+    memory_free(node);
 }
 
 bool trie_insert(trie* t, const char* word, void* data) {
+    *trie_slot(t, word) = data;
+    return true;
+}
+
+void** trie_slot(trie* t, const char* word) {
     trie_node* current = t->root;
     for (int i = 0; word[i] != '\0'; i++) {
         if (current->children[(unsigned char)word[i]] == NULL) {
-            current->children[(unsigned char)word[i]] = malloc(sizeof(trie_node));
+            current->children[(unsigned char)word[i]] = memory_alloc(MEMORY_TAG_TRIE, sizeof(trie_node));
             for (int j = 0; j < 256; j++) {
                 current->children[(unsigned char)word[i]]->children[j] = NULL;
             }
@@ -49,8 +55,15 @@ bool trie_insert(trie* t, const char* word, void* data) {
         }
         current = current->children[(unsigned char)word[i]];
     }
-    current->data = data;
-    return true;
+    return &current->data;
+}
+
+void* trie_get(const trie* t, const char* word) {
+    const trie_node* current = t->root;
+    for (int i = 0; word[i] != '\0' && current != NULL; i++) {
+        current = current->children[(unsigned char)word[i]];
+    }
+    return current != NULL ? current->data : NULL;
 }
 
 void trie_print(trie* t) {
@@ -88,16 +101,20 @@ void _trie_keys_helper(const trie_node* node, const char* prefix, dynamic_array
         return;
     }
     if (node->data != NULL) {
-        char *key = malloc((strlen(prefix) + 1) * sizeof(char));
+        char *key = memory_alloc(MEMORY_TAG_TRIE_KEYS, (strlen(prefix) + 1) * sizeof(char));
         strcpy(key, prefix);
         dynamic_array_insert(keys, key);
     }
     for (int i = 0; i < 256; i++) {
-        char *new_prefix = malloc((strlen(prefix) + 2) * sizeof(char));
+        if (node->children[i] == NULL) {
+            continue;
+        }
+        char *new_prefix = memory_alloc(MEMORY_TAG_TRIE_KEYS, (strlen(prefix) + 2) * sizeof(char));
         strcpy(new_prefix, prefix);
         new_prefix[strlen(prefix)] = (char)i;
         new_prefix[strlen(prefix) + 1] = '\0';
         _trie_keys_helper(node->children[i], new_prefix, keys, index + 1);
+        memory_free(new_prefix);
     }
 }
 
@@ -108,18 +125,25 @@ void* trie_search(const trie* t, const char* word, int *steps, bool greedy) {
     for (int i = 0; word[i] != '\0'; i++) {
         if (current->data != NULL) {
             if (greedy) {
+                *steps = i;
                 return current->data;
             } else {
                 last_data = current->data;
+                last_data_steps = i;
             }
         }
         if (current->children[(unsigned char)word[i]] == NULL) {
             *steps = last_data_steps;
             return last_data;
         }
-        *steps += 1;
-        last_data_steps += 1;
         current = current->children[(unsigned char)word[i]];
+        *steps = i + 1;
+    }
+
+    // the whole word was consumed, fall back to the longest prefix if it has no data
+    if (current->data == NULL) {
+        *steps = last_data_steps;
+        return last_data;
     }
 
     return current->data;
@@ -43,6 +43,23 @@ void _trie_destroy_helper(trie_node* node, void (*destroy_data)(void* data));
  */
 bool trie_insert(trie* t, const char* word, void* data);
 
+/**
+ * Returns the data slot of a word, inserting the word with NULL data if it is missing.
+ * Lets counters update a word with a single walk of the trie.
+ * @param t The trie.
+ * @param word The word.
+ * @return The address of the data associated with the word.
+ */
+void** trie_slot(trie* t, const char* word);
+
+/**
+ * Returns the data of a word, only if the whole word is in the trie.
+ * @param t The trie.
+ * @param word The word.
+ * @return The data associated with the word, or NULL if it is missing.
+ */
+void* trie_get(const trie* t, const char* word);
+
 void trie_print(trie* t);
 
 void _trie_print_helper(trie_node* node, int level);
@@ -67,8 +84,9 @@ void _trie_keys_helper(const trie_node* node, const char* prefix, dynamic_array
  * Searches for a word in the trie.
  * @param t The trie.
  * @param word The word to search for.
+ * @param steps Set to the length of the matched prefix of the word.
  * @param greedy If true, return the data associated with the first prefix of the word found.
- * @return The data associated with the word, or NULL if the word is not found.
+ * @return The data associated with the longest prefix of the word found, or NULL if none is found.
  */
 void* trie_search(const trie* t, const char* word, int *steps, bool greedy);
 
@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "vocabulary.h"
+#include "memory.h"
+
+vocabulary *vocabulary_create() {
+    vocabulary *vocab = memory_alloc(MEMORY_TAG_VOCABULARY, sizeof(vocabulary));
+    vocab->index = trie_create();
+    vocab->capacity = 256;
+    vocab->words = memory_alloc(MEMORY_TAG_VOCABULARY, vocab->capacity * sizeof(char *));
+    vocab->freqs = memory_alloc(MEMORY_TAG_VOCABULARY, vocab->capacity * sizeof(uint64_t));
+    vocab->count = 0;
+    return vocab;
+}
+
+void vocabulary_destroy(vocabulary *vocab) {
+    if (vocab == NULL) {
+        return;
+    }
+    // the index only holds ids, nothing to free in it
+    trie_destroy(vocab->index, NULL);
+    for (size_t i = 0; i < vocab->count; i++) {
+        memory_free(vocab->words[i]);
+    }
+    memory_free(vocab->words);
+    memory_free(vocab->freqs);
+    memory_free(vocab);
+}
+
+void _vocabulary_grow(vocabulary *vocab) {
+    vocab->capacity *= 2;
+    vocab->words = memory_realloc(MEMORY_TAG_VOCABULARY, vocab->words, vocab->capacity * sizeof(char *));
+    vocab->freqs = memory_realloc(MEMORY_TAG_VOCABULARY, vocab->freqs, vocab->capacity * sizeof(uint64_t));
+}
+
+uint32_t vocabulary_add(vocabulary *vocab, const char *word, uint64_t freq) {
+    // one walk of the index finds the word or makes room for it
+    void **slot = trie_slot(vocab->index, word);
+    if (*slot != NULL) {
+        uint32_t symbol = (uint32_t)((uintptr_t)*slot - 1);
+        vocab->freqs[symbol] += freq;
+        return symbol;
+    }
+
+    if (vocab->count == vocab->capacity) {
+        _vocabulary_grow(vocab);
+    }
+    uint32_t symbol = (uint32_t)vocab->count++;
+    vocab->words[symbol] = memory_strdup(MEMORY_TAG_VOCABULARY, word);
+    vocab->freqs[symbol] = freq;
+    *slot = (void *)(uintptr_t)(symbol + 1);
+    return symbol;
+}
+
+uint32_t vocabulary_find(const vocabulary *vocab, const char *word) {
+    void *data = trie_get(vocab->index, word);
+    return data != NULL ? (uint32_t)((uintptr_t)data - 1) : VOCABULARY_NO_SYMBOL;
+}
+
+void vocabulary_merge(vocabulary *target, const vocabulary *source, uint32_t *remap) {
+    for (size_t i = 0; i < source->count; i++) {
+        remap[i] = vocabulary_add(target, source->words[i], source->freqs[i]);
+    }
+}
+
+int _vocabulary_compare(const void *entry1, const void *entry2) {
+    // strcmp compares bytes as unsigned char, like the children of a trie node
+    return strcmp(((const vocabulary_entry *)entry1)->word, ((const vocabulary_entry *)entry2)->word);
+}
+
+uint32_t *vocabulary_sort(vocabulary *vocab) {
+    vocabulary_entry *entries = memory_alloc(MEMORY_TAG_VOCABULARY, vocab->count * sizeof(vocabulary_entry));
+    for (size_t i = 0; i < vocab->count; i++) {
+        entries[i].word = vocab->words[i];
+        entries[i].freq = vocab->freqs[i];
+        entries[i].symbol = (uint32_t)i;
+    }
+    qsort(entries, vocab->count, sizeof(vocabulary_entry), _vocabulary_compare);
+
+    // renumber the words and point the index at their new ids
+    uint32_t *remap = memory_alloc(MEMORY_TAG_VOCABULARY, (vocab->count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < vocab->count; i++) {
+        vocab->words[i] = entries[i].word;
+        vocab->freqs[i] = entries[i].freq;
+        remap[entries[i].symbol] = (uint32_t)i;
+        *trie_slot(vocab->index, entries[i].word) = (void *)(uintptr_t)(i + 1);
+    }
+
+    memory_free(entries);
+    return remap;
+}
@@ -0,0 +1,89 @@
+#ifndef VOCABULARY_H
+#define VOCABULARY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "trie.h"
+
+#define VOCABULARY_NO_SYMBOL 0xFFFFFFFFu    // Symbol id of a missing word
+
+/**
+ * Structure to represent the distinct words of a text, each with a dense symbol id and a frequency
+ */
+typedef struct vocabulary {
+    trie *index;                // Word to symbol id + 1
+    char **words;               // Words by symbol id
+    uint64_t *freqs;            // Frequencies by symbol id
+    size_t count;               // Number of words
+    size_t capacity;            // Capacity of the arrays
+} vocabulary;
+
+/**
+ * Structure to sort the words of a vocabulary while remembering their old ids
+ */
+typedef struct vocabulary_entry {
+    char *word;
+    uint64_t freq;
+    uint32_t symbol;            // Symbol id before sorting
+} vocabulary_entry;
+
+/**
+ * Creates a new empty vocabulary.
+ * @return The new vocabulary.
+ */
+vocabulary *vocabulary_create();
+
+/**
+ * Destroys the vocabulary and its words.
+ * @param vocab The vocabulary to destroy.
+ */
+void vocabulary_destroy(vocabulary *vocab);
+
+/**
+ * Adds occurrences of a word, giving it the next symbol id if it is new.
+ * @param vocab The vocabulary.
+ * @param word The word.
+ * @param freq The number of occurrences to add.
+ * @return The symbol id of the word.
+ */
+uint32_t vocabulary_add(vocabulary *vocab, const char *word, uint64_t freq);
+
+/**
+ * Finds the symbol id of a word.
+ * @param vocab The vocabulary.
+ * @param word The word.
+ * @return The symbol id of the word, VOCABULARY_NO_SYMBOL if it is missing.
+ */
+uint32_t vocabulary_find(const vocabulary *vocab, const char *word);
+
+/**
+ * Adds the words and frequencies of a vocabulary to another one.
+ * @param target The vocabulary receiving the words.
+ * @param source The vocabulary giving its words, left unchanged.
+ * @param remap Receives the symbol id in target of every symbol id of source.
+ */
+void vocabulary_merge(vocabulary *target, const vocabulary *source, uint32_t *remap);
+
+/**
+ * Renumbers the words in byte order, the order of the keys of a trie.
+ * @param vocab The vocabulary.
+ * @return The new symbol id of every old symbol id, to be freed by the caller.
+ */
+uint32_t *vocabulary_sort(vocabulary *vocab);
+
+/**
+ * Doubles the capacity of the arrays.
+ * @param vocab The vocabulary.
+ */
+void _vocabulary_grow(vocabulary *vocab);
+
+/**
+ * Compares two entries by word, bytes compared unsigned.
+ * @param entry1 The first entry.
+ * @param entry2 The second entry.
+ * @return The comparison of the words.
+ */
+int _vocabulary_compare(const void *entry1, const void *entry2);
+
+#endif // VOCABULARY_H
@@ -6,7 +6,7 @@
 @REM clear && gcc -g src/main.c src/priority_queue.c src/bitvector.c src/huffman.c src/trie.c src/dynamic_array.c -o huffman && gdb -ex "run" -ex "bt" --args ./huffman -D test_int.huffed test_out.txt
 
 clear
-gcc -O2 src/main.c src/priority_queue.c src/bitvector.c src/huffman.c src/trie.c src/dynamic_array.c -o huffman
+gcc -O2 src/main.c src/priority_queue.c src/bitvector.c src/huffman.c src/trie.c src/dynamic_array.c src/blocking_queue.c src/batch.c src/bitstream.c src/canonical.c src/block.c src/ans.c src/lz.c src/symbol_stream.c src/vocabulary.c src/pipeline.c src/crc32c.c src/mapped_file.c src/counts.c src/grep.c src/info.c src/memory.c -o huffman -lpthread -lm
 
 clear
 
@@ -7,5 +7,5 @@ clear &&
 # time ./huffman -C -t 0 100mb.txt test_int.huffed > encode.log
 # time ./huffman -D -t 0 test_int.huffed test_out.txt > decode.log
 
-clear && gcc -g src/main.c src/priority_queue.c src/bitvector.c src/huffman.c src/trie.c src/dynamic_array.c -o huffman &&
+clear && gcc -g src/main.c src/priority_queue.c src/bitvector.c src/huffman.c src/trie.c src/dynamic_array.c src/blocking_queue.c src/batch.c src/bitstream.c src/canonical.c src/block.c src/ans.c src/lz.c src/symbol_stream.c src/vocabulary.c src/pipeline.c src/crc32c.c src/mapped_file.c src/counts.c src/grep.c src/info.c src/memory.c -o huffman -lpthread -lm &&
 clear && gdb -ex "run" -ex "bt" --args ./huffman -C -t 1 1mb.txt test_int.huffed
\ No newline at end of file